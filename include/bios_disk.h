@@ -70,6 +70,8 @@ extern const uint8_t freedos_mbr[];
 #define FilSysType32  0x52 /* 8-bytes */
 #define BootCode32 0x5A
 
+class MappedFile;
+
 class imageDisk {
 	public:
 		enum IMAGE_TYPE {
@@ -88,6 +90,13 @@ class imageDisk {
 		virtual uint8_t Write_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,const void * data,unsigned int req_sector_size=0);
 		virtual uint8_t Read_AbsoluteSector(uint32_t sectnum, void * data);
 		virtual uint8_t Write_AbsoluteSector(uint32_t sectnum, const void * data);
+		/* transfer count consecutive sectors. the default loops over Read/Write_AbsoluteSector,
+		 * raw images do it with a single positioned read/write. */
+		virtual uint8_t Read_Sectors(uint32_t sectnum, uint32_t count, void * data);
+		virtual uint8_t Write_Sectors(uint32_t sectnum, uint32_t count, const void * data);
+		/* true if Read_Sectors may run on another thread (IDE async host io) while this one keeps
+		 * using the image. Call from the emulation thread. */
+		virtual bool CanReadConcurrently(void);
 
 		virtual void UpdateFloppyType(void);
 		virtual void Set_Reserved_Cylinders(Bitu resCyl);
@@ -127,6 +136,14 @@ class imageDisk {
 		uint64_t image_base = 0;
 		uint64_t image_length = 0;
 
+		/* read-only images may be served from a memory mapping, set up on first read */
+		MappedFile* mapped = NULL;
+		bool mapped_tried = false;
+
+		void TryMapping(void);
+		uint8_t Read_Raw(uint32_t sectnum, uint32_t count, void * data);
+		uint8_t Write_Raw(uint32_t sectnum, uint32_t count, const void * data);
+
 	private:
 		volatile int refcount = 0;
 		std::vector<bool> partition_in_use; /* used by FAT driver to prevent mounting a partition twice */
@@ -284,6 +301,8 @@ class imageDiskMemory : public imageDisk {
 public:
 	uint8_t Read_AbsoluteSector(uint32_t sectnum, void * data) override;
 	uint8_t Write_AbsoluteSector(uint32_t sectnum, const void * data) override;
+	uint8_t Read_Sectors(uint32_t sectnum, uint32_t count, void * data) override;
+	uint8_t Write_Sectors(uint32_t sectnum, uint32_t count, const void * data) override;
 	uint8_t GetBiosType(void) override;
 	void Set_Geometry(uint32_t setHeads, uint32_t setCyl, uint32_t setSect, uint32_t setSectSize) override;
 	// Partition and format the ramdrive
@@ -380,6 +399,8 @@ public:
     VHDTypes vhdType = VHD_TYPE_NONE;
 	uint8_t Read_AbsoluteSector(uint32_t sectnum, void * data) override;
 	uint8_t Write_AbsoluteSector(uint32_t sectnum, const void * data) override;
+	uint8_t Read_Sectors(uint32_t sectnum, uint32_t count, void * data) override;
+	uint8_t Write_Sectors(uint32_t sectnum, uint32_t count, const void * data) override;
 	static ErrorCodes Open(const char* fileName, const bool readOnly, imageDisk** disk);
 	static VHDTypes GetVHDType(const char* fileName);
 	VHDTypes GetVHDType(void) const;
@@ -435,6 +456,12 @@ private:
 	static bool convert_UTF16_for_fopen(std::string &string, const void* data, const uint32_t dataLength);
     bool is_zeroed_sector(const void* data);
 	bool is_block_allocated(uint32_t blockNumber);
+	bool allocateBlock(const uint32_t blockNumber);
+	bool takeBlockMapSlot(size_t &slot);
+	bool writeBlockMap(size_t slot);
+	bool flushMetadata(void);
+	void scheduleMetadataFlush(void);
+	static void metadataFlushTick(void);
 
     imageDisk* parentDisk = NULL;
     imageDisk* fixedDisk = NULL;
@@ -449,7 +476,24 @@ private:
 	uint32_t currentBlock = 0xFFFFFFFF;
     bool currentBlockAllocated = false;
 	uint32_t currentBlockSectorOffset = 0;
-	uint8_t* currentBlockDirtyMap = nullptr;
+	uint8_t* currentBlockDirtyMap = nullptr; //points into the slot of currentBlock, if allocated
+
+	//the BAT, in host byte order, and the sector bitmaps of recently used blocks.
+	//Changed bitmaps are written back when evicted, by a tick handler about a second after they
+	//were changed (while emulation runs), or on close.
+	struct BlockMapSlot {
+		uint32_t block = 0xFFFFFFFF;
+		uint32_t sectorOffset = 0;
+		bool dirty = false;
+		uint64_t lastUsed = 0;
+		std::vector<uint8_t> map;
+	};
+	std::vector<uint32_t> blockTable;
+	std::vector<BlockMapSlot> blockMapCache;
+	BlockMapSlot* currentBlockMapSlot = nullptr;
+	uint64_t blockMapClock = 0;
+	bool metadataFlushPending = false;
+	uint32_t lastMetadataFlush = 0;
 };
 
 /* C++ class implementing El Torito floppy emulation */
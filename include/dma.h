@@ -46,6 +46,12 @@ const char *DMAActorStr(const DMAActor a);
 class DmaChannel;
 typedef void (* DMA_CallBack)(DmaChannel * chan,DMAEvent event);
 
+/* A run of guest RAM covered by a DMA transfer, see DmaChannel::ReadSpans() */
+struct DmaSpan {
+	const uint8_t *ptr;     /* host pointer into guest RAM */
+	Bitu units;             /* length in DMA transfer units (bytes for 8-bit DMA, WORDs for 16-bit DMA) */
+};
+
 class DmaChannel {
 public:
 	uint32_t pagebase;
@@ -143,8 +149,19 @@ public:
 	Bitu Read(Bitu want, uint8_t * buffer);
 	Bitu Write(Bitu want, uint8_t * buffer);
 
+	/* Same as Read() and advances the channel the same way, but instead of copying the data
+	 * returns where it lives in guest RAM so the device can consume it in place. Page boundaries,
+	 * EMS mapping and address wrapping are honored, contiguous pieces are merged.
+	 * Only increment-mode transfers from system RAM can be mapped. The transfer stops short
+	 * (return value less than want) at anything that cannot be mapped or when max_spans are
+	 * used up, and the caller is expected to Read() the remainder if the channel is still unmasked.
+	 * The pointers are valid only until the guest runs again. */
+	Bitu ReadSpans(Bitu want, DmaSpan * spans, unsigned int max_spans, unsigned int &nspans);
+
 	void SaveState( std::ostream& stream );
 	void LoadState( std::istream& stream );
+private:
+	template <class BlockOp> Bitu ReadBlocks(Bitu want, BlockOp &op);
 };
 
 class DmaController {
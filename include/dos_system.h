@@ -24,6 +24,10 @@
 #include "string.h"
 #include "support.h"
 #include "mem.h"
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
 
 #define DOS_NAMELENGTH 12u
 #define DOS_NAMELENGTH_ASCII (DOS_NAMELENGTH+1)
@@ -228,6 +232,7 @@ public:
 	void		DeleteEntry			(const char* path, bool ignoreLastDir = false);
 
 	void		EmptyCache			(void);
+	void		EnableHostWatch		(void);
 	void		MediaChange			(void);
 	void		SetLabel			(const char* vname,bool cdrom,bool allowupdate);
 	char*		GetLabel			(void) { return label; };
@@ -242,18 +247,22 @@ public:
 		~CFileInfo(void) {
 			for (uint32_t i=0; i<fileList.size(); i++) delete fileList[i];
 			fileList.clear();
-			longNameList.clear();
 		};
 		char		orgname		[CROSS_LEN];
 		char		shortname	[DOS_NAMELENGTH_ASCII];
 		bool        isOverlayDir;
 		bool		isDir;
+		bool		stale = false;		// host directory changed since it was read in
+		int			watch = -1;			// inotify watch descriptor, if watched
 		uint16_t		id = MAX_OPENDIRS;
 		Bitu		nextEntry;
 		Bitu		shortNr;
 		// contents
 		std::vector<CFileInfo*>	fileList;
-		std::vector<CFileInfo*>	longNameList;
+		// lookup of the contents, kept in step with fileList
+		std::unordered_map<std::string,CFileInfo*>		shortIndex;		// short name
+		std::unordered_multimap<std::string,CFileInfo*>	longIndex;		// long name, ASCII upper case
+		std::unordered_map<std::string,std::set<Bitu> >	aliasIndex;		// "STEM~<digits>" of generated names -> shortNr in use
 	};
 
 private:
@@ -264,7 +273,10 @@ private:
 	Bits		GetLongName		(CFileInfo* curDir, char* shortName);
 	void		CreateShortName		(CFileInfo* curDir, CFileInfo* info);
 	Bitu		CreateShortNameID	(CFileInfo* curDir, const char* name);
-	int		CompareShortname	(const char* compareName, const char* shortName);
+	void		IndexEntry		(CFileInfo* dir, CFileInfo* info);
+	void		UnindexEntry		(CFileInfo* dir, CFileInfo* info);
+	CFileInfo*	FindLongName		(CFileInfo* dir, const char* name, bool exact);
+	Bits		IndexOf			(CFileInfo* dir, CFileInfo* info);
     bool        SetResult       (CFileInfo* dir, char * &result, char * &lresult, Bitu entryNr);
 	bool		IsCachedIn		(CFileInfo* curDir);
 	CFileInfo*	FindDirInfo		(const char* path, char* expandedPath);
@@ -275,6 +287,12 @@ private:
 	uint16_t		GetFreeID		(CFileInfo* dir);
 	void		Clear			(void);
 
+	void		PollHostWatch		(void);
+	void		AddHostWatch		(CFileInfo* dir, const char* path);
+	void		RemoveHostWatch		(CFileInfo* dir);
+	void		RefreshDir		(CFileInfo* dir, const char* path);
+	void		RemoveEntry		(CFileInfo* dir, size_t index);
+
 	CFileInfo*	dirBase;
 	char		dirPath				[CROSS_LEN] = {};
 	DOS_Drive*	drive = NULL;
@@ -293,6 +311,9 @@ private:
 
 	char		label				[CROSS_LEN];
 	bool		updatelabel;
+
+	int			watchFd = -1;
+	std::map<int,CFileInfo*> watchList;
 };
 
 class DOS_Drive {
@@ -327,11 +348,12 @@ public:
 	virtual bool isRemovable(void)=0;
 	virtual Bits UnMount(void)=0;
 
-	/* these 4 may only be used by DOS_Drive_Cache because they have special calling conventions */
+	/* these 5 may only be used by DOS_Drive_Cache because they have special calling conventions */
 	virtual void *opendir(const char *dir) { (void)dir; return NULL; };
 	virtual void closedir(void *handle) { (void)handle; };
     virtual bool read_directory_first(void *handle, char* entry_name, char* entry_sname, bool& is_directory) { (void)handle; (void)entry_name; (void)entry_sname; (void)is_directory; return false; };
     virtual bool read_directory_next(void *handle, char* entry_name, char* entry_sname, bool& is_directory) { (void)handle; (void)entry_name; (void)entry_sname; (void)is_directory; return false; };
+	virtual int add_directory_watch(int fd, const char *dir, uint32_t mask) { (void)fd; (void)dir; (void)mask; return -1; };
 	virtual const char * GetInfo(void);
 	char * GetBaseDir(void);
 
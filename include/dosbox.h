@@ -354,6 +354,10 @@ public:
 
     void registerComponent(const std::string& uniqueName, Component& comp); //comp must have global lifetime!
 
+    //in-memory states for rewinding: all components back to back, and the size of each
+    void snapshot(std::vector<char>& data, std::vector<size_t>& sizes);
+    void restore(const std::vector<char>& data, const std::vector<size_t>& sizes) const;
+
 private:
     SaveState() {}
     SaveState(const SaveState&);
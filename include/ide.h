@@ -18,5 +18,6 @@ void IDE_Hard_Disk_Attach(signed char index,bool slave,unsigned char bios_disk_i
 void IDE_Hard_Disk_Detach(unsigned char bios_disk_index);
 void IDE_ResetDiskByBIOS(unsigned char disk);
 bool IDE_controller_occupied(signed char index, bool slave);
+void IDE_WaitHostIO(void);
 
 #endif
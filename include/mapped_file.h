@@ -0,0 +1,67 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_MAPPED_FILE_H
+#define DOSBOX_MAPPED_FILE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/* Read-only memory mapping of a whole host file.
+ *
+ * Reads are served from the host page cache, so several DOSBox-X instances using the same
+ * image share its pages instead of each holding its own stdio buffers. Mapping is optional:
+ * Map() returns false if the host cannot do it, and the caller keeps using its file I/O. */
+class MappedFile {
+public:
+    enum Advice {
+        ADVICE_NORMAL=0,
+        ADVICE_SEQUENTIAL,
+        ADVICE_RANDOM
+    };
+
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /* fp must already be open, and is left open. Fails if fp was opened for writing. */
+    bool Map(FILE *fp);
+    bool Map(const char *path);
+    void Unmap(void);
+
+    bool Read(void *data, uint64_t offset, size_t count) const;
+    bool IsMapped(void) const { return base != NULL; }
+    uint64_t Size(void) const { return size; }
+
+    /* [dos] "map read-only images" settings, applied to images opened afterwards */
+    static bool enabled;
+    static Advice advice;
+    static bool hugepages;
+private:
+    void ApplyAdvice(void);
+
+    const uint8_t *base = NULL;
+    uint64_t size = 0;
+#if defined(WIN32)
+    void *mapping = NULL;
+#endif
+};
+
+#endif
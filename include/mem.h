@@ -269,6 +269,12 @@ void MEM_BlockRead(LinearPt pt,void * data,Bitu size);
 void MEM_BlockWrite32(LinearPt pt,void * data,Bitu size);
 void MEM_BlockRead32(LinearPt pt,void * data,Bitu size);
 void MEM_BlockCopy(LinearPt dest,LinearPt src,Bitu size);
+
+/* Host pointer to a linear range that is plain RAM already mapped in the TLB, so the caller
+ * can access it directly instead of through MEM_BlockRead/MEM_BlockWrite. Returns NULL if any
+ * page of the range would need a page handler (or a page fault), or the range is not one
+ * contiguous block of host memory. Only valid until the guest runs again. */
+HostPt MEM_GetBlockHostPt(LinearPt pt, size_t size, bool writing);
 void MEM_StrCopy(LinearPt pt,char * data,Bitu size);
 
 void mem_memcpy(LinearPt dest,LinearPt src,Bitu size);
@@ -125,6 +125,26 @@ public:
 
 void MIXER_SetMaster(float vol0,float vol1);
 
+/* "sample accurate" mode: devices whose state changes on I/O should call FillUp() first */
+bool Mixer_SampleAccurate();
+/* in "sample accurate" mode, render every channel up to the current emulated time */
+void Mixer_SampleAccurateFillUp();
+
+/* Audio pipeline statistics, for the title bar and the debugger */
+struct MixerStats {
+	unsigned long long underruns;		// audio device callbacks that ran out of rendered audio
+	unsigned long long dropped_samples;	// samples dropped to keep the queue from growing
+	unsigned long long callbacks;
+	unsigned int queue_ms;			// rendered audio waiting for the device after the last callback
+	unsigned int target_ms;			// buffer target the drop logic works toward
+	double jitter_ms;			// smoothed deviation of the callback interval from nominal
+	double max_jitter_ms;
+	bool adaptive;				// target is adjusted at runtime (adaptive prebuffer=true)
+};
+
+void MIXER_GetStats(MixerStats &st);
+void MIXER_ResetStats(void);
+
 MixerChannel * MIXER_AddChannel(MIXER_Handler handler,Bitu freq,const char * name);
 MixerChannel * MIXER_FindChannel(const char * name);
 /* Find the device you want to delete with findchannel "delchan gets deleted" */
@@ -22,6 +22,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <vector>
 
 #include "bios_disk.h"
 
@@ -55,10 +56,21 @@ public:
 	
 	uint8_t read_sector(uint32_t sectnum, uint8_t* data);
 
+	uint8_t read_sectors(uint32_t sectnum, uint32_t count, uint8_t* data);
+
 	uint8_t write_sector(uint32_t sectnum, const uint8_t* data);
+
+	uint8_t write_sectors(uint32_t sectnum, uint32_t count, const uint8_t* data);
 	
 private:
 
+	/* An L2 table, in host byte order and with the flags masked off. */
+	typedef struct L2CacheEntry {
+		uint64_t table_offset;
+		uint64_t last_used;
+		std::vector<uint64_t> entries;
+	} L2CacheEntry;
+
 	FILE* file;
 	QCow2Header header;
 	static const uint64_t copy_flag;
@@ -74,6 +86,11 @@ private:
 	uint64_t refcount_mask;
 	uint64_t refcount_bits;
 	QCow2Image* backing_image;
+	std::vector<uint64_t> l1_table;
+	std::vector<L2CacheEntry> l2_cache;
+	size_t l2_cache_limit;
+	uint64_t l2_cache_clock;
+	static const uint64_t l2_cache_bytes;
 
 	static uint16_t host_read16(uint16_t buffer);
 
@@ -89,6 +106,8 @@ private:
 
 	uint8_t read_cluster(uint64_t data_cluster_number, uint8_t* data);
 
+	const uint64_t* get_l2_table(uint64_t l2_table_offset);
+
 	uint8_t read_l1_table(uint64_t address, uint64_t& l2_table_offset);
 
 	uint8_t read_l2_table(uint64_t l2_table_offset, uint64_t address, uint64_t& data_cluster_offset);
@@ -128,6 +147,13 @@ public:
 
 	uint8_t Write_AbsoluteSector(uint32_t sectnum, const void* data) override;
 
+	uint8_t Read_Sectors(uint32_t sectnum, uint32_t count, void* data) override;
+
+	uint8_t Write_Sectors(uint32_t sectnum, uint32_t count, const void* data) override;
+
+	/* reads go through the shared L2 table cache and the stdio stream */
+	bool CanReadConcurrently(void) override { return false; }
+
 private:
 
 	QCow2Image qcowImage;
@@ -182,6 +182,12 @@ extern ttf_cell newAttrChar[];					// to be replaced by
 extern Render_ttf ttf;
 #endif
 extern Render_t render;
+
+/* the source line just read into the cache differs from the last frame */
+static inline void RENDER_SourceLineChanged(void) {
+	Scaler_ChangedSourceLines[(Bitu)(render.scale.cacheRead - (uint8_t*)&scalerSourceCache) / render.scale.cachePitch - 1u] = 1;
+}
+
 extern Bitu last_gfx_flags;
 extern ScalerLineHandler_t RENDER_DrawLine;
 void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double scrn_ratio);
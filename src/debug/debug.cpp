@@ -50,6 +50,7 @@ using namespace std;
 #include "../cpu/lazyflags.h"
 #include "keyboard.h"
 #include "control.h"
+#include "mixer.h"
 
 bool Clear_SYSENTER_Debug();
 bool Toggle_BreakSYSEnter();
@@ -2414,6 +2415,28 @@ bool ParseCommand(char* str) {
         return true;
     }
 
+    if (command == "MIXER") { // audio pipeline statistics
+        MixerStats st;
+
+        command.clear();
+        stream >> command;
+
+        if (command == "RESET") {
+            MIXER_ResetStats();
+            DEBUG_ShowMsg("MIXER: Statistics reset\n");
+            return true;
+        }
+        else if (command != "") {
+            return false;
+        }
+
+        MIXER_GetStats(st);
+        DEBUG_ShowMsg("MIXER: %llu callbacks, %llu underruns, %llu samples dropped\n",st.callbacks,st.underruns,st.dropped_samples);
+        DEBUG_ShowMsg("MIXER: queue %ums, target %ums%s, callback jitter %.2fms (max %.2fms)\n",
+            st.queue_ms,st.target_ms,st.adaptive?" (adaptive)":"",st.jitter_ms,st.max_jitter_ms);
+        return true;
+    }
+
 	if (command == "C") { // Set code overview
 		uint16_t codeSeg = (uint16_t)GetHexValue(found,found); found++;
 		uint32_t codeOfs = GetHexValue(found,found);
@@ -3709,6 +3732,7 @@ bool ParseCommand(char* str) {
 		DEBUG_ShowMsg("PAGING [page]             - Display content of page table.\n");
 		DEBUG_ShowMsg("EXTEND                    - Toggle additional info.\n");
 		DEBUG_ShowMsg("TIMERIRQ                  - Run the system timer.\n");
+		DEBUG_ShowMsg("MIXER [RESET]             - Show or reset audio underrun/drop/jitter statistics.\n");
 		DEBUG_ShowMsg("TIME [time]               - Display or change the internal time.\n");
 		DEBUG_ShowMsg("DATE [date]               - Display or change the internal date.\n");
 		DEBUG_ShowMsg("VRT                       - Run, then enter debugger at next vertical retrace.\n");
@@ -30,10 +30,14 @@
 #include <sstream>
 #if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
 #endif
 
 #include "mem.h"
 #include "mixer.h"
+#include "mapped_file.h"
 #include "../libs/decoders/SDL_sound.h"
 #include "../libs/libchdr/chd.h"
 
@@ -149,6 +153,9 @@ public:
     //! \brief Read sector data into host memory (for IDE emulation)
 	virtual bool	ReadSectorsHost			(void* buffer, bool raw, unsigned long sector, unsigned long num) = 0;
 
+    //! \brief True if ReadSectorsHost may run on another thread (IDE async host io) while this one keeps using the drive
+	virtual bool	CanReadConcurrently		(void) { return false; }
+
     //! \brief Load (close/spin up) or unload (eject/spin down) media
 	virtual bool	LoadUnloadMedia		(bool unload) = 0;
 
@@ -238,6 +245,12 @@ private:
 	public:
 		virtual          ~TrackFile() = default;
 		virtual bool     read(uint8_t *buffer,int64_t seek, int count) = 0;
+		// read num sectors of length bytes each, spaced frameSize bytes apart in the file
+		virtual bool     readFrames(uint8_t *buffer, int64_t seek, int length, int frameSize, unsigned long num) {
+			for (unsigned long i = 0; i < num; i++)
+				if (!read(buffer + i * (unsigned long)length, seek + (int64_t)i * frameSize, length)) return false;
+			return true;
+		}
 		virtual bool     seek(int64_t offset) = 0;
 		virtual uint16_t   decode(uint8_t *buffer) = 0;
 		virtual uint16_t   getEndian() = 0;
@@ -245,6 +258,8 @@ private:
 		virtual uint8_t    getChannels() = 0;
 		virtual int64_t    getLength() = 0;
 		virtual void setAudioPosition(uint32_t pos) = 0;
+		// true if read() and readFrames() use no state shared with other calls
+		virtual bool     canReadConcurrently() { return false; }
 		const uint16_t chunkSize = 0;
 		uint32_t audio_pos = UINT32_MAX; // last position when playing audio
 	};
@@ -267,8 +282,10 @@ private:
 		uint8_t           getChannels() override { return 2; }
 		int64_t           getLength() override;
 		void setAudioPosition(uint32_t pos) override { audio_pos = pos; }
+		bool            canReadConcurrently() override { return mapped.IsMapped(); }
 	private:
 		std::ifstream   *file;
+		MappedFile      mapped; // replaces the stream when the image is memory mapped
 	};
 
 	class AudioFile : public TrackFile {
@@ -302,6 +319,7 @@ private:
         CHDFile& operator= (const CHDFile&) = delete;
 
         bool            read(uint8_t* buffer, int64_t seek, int count) override;
+        bool            readFrames(uint8_t* buffer, int64_t seek, int length, int frameSize, unsigned long num) override;
         bool            seek(int64_t offset) override;
         uint16_t        decode(uint8_t* buffer) override;
         uint16_t        getEndian() override;
@@ -311,18 +329,34 @@ private:
         void setAudioPosition(uint32_t pos) override { audio_pos = pos; }
         chd_file*       getChd() { return this->chd; }
     private:
+        enum HunkState { HUNK_EMPTY = 0, HUNK_PENDING, HUNK_READY, HUNK_ERROR };
+        struct CachedHunk {
+            uint8_t*  data  = nullptr;      // hunkbytes, hunks in CHD are up to 1 MiB
+            uint32_t  index = 0;            // hunk number held
+            HunkState state = HUNK_EMPTY;   // PENDING slots belong to whoever decodes them and are never evicted
+            uint64_t  used  = 0;            // LRU stamp
+        };
+
+        const uint8_t*  getHunk(uint32_t hunk);
+        void            prefetch(uint32_t hunk, const CachedHunk* keep);
+        CachedHunk*     findHunk(uint32_t hunk);
+        CachedHunk*     evictHunk(const CachedHunk* keep = nullptr);
+
               chd_file*   chd               = nullptr;
         const chd_header* header            = nullptr; // chd header
-                /*
-                    TODO: cache more than one hunk
-                    or wait for https://github.com/rtissera/libchdr/issues/36
-                */
-              uint8_t*     hunk_buffer       = nullptr; // buffer to hold one hunk // size of hunks in CHD up to 1 MiB
-              uint8_t*     hunk_buffer_next  = nullptr; // index + 1 prefetch
-              int          hunk_buffer_index = -1;      // hunk index for buffer
+              std::vector<CachedHunk> hunk_cache;       // LRU cache of decoded hunks, only the emulator thread changes which hunk a slot holds
+              uint64_t     hunk_use_counter  = 0;
+              unsigned int readahead         = 0;       // hunks decoded ahead of the one being read
 #if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-              std::thread* hunk_thread       = nullptr; // used for prefetch
-              bool         hunk_thread_error = true;
+        void            workerLoop(chd_file* wchd);
+
+              std::vector<std::thread> workers;         // decoder pool, each with its own chd handle since libchdr is not reentrant
+              std::vector<chd_file*>   worker_chd;
+              std::deque<CachedHunk*>  work_queue;
+              std::mutex               hunk_lock;       // guards slot state and the queue
+              std::condition_variable  work_ready;
+              std::condition_variable  hunk_done;
+              bool                     stopping = false;
 #endif
     public:
               bool         skip_sync         = false;   // this will fail if a CHD contains 2048 and 2352 sector tracks
@@ -359,6 +393,7 @@ public:
 	bool	ReadSectors             (PhysPt buffer, bool raw, unsigned long sector, unsigned long num) override;
 	/* This is needed for IDE hack, who's buffer does not exist in DOS physical memory */
 	bool	ReadSectorsHost			(void* buffer, bool raw, unsigned long sector, unsigned long num) override;
+	bool	CanReadConcurrently     (void) override;
 	bool	LoadUnloadMedia         (bool unload) override;
 	//! \brief Indicate whether the image has a data track
 	bool	ReadSector              (uint8_t *buffer, bool raw, unsigned long sector);
@@ -407,6 +442,7 @@ private:
 	bool  LoadIsoFile(char *filename);
 	bool  CanReadPVD(TrackFile *file, int sectorSize, bool mode2) const;
 	int	  GetTrack(unsigned long sector);
+	bool  ReadSectorRun(uint8_t *buffer, bool raw, unsigned long sector, unsigned long num);
 	static void CDAudioCallBack (Bitu len);
 
 	// Private functions for cue sheet processing
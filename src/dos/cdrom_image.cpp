@@ -17,6 +17,7 @@
  */
 
 #include "cdrom.h"
+#include <algorithm>
 #include <cassert>
 #include <cctype>
 #include <chrono>
@@ -46,6 +47,7 @@
 #include "logging.h"
 #include "support.h"
 #include "setup.h"
+#include "control.h"
 #include "src/libs/decoders/audio_convert.c"
 #include "src/libs/decoders/SDL_sound.c"
 #include "src/libs/decoders/vorbis.c"
@@ -120,6 +122,11 @@ CDROM_Interface_Image::BinaryFile::BinaryFile(const char *filename, bool &error)
         }
     }
 #endif
+	// Serve reads straight from the page cache if asked to; the stream is no longer needed then
+	if (!error && MappedFile::enabled && mapped.Map(filename)) {
+		delete file;
+		file = nullptr;
+	}
 }
 
 CDROM_Interface_Image::BinaryFile::~BinaryFile()
@@ -134,6 +141,9 @@ CDROM_Interface_Image::BinaryFile::~BinaryFile()
 
 bool CDROM_Interface_Image::BinaryFile::read(uint8_t *buffer,int64_t offset, int count)
 {
+	if (mapped.IsMapped())
+		return offset >= 0 && count >= 0 && mapped.Read(buffer, (uint64_t)offset, (size_t)count);
+
     if (!seek(offset)) return false;
 	file->seekg((streampos)offset, ios::beg);
 	file->read((char*)buffer, count);
@@ -142,6 +152,9 @@ bool CDROM_Interface_Image::BinaryFile::read(uint8_t *buffer,int64_t offset, int
 
 int64_t CDROM_Interface_Image::BinaryFile::getLength()
 {
+	if (mapped.IsMapped())
+		return (int64_t)mapped.Size();
+
 	file->seekg(0, ios::end);
 	int64_t length = (int64_t)file->tellg();
 	if (file->fail()) return -1;
@@ -160,6 +173,9 @@ uint16_t CDROM_Interface_Image::BinaryFile::getEndian()
 
 bool CDROM_Interface_Image::BinaryFile::seek(int64_t offset)
 {
+	if (mapped.IsMapped())
+		return offset >= 0 && (uint64_t)offset <= mapped.Size();
+
 	const auto pos = static_cast<std::streamoff>(offset);
 	if (file->tellg() == pos)
 		return true;
@@ -177,6 +193,14 @@ bool CDROM_Interface_Image::BinaryFile::seek(int64_t offset)
 
 uint16_t CDROM_Interface_Image::BinaryFile::decode(uint8_t *buffer)
 {
+	if (mapped.IsMapped()) {
+		const uint64_t left = (audio_pos < mapped.Size()) ? (mapped.Size() - audio_pos) : 0;
+		const uint16_t bytes_read = (left < chunkSize) ? (uint16_t)left : chunkSize;
+		if (bytes_read != 0) mapped.Read(buffer, audio_pos, bytes_read);
+		audio_pos += bytes_read;
+		return bytes_read;
+	}
+
     if (static_cast<uint32_t>(file->tellg()) != audio_pos)
 		if (!seek(audio_pos)) return 0;
 
@@ -302,99 +326,251 @@ CDROM_Interface_Image::CHDFile::CHDFile(const char* filename, bool& error)
     :TrackFile(RAW_SECTOR_SIZE) // CDAudioCallBack needs 2352
 {
     error = chd_open(filename, CHD_OPEN_READ, NULL, &this->chd) != CHDERR_NONE;
-    if (!error) {
-        this->header           = chd_get_header(this->chd);
-        this->hunk_buffer      = new uint8_t[this->header->hunkbytes];
-        this->hunk_buffer_next = new uint8_t[this->header->hunkbytes];
+    if (error) return;
+
+    this->header = chd_get_header(this->chd);
+
+    const Section_prop* section = static_cast<Section_prop*>(control->GetSection("dos"));
+    int threads = section ? section->Get_int("chd decoder threads") : 0;
+    int ahead   = section ? section->Get_int("chd read-ahead hunks") : 0;
+#if defined(HX_DOS) || defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR)
+    threads = 0;
+#else
+    if (threads < 0) {
+        // leave one host core to the emulator, but keep the pool small
+        const int cores = (int)std::thread::hardware_concurrency();
+        threads = cores > 1 ? std::min(cores - 1, 4) : 1;
     }
+    threads = std::min(threads, 16);
+#endif
+    this->readahead = (threads > 0 && ahead > 0) ? (unsigned int)std::min(ahead, 64) : 0;
+
+    // room for the read-ahead window plus the hunks behind it that are still being read from
+    this->hunk_cache.resize(this->readahead * 2 + 4);
+    for (auto &h : this->hunk_cache)
+        h.data = new uint8_t[this->header->hunkbytes];
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+    if (this->readahead != 0) {
+        for (int i = 0; i < threads; i++) {
+            chd_file* wchd = nullptr;
+            if (chd_open(filename, CHD_OPEN_READ, NULL, &wchd) != CHDERR_NONE) break;
+            this->worker_chd.push_back(wchd);
+            this->workers.emplace_back(&CHDFile::workerLoop, this, wchd);
+        }
+        if (this->workers.empty()) this->readahead = 0;
+    }
+#endif
 }
 
 CDROM_Interface_Image::CHDFile::~CHDFile()
 {
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+    {
+        std::lock_guard<std::mutex> guard(this->hunk_lock);
+        this->stopping = true;
+    }
+    this->work_ready.notify_all();
+    for (auto &t : this->workers) t.join();
+    this->workers.clear();
+    for (auto wchd : this->worker_chd) chd_close(wchd);
+    this->worker_chd.clear();
+#endif
+
     // Guard: only cleanup if needed
     if (this->chd) {
         chd_close(this->chd);
         this->chd = nullptr;
     }
 
-    if (this->hunk_buffer) {
-        delete[] this->hunk_buffer;
-        this->hunk_buffer = nullptr;
-    }
+    for (auto &h : this->hunk_cache) delete[] h.data;
+    this->hunk_cache.clear();
+}
 
 #if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-    if (this->hunk_thread) {
-        this->hunk_thread->join();
-        delete hunk_thread;
-        this->hunk_thread = nullptr;
+void CDROM_Interface_Image::CHDFile::workerLoop(chd_file* wchd)
+{
+    std::unique_lock<std::mutex> guard(this->hunk_lock);
+    for (;;) {
+        this->work_ready.wait(guard, [this] { return this->stopping || !this->work_queue.empty(); });
+        if (this->stopping) return;
+
+        CachedHunk* h = this->work_queue.front();
+        this->work_queue.pop_front();
+
+        // the slot is PENDING, so nobody else touches it while we decode without the lock
+        guard.unlock();
+        const bool ok = chd_read(wchd, h->index, h->data) == CHDERR_NONE;
+        guard.lock();
+
+        h->state = ok ? HUNK_READY : HUNK_ERROR;
+        this->hunk_done.notify_all();
     }
-#endif
 }
+#endif
 
-#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-void hunk_thread_func(chd_file* chd, int hunk_index, uint8_t* buffer, bool* error)
+// caller holds hunk_lock if there are workers
+CDROM_Interface_Image::CHDFile::CachedHunk* CDROM_Interface_Image::CHDFile::findHunk(uint32_t hunk)
 {
-    // loads one hunk into buffer
-    *error = chd_read(chd, hunk_index, buffer) != CHDERR_NONE;
+    for (auto &h : this->hunk_cache)
+        if (h.state != HUNK_EMPTY && h.index == hunk) return &h;
+    return nullptr;
 }
-#endif
 
-bool CDROM_Interface_Image::CHDFile::read(uint8_t* buffer,int64_t offset, int count)
+// caller holds hunk_lock if there are workers; keep is never chosen
+CDROM_Interface_Image::CHDFile::CachedHunk* CDROM_Interface_Image::CHDFile::evictHunk(const CachedHunk* keep)
 {
-    // we can not read more than a single sector currently
-    if (count > RAW_SECTOR_SIZE) {
-        return false;
+    CachedHunk* victim = nullptr;
+    for (auto &h : this->hunk_cache) {
+        if (h.state == HUNK_PENDING || &h == keep) continue;
+        if (h.state == HUNK_EMPTY) return &h;
+        if (victim == nullptr || h.used < victim->used) victim = &h;
     }
+    return victim;
+}
 
-    uint64_t needed_hunk = (uint64_t)offset / (uint64_t)this->header->hunkbytes;
+// Returns the decoded hunk. The pointer stays valid until the next call, as only this thread evicts.
+const uint8_t* CDROM_Interface_Image::CHDFile::getHunk(uint32_t hunk)
+{
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+    std::unique_lock<std::mutex> guard(this->hunk_lock);
+#endif
+    CachedHunk* h = findHunk(hunk);
 
-    // EOF
-    if (needed_hunk > this->header->totalhunks) {
-        return false;
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+    // prefetched but not decoded yet: wait for the worker rather than decoding it twice
+    if (h != nullptr && h->state == HUNK_PENDING) {
+        // a worker may not have picked it up yet, in which case we would wait behind the whole queue
+        auto q = std::find(this->work_queue.begin(), this->work_queue.end(), h);
+        if (q != this->work_queue.end()) {
+            this->work_queue.erase(q);
+        }
+        else {
+            this->hunk_done.wait(guard, [h] { return h->state != HUNK_PENDING; });
+        }
     }
+#endif
 
-    // read new hunk if needed
-    if ((int)needed_hunk != this->hunk_buffer_index) {
-#if defined(HX_DOS) || defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR)
-        if (chd_read(this->chd, needed_hunk, this->hunk_buffer) != CHDERR_NONE)
-            return false;
-#else
-        // make sure our thread is done
-        if (this->hunk_thread) this->hunk_thread->join();
-
-        // can we use our prefetched hunk
-        if (((int)needed_hunk == (this->hunk_buffer_index + 1)) && (!this->hunk_thread_error)) {
-            // swap pointers and we're good :)
-            std::swap(this->hunk_buffer, this->hunk_buffer_next);
-
-        } else {
-            // read new hunk
-            bool error = true;
-            hunk_thread_func(this->chd, (int)needed_hunk, this->hunk_buffer, &error);
-            if (error) {
-                return false;
-            }
-        }
+    if (h == nullptr) {
+        h = evictHunk();
+        if (h == nullptr) return nullptr;
+        h->index = hunk;
+        h->state = HUNK_PENDING;
+    }
+    else if (h->state == HUNK_ERROR) {
+        h->state = HUNK_PENDING; // try again
+    }
+
+    if (h->state == HUNK_PENDING) {
+        // not cached or taken back from the queue: decode here with our own handle
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+        guard.unlock();
+#endif
+        const bool ok = chd_read(this->chd, hunk, h->data) == CHDERR_NONE;
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+        guard.lock();
 #endif
+        h->state = ok ? HUNK_READY : HUNK_ERROR;
+    }
 
-        this->hunk_buffer_index = (int)needed_hunk;
+    if (h->state != HUNK_READY) return nullptr;
+    h->used = ++this->hunk_use_counter;
 
 #if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
-        // prefetch: let our thread decode the next hunk
-        if (hunk_thread) delete this->hunk_thread;
-        this->hunk_thread = new std::thread(
-            [this, needed_hunk]() {
-                hunk_thread_func(this->chd, (int)(needed_hunk + 1), this->hunk_buffer_next, &this->hunk_thread_error);
-            }
-        );
+    guard.unlock();
 #endif
+    prefetch(hunk, h); // must not evict the slot returned here
+    return h->data;
+}
+
+// queue the hunks following this one for the decoder pool, never evicting keep
+void CDROM_Interface_Image::CHDFile::prefetch(uint32_t hunk, const CachedHunk* keep)
+{
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+    if (this->readahead == 0) return;
+
+    bool queued = false;
+    {
+        std::lock_guard<std::mutex> guard(this->hunk_lock);
+        for (unsigned int i = 1; i <= this->readahead; i++) {
+            const uint64_t next = (uint64_t)hunk + i;
+            if (next >= this->header->totalhunks) break;
+            if (findHunk((uint32_t)next) != nullptr) continue;
+
+            CachedHunk* h = evictHunk(keep);
+            if (h == nullptr) break;
+            h->index = (uint32_t)next;
+            h->state = HUNK_PENDING;
+            h->used  = ++this->hunk_use_counter;
+            this->work_queue.push_back(h);
+            queued = true;
+        }
     }
+    if (queued) this->work_ready.notify_all();
+#else
+    (void)hunk;
+    (void)keep;
+#endif
+}
 
-    // copy data
+bool CDROM_Interface_Image::CHDFile::read(uint8_t* buffer,int64_t offset, int count)
+{
     // the overlying read code thinks there is a sync header
     // so for 2048 sector size images we need to subtract 16 from the offset to account for the missing sync header
-    uint8_t* source = this->hunk_buffer + ((uint64_t)offset - (uint64_t)needed_hunk * this->header->hunkbytes) - ((uint64_t)16 * this->skip_sync);
-    memcpy(buffer, source, min(count, RAW_SECTOR_SIZE));
+    uint64_t pos = (uint64_t)offset - ((uint64_t)16 * this->skip_sync);
+    const uint64_t hunkbytes = this->header->hunkbytes;
+
+    while (count > 0) {
+        const uint64_t needed_hunk = pos / hunkbytes;
+
+        // EOF
+        if (needed_hunk >= this->header->totalhunks) {
+            return false;
+        }
+
+        const uint8_t* source = getHunk((uint32_t)needed_hunk);
+        if (source == nullptr) {
+            return false;
+        }
+
+        const uint64_t in_hunk = pos - needed_hunk * hunkbytes;
+        const int n = (int)std::min<uint64_t>((uint64_t)count, hunkbytes - in_hunk);
+        memcpy(buffer, source + in_hunk, (size_t)n);
+        buffer += n;
+        pos += (uint64_t)n;
+        count -= n;
+    }
+
+    return true;
+}
+
+bool CDROM_Interface_Image::CHDFile::readFrames(uint8_t* buffer, int64_t seek, int length, int frameSize, unsigned long num)
+{
+    // look up each hunk once for all the frames it holds
+    const uint64_t hunkbytes = this->header->hunkbytes;
+    const uint8_t* source = nullptr;
+    uint64_t source_hunk = 0;
+
+    for (unsigned long i = 0; i < num; i++, buffer += length, seek += frameSize) {
+        const uint64_t pos = (uint64_t)seek - ((uint64_t)16 * this->skip_sync);
+        const uint64_t hunk = pos / hunkbytes;
+        const uint64_t in_hunk = pos - hunk * hunkbytes;
+
+        if (in_hunk + (uint64_t)length > hunkbytes) {
+            // frame straddles two hunks
+            if (!read(buffer, seek, length)) return false;
+            source = nullptr;
+            continue;
+        }
+
+        if (source == nullptr || hunk != source_hunk) {
+            if (hunk >= this->header->totalhunks) return false;
+            source = getHunk((uint32_t)hunk);
+            if (source == nullptr) return false;
+            source_hunk = hunk;
+        }
+        memcpy(buffer, source + in_hunk, (size_t)length);
+    }
 
     return true;
 }
@@ -419,7 +595,7 @@ bool CDROM_Interface_Image::CHDFile::seek(int64_t offset)
 {
     // only checks if seek range is valid ? only used for audio ?
     // only used by PlayAudioSector ?
-    if ((uint32_t)((uint64_t)offset / this->header->hunkbytes) < this->header->hunkcount) {
+    if ((uint32_t)((uint64_t)offset / this->header->hunkbytes) < this->header->totalhunks) {
         return true;
     } else {
         return false;
@@ -772,11 +948,7 @@ bool CDROM_Interface_Image::ReadSectors(PhysPt buffer, bool raw, unsigned long s
 	Bitu buflen = num * sectorSize;
 	uint8_t* buf = new uint8_t[buflen];
 
-	bool success = true; //Gobliiins reads 0 sectors
-	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector(&buf[i * sectorSize], raw, sector + i);
-		if (!success) break;
-	}
+	bool success = ReadSectorRun(buf, raw, sector, num); //Gobliiins reads 0 sectors
 
 	MEM_BlockWrite(buffer, buf, buflen);
 	delete[] buf;
@@ -787,10 +959,9 @@ bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned lon
 {
 	Bitu sectorSize = raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE;
 	uint8_t* buf = (uint8_t*)buffer;
-	bool success = true; //Gobliiins reads 0 sectors
+	bool success = ReadSectorRun(buf, raw, sector, num); //Gobliiins reads 0 sectors
+	if (!success) return false;
 	for(unsigned long i = 0; i < num; i++) {
-		success = ReadSector(&buf[i * sectorSize], raw, sector + i);
-		if (!success) break;
 		if (raw && buf[i * sectorSize + 2068] && sector < tracks[0].length && !tracks[0].mode2) {
 			// ECMA-130: The Intermediate field shall consist of 8 (00)-bytes recorded in positions 2068 to 2075
 			// We report a non-zero value as a sector read error. This is to satisfy copy protection checks which expect certain sectors to be bad.
@@ -802,6 +973,14 @@ bool CDROM_Interface_Image::ReadSectorsHost(void *buffer, bool raw, unsigned lon
 	return success;
 }
 
+// Only memory mapped binary tracks are read without stream positions or the CHD hunk cache
+bool CDROM_Interface_Image::CanReadConcurrently(void)
+{
+	for (const Track &track : tracks)
+		if (track.file != nullptr && !track.file->canReadConcurrently()) return false;
+	return !tracks.empty();
+}
+
 bool CDROM_Interface_Image::LoadUnloadMedia(bool unload)
 {
 	(void)unload; // unused by part of the API
@@ -847,6 +1026,36 @@ bool CDROM_Interface_Image::ReadSector(uint8_t *buffer, bool raw, unsigned long
 	return tracks[track].file->read(buffer, seek, length);
 }
 
+// Same as ReadSector for num consecutive sectors, handing each track one request
+bool CDROM_Interface_Image::ReadSectorRun(uint8_t *buffer, bool raw, unsigned long sector, unsigned long num)
+{
+	const int length = (raw ? RAW_SECTOR_SIZE : COOKED_SECTOR_SIZE);
+
+	while (num > 0) {
+		const int track = GetTrack(sector)-1;
+		if (track < 0) return false;
+		if (tracks[track].sectorSize != RAW_SECTOR_SIZE && raw) return false;
+
+		// GetTrack() never returns the last (lead-out) entry, so track + 1 exists
+		const Track &next = tracks[track + 1];
+		const unsigned long track_end = next.pregap ? next.pregap : next.start;
+		unsigned long count = num;
+		if (track_end > sector && (track_end - sector) < count) count = track_end - sector;
+
+		int64_t seek = (int64_t)(tracks[track].skip + (sector - tracks[track].start) * tracks[track].sectorSize);
+		if ((tracks[track].sectorSize == RAW_SECTOR_SIZE || tracks[track].sectorSize == 2448) && !tracks[track].mode2 && !raw) seek += 16;
+		if (tracks[track].mode2 && !raw) seek += 24;
+
+		if (!tracks[track].file->readFrames(buffer, seek, length, tracks[track].sectorSize, count)) return false;
+
+		buffer += count * (unsigned long)length;
+		sector += count;
+		num -= count;
+	}
+
+	return true;
+}
+
 void CDROM_Interface_Image::CDAudioCallBack(Bitu len)
 {
 	// Our member object "playbackRemaining" holds the
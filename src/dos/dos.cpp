@@ -41,6 +41,7 @@
 #include "menu.h"
 #include "menudef.h"
 #include "mapper.h"
+#include "mapped_file.h"
 #include "drives.h"
 #include "setup.h"
 #include "support.h"
@@ -2041,7 +2042,19 @@ static Bitu DOS_21Handler(void) {
                 }
                 else
                 {
-                    if((fRead = DOS_ReadFile(reg_bx, dos_copybuf, &toread))) {
+                    /* files (not character devices, which may run the guest while they wait for
+                     * input) read straight into the caller's buffer if it is plain RAM */
+                    HostPt direct = NULL;
+                    if (!(Files[handle]->GetInformation() & DeviceInfoFlags::Device))
+                        direct = MEM_GetBlockHostPt(SegPhys(ds) + reg_dx, toread, true);
+#if defined(USE_TTF)
+                    if (ttf.inUse && reg_bx == WPvga512CHMhandle) direct = NULL; /* checked in dos_copybuf below */
+#endif
+                    if (direct != NULL) {
+                        if((fRead = DOS_ReadFile(reg_bx, direct, &toread)))
+                            diskio_delay_handle(reg_bx, toread);
+                    }
+                    else if((fRead = DOS_ReadFile(reg_bx, dos_copybuf, &toread))) {
                         MEM_BlockWrite(SegPhys(ds) + reg_dx, dos_copybuf, toread);
                         diskio_delay_handle(reg_bx, toread);
                     }
@@ -2108,8 +2121,19 @@ static Bitu DOS_21Handler(void) {
                     towrite = nuwrite;
                 }
 
-                MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
-                packerr=reg_bx==2&&towrite==22&&!strncmp((char *)dos_copybuf,"Packed file is corrupt",towrite);
+                /* files (not character devices, which may run the guest while they output) take
+                 * the data straight from the caller's buffer if it is plain RAM */
+                const uint8_t *src = NULL;
+                {
+                    uint32_t handle = RealHandle(reg_bx);
+                    if (handle < DOS_FILES && Files[handle] && Files[handle]->IsOpen() && !(Files[handle]->GetInformation() & DeviceInfoFlags::Device))
+                        src = MEM_GetBlockHostPt(SegPhys(ds)+reg_dx,towrite,false);
+                }
+                if (src == NULL) {
+                    MEM_BlockRead(SegPhys(ds)+reg_dx,dos_copybuf,towrite);
+                    src = dos_copybuf;
+                }
+                packerr=reg_bx==2&&towrite==22&&!strncmp((const char *)src,"Packed file is corrupt",towrite);
                 fWritten = (packerr && !(i4dos && !shellrun) && (!autofixwarn || (autofixwarn == 2 && infix == 0) || (autofixwarn == 1 && infix == 1)));
                 if(!fWritten)
                 {
@@ -2122,7 +2146,7 @@ static Bitu DOS_21Handler(void) {
                         fWritten = !(((DOS_ExtDevice*)Files[handle])->CallDeviceFunction(8, 26, SegValue(ds), reg_dx, towrite) & 0x8000);
                     }
                     else {
-                        if((fWritten = DOS_WriteFile(reg_bx, dos_copybuf, &towrite))) {
+                        if((fWritten = DOS_WriteFile(reg_bx, src, &towrite))) {
                             diskio_delay_handle(reg_bx, towrite);
                         }
                     }
@@ -4057,6 +4081,15 @@ public:
 			}
 		}
 
+		{
+			const std::string mapimages = section->Get_string("map read-only images");
+			MappedFile::enabled = mapimages != "false" && mapimages != "0";
+			if (mapimages == "sequential") MappedFile::advice = MappedFile::ADVICE_SEQUENTIAL;
+			else if (mapimages == "random") MappedFile::advice = MappedFile::ADVICE_RANDOM;
+			else MappedFile::advice = MappedFile::ADVICE_NORMAL;
+			MappedFile::hugepages = section->Get_bool("map read-only images with huge pages");
+		}
+
 		::disk_data_rate = section->Get_int("hard drive data rate limit");
 		::floppy_data_rate = section->Get_int("floppy drive data rate limit");
 		if (::disk_data_rate < 0) {
@@ -2072,6 +2072,7 @@ void DOS_SetupFiles (void) {
 		if (Drives[i]) DriveManager::UnmountDrive(i);
 		Drives[i]=nullptr;
 	}
+    IDE_WaitHostIO();
     for (int i=0; i<MAX_DISK_IMAGES; i++) {
         if (imageDiskList[i]) {
             delete imageDiskList[i];
@@ -358,6 +358,9 @@ bool DOS_IOCTL_AX440D_CH08(uint8_t drive,bool query) {
                 LOG(LOG_IOCTL,LOG_DEBUG)("DOS:IOCTL Call 0D:41 Write Logical Device Track from Drive %2X C/H/S=%u/%u/%u num=%u from %04x:%04x sz=%u",
                         drive,cyl,head,sect,nsect,xfer_addr >> 16,xfer_addr & 0xFFFF,sectsize);
 
+                /* the FAT driver caches sectors, write back what it holds and forget it */
+                fdp->MediaChange();
+
                 while (nsect > 0) {
                     MEM_BlockRead(xfer_ptr,sectbuf,sectsize);
 
@@ -434,6 +437,9 @@ bool DOS_IOCTL_AX440D_CH08(uint8_t drive,bool query) {
                 LOG(LOG_IOCTL,LOG_DEBUG)("DOS:IOCTL Call 0D:61 Read Logical Device Track from Drive %2X C/H/S=%u/%u/%u num=%u to %04x:%04x sz=%u",
                         drive,cyl,head,sect,nsect,xfer_addr >> 16,xfer_addr & 0xFFFF,sectsize);
 
+                /* sectors the FAT driver has not written back yet */
+                fdp->flushBlockCache();
+
                 while (nsect > 0) {
                     uint8_t status = fdp->loadedDisk->Read_Sector(head,cyl,sect,sectbuf);
                     if (status != 0) {
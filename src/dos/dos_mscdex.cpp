@@ -31,6 +31,7 @@
 #include "cpu.h"
 
 #include "cdrom.h"
+#include "ide.h"
 
 #define MSCDEX_LOG LOG(LOG_MISC, LOG_DEBUG)
 #define MSCDEX_LOG_ERROR LOG(LOG_MISC, LOG_ERROR)
@@ -174,6 +175,7 @@ CMscdex::CMscdex(const char *_name) {
 CMscdex::~CMscdex(void) {
 	if ((bootguest||(use_quick_reboot&&!bootvm))&&bootdrive>=0) return;
 	defaultBufSeg = 0;
+	IDE_WaitHostIO();
 	for (uint16_t i=0; i<GetNumDrives(); i++) {
 		delete cdrom[i];
 		cdrom[i] = nullptr;
@@ -211,6 +213,7 @@ int CMscdex::RemoveDrive(uint16_t _drive)
 	}
 
 	if (idx == MSCDEX_MAX_DRIVES || (idx!=0 && idx!=GetNumDrives()-1)) return 0;
+	IDE_WaitHostIO();
 	delete cdrom[idx];
 	if (idx==0) {
 		for (uint16_t i=0; i<GetNumDrives(); i++) {
@@ -424,6 +427,7 @@ bool CMscdex::HasDrive(uint16_t drive) {
 void CMscdex::ReplaceDrive(CDROM_Interface* newCdrom, uint8_t subUnit) {
 	if (cdrom[subUnit] != NULL) {
 		StopAudio(subUnit);
+		IDE_WaitHostIO();
 		delete cdrom[subUnit];
 	}
 	cdrom[subUnit] = newCdrom;
@@ -1631,6 +1635,7 @@ void POD_Load_DOS_Mscdex( std::istream& stream )
 		READ_POD( &dnum, dnum);
         if (mscdex->GetNumDrives()>dnum) {
             mscdex->numDrives=dnum;
+            IDE_WaitHostIO();
             for (uint16_t i=dnum; i<mscdex->GetNumDrives(); i++) {
                 delete mscdex->cdrom[i];
                 mscdex->cdrom[i] = nullptr;
@@ -93,6 +93,7 @@ char lastmount = 0;
 bool Mouse_Drv=true;
 bool Mouse_Vertical = false;
 bool force_nocachedir = false;
+bool watch_host_dirs = false;
 bool lockmount = true;
 bool wpcolon = true;
 bool convertimg = true;
@@ -1581,6 +1582,7 @@ public:
                     newdrive=new localDrive(temp_line.c_str(),sizes[0],bit8size,sizes[2],sizes[3],mediaid,options);
                     newdrive->nocachedir = nocachedir;
                     newdrive->readonly = readonly;
+                    if (watch_host_dirs && !nocachedir) static_cast<localDrive*>(newdrive)->WatchHostDirs();
                 }
             }
         } else {
@@ -6034,6 +6036,7 @@ class IMGMOUNT : public Program {
 											}
 										}
 								if (i_drive < MAX_DISK_IMAGES && imageDiskList[i_drive]) {
+									IDE_WaitHostIO();
 									delete imageDiskList[i_drive];
 									imageDiskList[i_drive] = NULL;
 								}
@@ -9626,6 +9629,8 @@ void DOS_SetupPrograms(void) {
         " -nocachedir      Enable real-time update and do not cache the drive.\n"
         " -z drive         Move virtual drive Z: to a different letter.\n"
         " -o               Report the drive as: local, remote.\n"
+        "                  With -t overlay, -o writeback journals the overlay's deletion\n"
+        "                  markers and writes them in batches.\n"
         " -q               Quiet mode (no message output).\n"
         " -u               Unmount the drive.\n"
         " \033[32;1m-examples        Show some usage examples.\033[0m\n"
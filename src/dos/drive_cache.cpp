@@ -27,6 +27,14 @@
 #include <vector>
 #include <iterator>
 #include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+
+#if C_HAVE_INOTIFY
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 #if defined (WIN32)   /* Win 32 */
 #define WIN32_LEAN_AND_MEAN        // Exclude rarely-used stuff from
@@ -91,6 +99,9 @@ DOS_Drive_Cache::DOS_Drive_Cache(const char* path, DOS_Drive *drive) {
 DOS_Drive_Cache::~DOS_Drive_Cache(void) {
     Clear();
     for (uint32_t i=0; i<MAX_OPENDIRS; i++) { DeleteFileInfo(dirFindFirst[i]); dirFindFirst[i]=nullptr; }
+#if C_HAVE_INOTIFY
+    if (watchFd >= 0) close(watchFd);
+#endif
 }
 
 void DOS_Drive_Cache::Clear(void) {
@@ -108,6 +119,150 @@ void DOS_Drive_Cache::EmptyCache(void) {
     if (basePath[0] != 0) SetBaseDir(basePath,drive);
 }
 
+/* Watch the host directories as they are cached in, so that listings can stay cached
+ * until the host actually changes them. Only the changed directory is re-read, and
+ * entries that are still there keep their short names. */
+void DOS_Drive_Cache::EnableHostWatch(void) {
+#if C_HAVE_INOTIFY
+    if (watchFd >= 0) return;
+    watchFd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if (watchFd < 0) {
+        LOG(LOG_DOSMISC,LOG_WARN)("DIRCACHE: inotify not available, host directory changes will not be noticed");
+        return;
+    }
+    // directories already read in have no watch yet
+    EmptyCache();
+#endif
+}
+
+void DOS_Drive_Cache::AddHostWatch(CFileInfo* dir, const char* path) {
+#if C_HAVE_INOTIFY
+    if (watchFd < 0 || dir->watch >= 0 || dir->isOverlayDir) return;
+    int wd = drive->add_directory_watch(watchFd,path,IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO|IN_DELETE_SELF|IN_MOVE_SELF|IN_ONLYDIR);
+    if (wd < 0) return;
+    dir->watch = wd;
+    watchList[wd] = dir;
+#else
+    (void)dir;
+    (void)path;
+#endif
+}
+
+void DOS_Drive_Cache::RemoveHostWatch(CFileInfo* dir) {
+#if C_HAVE_INOTIFY
+    if (dir->watch < 0) return;
+    std::map<int,CFileInfo*>::iterator it = watchList.find(dir->watch);
+    if (it != watchList.end() && it->second == dir) {
+        inotify_rm_watch(watchFd,dir->watch);
+        watchList.erase(it);
+    }
+    dir->watch = -1;
+#else
+    (void)dir;
+#endif
+}
+
+// Mark the directories the host changed, they are re-read the next time they are looked up
+void DOS_Drive_Cache::PollHostWatch(void) {
+#if C_HAVE_INOTIFY
+    if (watchFd < 0) return;
+
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(watchFd,buf,sizeof(buf))) > 0) {
+        for (char* p = buf; p < buf + len; ) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                for (std::map<int,CFileInfo*>::iterator it = watchList.begin(); it != watchList.end(); ++it)
+                    it->second->stale = true;
+                continue;
+            }
+
+            std::map<int,CFileInfo*>::iterator it = watchList.find(ev->wd);
+            if (it == watchList.end()) continue;
+            it->second->stale = true;
+            if (ev->mask & IN_IGNORED) { // directory is gone, the kernel dropped the watch
+                it->second->watch = -1;
+                watchList.erase(it);
+            }
+        }
+        save_dir = nullptr;
+    }
+#endif
+}
+
+void DOS_Drive_Cache::RemoveEntry(CFileInfo* dir, size_t index) {
+    CFileInfo* info = dir->fileList[index];
+
+    // Check if there are any open search dir that are affected by this...
+    for (uint32_t i=0; i<MAX_OPENDIRS; i++) {
+        if ((dirSearch[i]==dir) && (index<dirSearch[i]->nextEntry))
+            dirSearch[i]->nextEntry--;
+    }
+
+    UnindexEntry(dir,info);
+    dir->fileList.erase(dir->fileList.begin()+(std::vector<CFileInfo*>::difference_type)index);
+    DeleteFileInfo(info);
+}
+
+// Bring a cached directory in line with the host without throwing away entries that did not change
+void DOS_Drive_Cache::RefreshDir(CFileInfo* dir, const char* path) {
+    char expandcopy [CROSS_LEN];
+    if (strlen(path)>=CROSS_LEN-1) return;
+    strcpy(expandcopy,path);
+    size_t expandcopylen = strlen(expandcopy);
+    if (expandcopylen > 0 && expandcopy[expandcopylen - 1] != CROSS_FILESPLIT) {
+        char end[2]={CROSS_FILESPLIT,0};
+        strcat(expandcopy,end);
+    }
+
+    dir->stale = false;
+    save_dir = nullptr;
+
+    std::map<std::string,bool> found;
+    std::vector<std::string> order, snames;
+    void* dirp = drive->opendir(expandcopy);
+    if (dirp) {
+        char dir_name[CROSS_LEN], dir_sname[DOS_NAMELENGTH+1];
+        bool is_directory;
+        if (drive->read_directory_first(dirp, dir_name, dir_sname, is_directory)) {
+            do {
+                if (found.insert(std::make_pair(std::string(dir_name),is_directory)).second) {
+                    order.push_back(dir_name);
+                    snames.push_back(dir_sname);
+                }
+            } while (drive->read_directory_next(dirp, dir_name, dir_sname, is_directory));
+        }
+        drive->closedir(dirp);
+    }
+
+    // drop what the host removed, or what turned from a file into a directory or back
+    for (size_t i=dir->fileList.size(); i-- > 0;) {
+        std::map<std::string,bool>::iterator f = found.find(dir->fileList[i]->orgname);
+        if (f == found.end() || f->second != dir->fileList[i]->isDir) RemoveEntry(dir,i);
+    }
+
+    // add what is new
+    std::set<std::string> have;
+    for (size_t i=0; i<dir->fileList.size(); i++) have.insert(dir->fileList[i]->orgname);
+    for (size_t i=0; i<order.size(); i++) {
+        if (have.count(order[i])) continue;
+
+        CreateEntry(dir,order[i].c_str(),snames[i].c_str(),found[order[i]]);
+        char file[CROSS_LEN];
+        strcpy(file,order[i].c_str());
+        Bits index = GetLongName(dir,file);
+        if (index>=0) {
+            for (uint32_t j=0; j<MAX_OPENDIRS; j++) {
+                if ((dirSearch[j]==dir) && ((uint32_t)index<=dirSearch[j]->nextEntry))
+                    dirSearch[j]->nextEntry++;
+            }
+        }
+    }
+}
+
 void DOS_Drive_Cache::SetLabel(const char* vname,bool cdrom,bool allowupdate) {
 /* allowupdate defaults to true. if mount sets a label then allowupdate is
  * false and will this function return at once after the first call.
@@ -367,7 +522,9 @@ void DOS_Drive_Cache::CacheOut(const char* path, bool ignoreLastDir) {
     }
     // clear lists
     dir->fileList.clear();
-    dir->longNameList.clear();
+    dir->shortIndex.clear();
+    dir->longIndex.clear();
+    dir->aliasIndex.clear();
     save_dir = nullptr;
 }
 
@@ -384,77 +541,123 @@ bool DOS_Drive_Cache::GetShortName(const char* fullname, char* shortname) {
     const char* pos = strrchr_dbcs((char *)fullname,CROSS_FILESPLIT);
     if (pos) pos++; else return false;
 
-    std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-    if (GCC_UNLIKELY(filelist_size<=0)) return false;
+    // only entries that were given a generated short name have one to report
+    CFileInfo* info = FindLongName(curDir,pos,true);
+    if (info == nullptr || info->shortNr == 0) return false;
 
-    // The orgname part of the list is not sorted (shortname is)! So we can only walk through it.
-    for(Bitu i = 0; i < filelist_size; i++) {
-#if defined (WIN32) || defined (OS2)                        /* Win 32 & OS/2*/
-        if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#else
-        if (strcmp(pos,curDir->longNameList[i]->orgname) == 0) {
-#endif
-            strcpy(shortname,curDir->longNameList[i]->shortname);
-            return true;
-        }
+    strcpy(shortname,info->shortname);
+    return true;
+}
+
+static std::string FoldName(const char* name) {
+    std::string r(name);
+    for (size_t i=0; i<r.size(); i++) {
+        if (r[i] >= 'a' && r[i] <= 'z') r[i] -= 'a' - 'A';
     }
-    return false;
+    return r;
 }
 
-int DOS_Drive_Cache::CompareShortname(const char* compareName, const char* shortName) {
-    char const* cpos = strchr(shortName,'~');
-    if (cpos) {
-/* the following code is replaced as it's not safe when char* is 64 bits */
-/*      Bits compareCount1  = (int)cpos - (int)shortName;
-        char* endPos        = strchr(cpos,'.');
-        Bitu numberSize     = endPos ? int(endPos)-int(cpos) : strlen(cpos);
+/* Key of generated short names in aliasIndex: the characters kept from the long name and the
+ * number of digits after the '~', e.g. LONGFI~12.TXT -> "LONGFI~2". A long name that would
+ * keep the same characters for a number of that width collides with all of these. */
+static std::string AliasKey(const char* stem, size_t stemlen, size_t digits) {
+    std::string r(stem,stemlen);
+    r += '~';
+    r += (char)('0' + digits);
+    return r;
+}
 
-        char* lpos          = strchr(compareName,'.');
-        Bits compareCount2  = lpos ? int(lpos)-int(compareName) : strlen(compareName);
-        if (compareCount2>8) compareCount2 = 8;
+static bool AliasKeyOf(const char* shortname, std::string &key) {
+    size_t baselen = strcspn(shortname,".");
+    size_t tilde = baselen;
+    while (tilde > 0 && shortname[tilde-1] != '~') tilde--;
+    if (tilde == 0 || tilde == baselen) return false;
+    key = AliasKey(shortname,tilde-1,baselen-tilde);
+    return true;
+}
 
-        compareCount2 -= numberSize;
-        if (compareCount2>compareCount1) compareCount1 = compareCount2;
-*/
-        size_t compareCount1 = strcspn(shortName,"~");
-        size_t numberSize    = strcspn(cpos,".");
-        size_t compareCount2 = strcspn(compareName,".");
-        if(compareCount2 > 8) compareCount2 = 8;
-        /* We want
-         * compareCount2 -= numberSize;
-         * if (compareCount2>compareCount1) compareCount1 = compareCount2;
-         * but to prevent negative numbers:
-         */
-        if(compareCount2 > compareCount1 + numberSize)
-            compareCount1 = compareCount2 - numberSize;
-        return strncmp(compareName,shortName,compareCount1);
-    }
-    return strcmp(compareName,shortName);
+// Number of characters of the long name kept in front of a "~number" of the given width
+static Bits ShortNameStemLength(const char* tmpName, Bits len, size_t digits) {
+    if ((size_t)len+digits+1u<=8u) return len;
+
+    Bits tocopy = (Bits)(8u - digits - 1u);
+    bool lead = false;
+    if (IS_PC98_ARCH || isDBCSCP())
+        for (int i=0; i<tocopy; i++) {
+            if (lead) lead = false;
+            else if ((IS_PC98_ARCH && shiftjis_lead_byte(tmpName[i]&0xFF)) || (isDBCSCP() && isKanji1_gbk(tmpName[i]&0xFF))) lead = true;
+        }
+    if (lead) tocopy--;
+    return tocopy;
 }
 
-Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* name) {
-    std::vector<CFileInfo*>::size_type filelist_size = curDir->longNameList.size();
-    if (GCC_UNLIKELY(filelist_size<=0)) return 1;   // shortener IDs start with 1
+void DOS_Drive_Cache::IndexEntry(CFileInfo* dir, CFileInfo* info) {
+    dir->shortIndex.insert(std::make_pair(std::string(info->shortname),info));
+    dir->longIndex.insert(std::make_pair(FoldName(info->orgname),info));
 
-    Bitu foundNr    = 0;
-    Bits low        = 0;
-    Bits high       = (Bits)(filelist_size-1);
+    std::string key;
+    if (info->shortNr > 0 && AliasKeyOf(info->shortname,key))
+        dir->aliasIndex[key].insert(info->shortNr);
+}
 
-    while (low<=high) {
-        Bits mid = (low+high)/2;
-        Bits res = CompareShortname(name,curDir->longNameList[(size_t)mid]->shortname);
+void DOS_Drive_Cache::UnindexEntry(CFileInfo* dir, CFileInfo* info) {
+    std::unordered_map<std::string,CFileInfo*>::iterator s = dir->shortIndex.find(info->shortname);
+    if (s != dir->shortIndex.end() && s->second == info) dir->shortIndex.erase(s);
 
-        if (res>0)  low  = mid+1; else
-        if (res<0)  high = mid-1;
-        else {
-            // any more same x chars in next entries ?
-            do {
-                foundNr = curDir->longNameList[(size_t)mid]->shortNr;
-                mid++;
-            } while((Bitu)mid<curDir->longNameList.size() && (CompareShortname(name,curDir->longNameList[(size_t)mid]->shortname)==0));
+    std::pair<std::unordered_multimap<std::string,CFileInfo*>::iterator,std::unordered_multimap<std::string,CFileInfo*>::iterator> range =
+        dir->longIndex.equal_range(FoldName(info->orgname));
+    for (std::unordered_multimap<std::string,CFileInfo*>::iterator l = range.first; l != range.second; ++l) {
+        if (l->second == info) {
+            dir->longIndex.erase(l);
             break;
         }
     }
+
+    std::string key;
+    if (info->shortNr > 0 && AliasKeyOf(info->shortname,key)) {
+        std::unordered_map<std::string,std::set<Bitu> >::iterator a = dir->aliasIndex.find(key);
+        if (a != dir->aliasIndex.end()) {
+            a->second.erase(info->shortNr);
+            if (a->second.empty()) dir->aliasIndex.erase(a);
+        }
+    }
+}
+
+/* Entry with the given long name. If not exact, the case of ASCII letters is ignored, but an
+ * entry with the exact case is still preferred, then the first one in the list. */
+DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindLongName(CFileInfo* dir, const char* name, bool exact) {
+    CFileInfo* found = nullptr;
+    std::pair<std::unordered_multimap<std::string,CFileInfo*>::iterator,std::unordered_multimap<std::string,CFileInfo*>::iterator> range =
+        dir->longIndex.equal_range(FoldName(name));
+    for (std::unordered_multimap<std::string,CFileInfo*>::iterator l = range.first; l != range.second; ++l) {
+        if (strcmp(name,l->second->orgname) == 0) return l->second;
+        if (!exact && (found == nullptr || IndexOf(dir,l->second) < IndexOf(dir,found))) found = l->second;
+    }
+    return found;
+}
+
+// Position of an entry in fileList, which is sorted by short name except while ReadDir fills it
+Bits DOS_Drive_Cache::IndexOf(CFileInfo* dir, CFileInfo* info) {
+    std::vector<CFileInfo*>::iterator it = std::lower_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName);
+    for (; it != dir->fileList.end() && strcmp((*it)->shortname,info->shortname) == 0; ++it) {
+        if (*it == info) return (Bits)(it - dir->fileList.begin());
+    }
+    it = std::find(dir->fileList.begin(),dir->fileList.end(),info);
+    return (it != dir->fileList.end()) ? (Bits)(it - dir->fileList.begin()) : -1;
+}
+
+Bitu DOS_Drive_Cache::CreateShortNameID(CFileInfo* curDir, const char* name) {
+    if (GCC_UNLIKELY(curDir->aliasIndex.empty())) return 1;   // shortener IDs start with 1
+
+    // the characters kept from the name depend on the width of the number
+    Bits len = (Bits)strcspn(name,".");
+    Bitu foundNr = 0;
+    for (size_t digits=1; digits<=7; digits++) {
+        std::unordered_map<std::string,std::set<Bitu> >::iterator it =
+            curDir->aliasIndex.find(AliasKey(name,(size_t)ShortNameStemLength(name,len,digits),digits));
+        if (it != curDir->aliasIndex.end() && *it->second.rbegin() > foundNr)
+            foundNr = *it->second.rbegin();
+    }
     return foundNr+1;
 }
 
@@ -532,25 +735,17 @@ Bits DOS_Drive_Cache::GetLongName(CFileInfo* curDir, char* shortName) {
     RemoveTrailingDot(shortName);
     // Search long name and return array number of element
     Bits res;
-	Bits low	= 0;
-	Bits high	= (Bits)(filelist_size-1);
-	Bits mid;
-	while (low<=high) {
-		mid = (low+high)/2;
-		res = strcmp(shortName,curDir->fileList[mid]->shortname);
-		if (res>0)	low  = mid+1; else
-		if (res<0)	high = mid-1; else
-		{	// Found
-			strcpy(shortName,curDir->fileList[mid]->orgname);
-			return mid;
-		};
+	std::unordered_map<std::string,CFileInfo*>::iterator it = curDir->shortIndex.find(shortName);
+	if (it != curDir->shortIndex.end()) {
+		// Found
+		strcpy(shortName,it->second->orgname);
+		return IndexOf(curDir,it->second);
 	}
 	if (uselfn && strlen(shortName)) {
-		for (Bitu i=0; i<filelist_size; i++) {
-			if (!strcasecmp(shortName,curDir->fileList[i]->orgname)) {
-				strcpy(shortName,curDir->fileList[i]->orgname);
-				return (Bits)i;
-		    }
+		CFileInfo* info = FindLongName(curDir,shortName,false);
+		if (info) {
+			strcpy(shortName,info->orgname);
+			return IndexOf(curDir,info);
 		}
 	}
 
@@ -633,7 +828,9 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
     if (!createShort) {
         char buffer[CROSS_LEN];
         strcpy(buffer,tmpName);
-        createShort = (GetLongName(curDir,buffer)>=0);
+        RemoveTrailingDot(buffer);
+        // same test as GetLongName, without looking up the position in a list ReadDir may not have sorted yet
+        createShort = curDir->shortIndex.count(buffer)>0 || (uselfn && buffer[0] && FindLongName(curDir,buffer,false) != nullptr);
     }
 
     if (createShort) {
@@ -643,19 +840,7 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
         if (GCC_UNLIKELY(info->shortNr > 9999999)) E_Exit("~9999999 same name files overflow");
         sprintf(buffer, "%d", static_cast<unsigned int>(info->shortNr));
         // Copy first letters
-        Bits tocopy = 0;
-        size_t buflen = strlen(buffer);
-        if ((size_t)len+buflen+1u>8u) {
-            tocopy = (Bits)(8u - buflen - 1u);
-            bool lead = false;
-            if (IS_PC98_ARCH || isDBCSCP())
-                for (int i=0; i<tocopy; i++) {
-                    if (lead) lead = false;
-                    else if ((IS_PC98_ARCH && shiftjis_lead_byte(tmpName[i]&0xFF)) || (isDBCSCP() && isKanji1_gbk(tmpName[i]&0xFF))) lead = true;
-                }
-            if (lead) tocopy--;
-        }
-        else                          tocopy = len;
+        Bits tocopy = ShortNameStemLength(tmpName,len,strlen(buffer));
         safe_strncpy(info->shortname,tmpName,tocopy+1);
         // Copy number
         strcat(info->shortname,"~");
@@ -669,29 +854,6 @@ void DOS_Drive_Cache::CreateShortName(CFileInfo* curDir, CFileInfo* info) {
             info->shortname[DOS_NAMELENGTH] = 0;
         }
 
-        // keep list sorted for CreateShortNameID to work correctly
-        if (curDir->longNameList.size()>0) {
-            if (!(strcmp(info->shortname,curDir->longNameList.back()->shortname)<0)) {
-                // append at end of list
-                curDir->longNameList.push_back(info);
-            } else {
-                // look for position where to insert this element
-                bool found=false;
-                std::vector<CFileInfo*>::iterator it;
-                for (it=curDir->longNameList.begin(); it!=curDir->longNameList.end(); ++it) {
-                    if (strcmp(info->shortname,(*it)->shortname)<0) {
-                        found = true;
-                        break;
-                    }
-                }
-                // Put it in longname list...
-                if (found) curDir->longNameList.insert(it,info);
-                else curDir->longNameList.push_back(info);
-            }
-        } else {
-            // empty file list, append
-            curDir->longNameList.push_back(info);
-        }
     } else {
         strcpy(info->shortname,tmpName);
     }
@@ -707,6 +869,7 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
     CFileInfo*  curDir = dirBase;
     uint16_t      id;
 
+    PollHostWatch();
     if (save_dir && (strcmp(path,save_path)==0)) {
         strcpy(expandedPath,save_expanded);
         return save_dir;
@@ -733,6 +896,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
                 dirSearch[id] = nullptr;
             }
         }
+    } else if (curDir->stale) {
+        RefreshDir(curDir,basePath);
     }
 
     do {
@@ -766,6 +931,8 @@ DOS_Drive_Cache::CFileInfo* DOS_Drive_Cache::FindDirInfo(const char* path, char*
                         dirSearch[id] = nullptr;
                     }
                 }
+            } else if (curDir->stale) {
+                RefreshDir(curDir,expandedPath);
             }
         }
         if (pos) {
@@ -833,25 +1000,16 @@ char* DOS_Drive_Cache::CreateEntry(CFileInfo* dir, const char* name, const char*
 
     // Check for long filenames...
     if (sname[0]==0) CreateShortName(dir, info);
+    IndexEntry(dir, info);
 
-    // keep list sorted (so GetLongName works correctly, used by CreateShortName in this routine)
+    // keep list sorted (so GetLongName can return positions, ReadDir sorts once when it is done)
     if (dir->fileList.size()>0 && !skipSort) {
         if (!(strcmp(info->shortname,dir->fileList.back()->shortname)<0)) {
             // append at end of list
             dir->fileList.push_back(info);
         } else {
-            bool found = false;
-            // look for position where to insert this element
-            std::vector<CFileInfo*>::iterator it;
-            for (it=dir->fileList.begin(); it!=dir->fileList.end(); ++it) {
-                if (strcmp(info->shortname,(*it)->shortname)<0) {
-                    found = true;
-                    break;
-                }
-            }
-            // Put file in lists
-            if (found) dir->fileList.insert(it,info);
-            else dir->fileList.push_back(info);
+            // Put file in lists, after any entry with the same name
+            dir->fileList.insert(std::upper_bound(dir->fileList.begin(),dir->fileList.end(),info,SortByName),info);
         }
     } else {
         // empty file list, append
@@ -878,10 +1036,16 @@ bool DOS_Drive_Cache::ReadDir(uint16_t id, char* &result, char * &lresult) {
     if (id>=MAX_OPENDIRS) return false;
 
     if (!IsCachedIn(dirSearch[id])) {
+        // Watch before reading, so a host change made while the directory is read marks it stale again
+        if (dirSearch[id]) {
+            dirSearch[id]->stale = false;
+            AddHostWatch(dirSearch[id], dirPath);
+        }
         // Try to open directory
         void* dirp = drive->opendir(dirPath);
         if (!dirp) {
             if (dirSearch[id]) {
+                RemoveHostWatch(dirSearch[id]);
                 dirSearch[id]->id = MAX_OPENDIRS;
                 dirSearch[id] = nullptr;
             }
@@ -1015,6 +1179,7 @@ void DOS_Drive_Cache::ClearFileInfo(CFileInfo *dir) {
         dirSearch[dir->id] = nullptr;
         dir->id = MAX_OPENDIRS;
     }
+    RemoveHostWatch(dir);
 }
 
 void DOS_Drive_Cache::DeleteFileInfo(CFileInfo *dir) {
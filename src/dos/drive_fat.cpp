@@ -252,6 +252,7 @@ class fatFile : public DOS_File {
                 bool modified = false;
                 bool loadedSector = false;
                 fatDrive *myDrive;
+                fatDrive::clusterChainMemory ccm; /* position in the allocation chain of the last Read() */
 };
 
 void time_t_to_DOS_DateTime(uint16_t &t,uint16_t &d,time_t unix_time) {
@@ -350,6 +351,8 @@ void fatFile::Flush(void) {
 		modified = false;
 		newtime = false;
 	}
+
+	myDrive->flushBlockCache();
 }
 
 bool fatFile::Read(uint8_t * data, uint16_t *size) {
@@ -357,51 +360,71 @@ bool fatFile::Read(uint8_t * data, uint16_t *size) {
 		DOS_SetError(DOSERR_ACCESS_DENIED);
 		return false;
 	}
-	uint16_t sizedec, sizecount;
 	if(seekpos >= filelength) {
 		*size = 0;
 		return true;
 	}
 
-	if (!loadedSector) {
-		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
-		if(currentSector == 0) {
-			/* EOC reached before EOF */
-			*size = 0;
-			loadedSector = false;
-			return true;
-		}
-		curSectOff = seekpos % myDrive->getSectorSize();
-		myDrive->readSector(currentSector, sectorBuffer);
-		loadedSector = true;
-	}
+	const uint32_t sectsize = myDrive->getSectorSize();
+	uint32_t todo = *size;
+	uint32_t done = 0;
 
-	sizedec = *size;
-	sizecount = 0;
-	while(sizedec != 0) {
-		if(seekpos >= filelength) {
-			*size = sizecount;
-			return true; 
-		}
-		data[sizecount++] = sectorBuffer[curSectOff++];
-		seekpos++;
-		if(curSectOff >= myDrive->getSectorSize()) {
-			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos);
+	if (todo > (filelength - seekpos)) todo = filelength - seekpos;
+
+	while (done < todo) {
+		if (!loadedSector) {
+			currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &ccm);
 			if(currentSector == 0) {
 				/* EOC reached before EOF */
 				//LOG_MSG("EOC reached before EOF, seekpos %d, filelen %d", seekpos, filelength);
-				*size = sizecount;
-				loadedSector = false;
-				return true;
+				break;
+			}
+			curSectOff = seekpos % sectsize;
+
+			/* whole sectors go directly to the caller, one run of contiguous sectors at a time */
+			if (curSectOff == 0 && (todo - done) >= sectsize) {
+				const uint32_t maxcount = (todo - done) / sectsize;
+				uint32_t count = 1;
+
+				while (count < maxcount && myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos + (count * sectsize), &ccm) == (currentSector + count))
+					count++;
+
+				if (myDrive->readSectors(currentSector, count, data + done) != 0) {
+					/* a host read error must not hand the caller stale buffer contents */
+					DOS_SetError(DOSERR_ACCESS_DENIED);
+					return false;
+				}
+				done += count * sectsize;
+				seekpos += count * sectsize;
+				continue;
+			}
+
+			if (myDrive->readSector(currentSector, sectorBuffer) != 0) {
+				DOS_SetError(DOSERR_ACCESS_DENIED);
+				return false;
 			}
-			curSectOff = 0;
-			myDrive->readSector(currentSector, sectorBuffer);
 			loadedSector = true;
-			//LOG_MSG("Reading absolute sector at %d for seekpos %d", currentSector, seekpos);
 		}
-		--sizedec;
+
+		uint32_t n = sectsize - curSectOff;
+		if (n > (todo - done)) n = todo - done;
+		memcpy(data + done, sectorBuffer + curSectOff, n);
+		done += n;
+		seekpos += n;
+		curSectOff += n;
+		if (curSectOff >= sectsize) loadedSector = false;
 	}
-	*size =sizecount;
+
+	/* Write() expects the sector at the file position to be loaded */
+	if (!loadedSector && seekpos < filelength) {
+		currentSector = myDrive->getAbsoluteSectFromBytePos(firstCluster, seekpos, &ccm);
+		if (currentSector != 0) {
+			curSectOff = seekpos % sectsize;
+			loadedSector = myDrive->readSector(currentSector, sectorBuffer) == 0;
+		}
+	}
+
+	*size = (uint16_t)done;
 	return true;
 }
 
@@ -416,6 +439,10 @@ bool fatFile::Write(const uint8_t * data, uint16_t *size) {
 	sizedec = *size;
 	sizecount = 0;
 
+	/* the allocation chain may change, and sector writes are held in the drive's cache until Close() or Flush() */
+	ccm.clear();
+	myDrive->blockCacheDeferWrites++;
+
 	if(seekpos < filelength && *size == 0) {
 		/* Truncate file to current position */
 		if(firstCluster != 0) myDrive->deleteClustChain(firstCluster, seekpos);
@@ -525,6 +552,7 @@ finalizeWrite:
 		tmpentry.loFirstClust = (uint16_t)firstCluster;
 
 	myDrive->directoryChange(dirCluster, &tmpentry, (int32_t)dirIndex);
+	myDrive->blockCacheDeferWrites--;
 
 	*size =sizecount;
 	return true;
@@ -587,6 +615,7 @@ bool fatFile::Close() {
 		myDrive->directoryChange(dirCluster, &tmpentry, (int32_t)dirIndex);
 	}
 
+	myDrive->flushBlockCache();
 	return false;
 }
 
@@ -615,6 +644,9 @@ uint32_t fatDrive::getClusterValue(uint32_t clustNum) {
 
 	if (unformatted) return 0xFFFFFFFFu;
 
+	if (!fatTableLoaded) loadFatTable();
+	if (clustNum < fatTable.size()) return fatTable[clustNum];
+
 	switch(fattype) {
 		case FAT12:
 			fatoffset = clustNum + (clustNum / 2);
@@ -716,6 +748,28 @@ void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 		curFatSect = fatsectnum;
 	}
 
+	uint32_t newValue = 0;
+	switch(fattype) {
+		case FAT12: newValue = clustValue & 0xfff; break;
+		case FAT16: newValue = clustValue & 0xffff; break;
+		case FAT32: newValue = clustValue & 0x0FFFFFFFul; break;
+	}
+	if (clustNum < fatTable.size()) fatTable[clustNum] = newValue;
+
+	if (clusterMapLoaded && clustNum >= 2 && (clustNum - 2) < CountOfClusters) {
+		uint64_t &w = clusterMap[(clustNum - 2) >> 6u];
+		const uint64_t bit = (uint64_t)1u << (uint64_t)((clustNum - 2) & 63u);
+
+		if (newValue != 0 && !(w & bit)) {
+			w |= bit;
+			freeClusterCount--;
+		}
+		else if (newValue == 0 && (w & bit)) {
+			w &= ~bit;
+			freeClusterCount++;
+		}
+	}
+
 	switch(fattype) {
 		case FAT12: {
 			uint16_t tmpValue = var_read((uint16_t *)&fatSectBuffer[fatentoff]);
@@ -741,10 +795,10 @@ void fatDrive::setClusterValue(uint32_t clustNum, uint32_t clustValue) {
 			break;
 	}
 	for(unsigned int fc=0;fc<BPB.v.BPB_NumFATs;fc++) {
-		writeSector(fatsectnum + (fc * (BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16)), &fatSectBuffer[0]);
+		writeBlock(fatsectnum + (fc * (BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16)), &fatSectBuffer[0]);
 		if (fattype==FAT12) {
 			if (fatentoff >= (BPB.v.BPB_BytsPerSec-1U))
-				writeSector(fatsectnum+1u+(fc * (BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16)), &fatSectBuffer[BPB.v.BPB_BytsPerSec]);
+				writeBlock(fatsectnum+1u+(fc * (BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16)), &fatSectBuffer[BPB.v.BPB_BytsPerSec]);
 		}
 	}
 }
@@ -1053,7 +1107,251 @@ bool fatDrive::getDirClustNum(const char *dir, uint32_t *clustNum, bool parDir)
    However, if CHS is expressed in terms of the loadedDisk geometry
    (instead of fatDrive's, which can differ), VHD access works fine, and
    RAW images keep working.  2023.05.11 - maxpat78 */
+/* number of logical sectors held by the fatDrive block cache */
+static const size_t fat_block_cache_sectors = 512;
+
+/* largest volume (in clusters) whose FAT is decoded into memory, 64MB worth of entries */
+static const uint32_t fat_table_max_clusters = 0x1000000u;
+
 uint8_t fatDrive::readSector(uint32_t sectnum, void * data) {
+	return readBlock(sectnum, data, true);
+}
+
+uint8_t fatDrive::writeSector(uint32_t sectnum, void * data) {
+	/* writes to the FAT from outside setClusterValue() (INT 26h, IOCTL) make the decoded copy stale */
+	if ((fatTableLoaded || clusterMapLoaded) && isFatSector(sectnum)) {
+		fatTable.clear();
+		fatTableLoaded = false;
+		clusterMap.clear();
+		clusterMapLoaded = false;
+		curFatSect = 0xffffffff;
+	}
+
+	return writeBlock(sectnum, data);
+}
+
+/* read consecutive sectors straight into the caller's buffer. Sectors already in the cache are
+ * copied from it, others are read from the disk without filling the cache, so that large file
+ * reads do not push the FAT and directory sectors out. */
+uint8_t fatDrive::readSectors(uint32_t sectnum, uint32_t count, void * data) {
+	const uint32_t sectsize = getSectorSize();
+	uint8_t *d = (uint8_t*)data;
+
+	while (count != 0) {
+		/* runs of sectors that are not cached go to the disk image as one request */
+		uint32_t run = 0;
+		if (absolute) {
+			while (run < count && blockCacheMap.find(sectnum+run) == blockCacheMap.end()) run++;
+		}
+
+		if (run > 1) {
+			const uint8_t r = readSectorsUncached(sectnum, run, d);
+			if (r != 0) return r;
+		}
+		else {
+			const uint8_t r = readBlock(sectnum, d, false);
+			if (r != 0) return r;
+			run = 1;
+		}
+
+		sectnum += run;
+		count -= run;
+		d += (size_t)run * sectsize;
+	}
+
+	return 0;
+}
+
+std::list<fatDrive::blockCacheEntry>::iterator fatDrive::allocBlock(uint32_t sectnum) {
+	std::list<blockCacheEntry>::iterator i;
+
+	if (blockCache.size() >= fat_block_cache_sectors) {
+		/* recycle the least recently used entry */
+		i = std::prev(blockCache.end());
+		if (i->dirty) {
+			if (writeSectorUncached(i->sectnum, &i->data[0]) != 0)
+				LOG(LOG_DOSMISC,LOG_WARN)("FAT: failed to write back cached sector %u",(unsigned int)i->sectnum);
+		}
+		blockCacheMap.erase(i->sectnum);
+		blockCache.splice(blockCache.begin(), blockCache, i);
+	}
+	else {
+		blockCache.push_front(blockCacheEntry());
+		i = blockCache.begin();
+	}
+
+	i->sectnum = sectnum;
+	i->dirty = false;
+	i->data.resize(getSectorSize());
+	blockCacheMap[sectnum] = i;
+	return i;
+}
+
+uint8_t fatDrive::readBlock(uint32_t sectnum, void * data, bool fill) {
+	auto m = blockCacheMap.find(sectnum);
+	if (m != blockCacheMap.end()) {
+		blockCache.splice(blockCache.begin(), blockCache, m->second);
+		memcpy(data, &m->second->data[0], getSectorSize());
+		return 0;
+	}
+
+	const uint8_t r = readSectorUncached(sectnum, data);
+	if (r == 0 && fill) {
+		auto i = allocBlock(sectnum);
+		memcpy(&i->data[0], data, getSectorSize());
+	}
+
+	return r;
+}
+
+uint8_t fatDrive::writeBlock(uint32_t sectnum, void * data) {
+	std::list<blockCacheEntry>::iterator i;
+	auto m = blockCacheMap.find(sectnum);
+
+	if (m != blockCacheMap.end()) {
+		i = m->second;
+		blockCache.splice(blockCache.begin(), blockCache, i);
+	}
+	else {
+		i = allocBlock(sectnum);
+	}
+
+	memcpy(&i->data[0], data, getSectorSize());
+
+	if (blockCacheDeferWrites != 0) {
+		i->dirty = true;
+		return 0;
+	}
+
+	const uint8_t r = writeSectorUncached(sectnum, data);
+	if (r != 0) {
+		/* do not keep data the disk did not accept */
+		blockCacheMap.erase(i->sectnum);
+		blockCache.erase(i);
+	}
+	else {
+		i->dirty = false;
+	}
+
+	return r;
+}
+
+void fatDrive::flushBlockCache(void) {
+	std::vector<blockCacheEntry*> dirty;
+
+	for (auto &e : blockCache) {
+		if (e.dirty) dirty.push_back(&e);
+	}
+	if (dirty.empty()) return;
+
+	/* write back in sector order */
+	std::sort(dirty.begin(), dirty.end(), [](const blockCacheEntry *a, const blockCacheEntry *b) { return a->sectnum < b->sectnum; });
+	for (auto e : dirty) {
+		if (writeSectorUncached(e->sectnum, &e->data[0]) != 0)
+			LOG(LOG_DOSMISC,LOG_WARN)("FAT: failed to write back cached sector %u",(unsigned int)e->sectnum);
+		e->dirty = false;
+	}
+}
+
+void fatDrive::invalidateBlockCache(void) {
+	blockCacheMap.clear();
+	blockCache.clear();
+	fatTable.clear();
+	fatTableLoaded = false;
+	clusterMap.clear();
+	clusterMapLoaded = false;
+	curFatSect = 0xffffffff;
+}
+
+void fatDrive::EmptyCache(void) {
+	flushBlockCache();
+}
+
+void fatDrive::MediaChange(void) {
+	flushBlockCache();
+	invalidateBlockCache();
+}
+
+bool fatDrive::isFatSector(uint32_t sectnum) {
+	const uint32_t fatstart = BPB.v.BPB_RsvdSecCnt + partSectOff;
+	const uint32_t fatsize = BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16;
+
+	return sectnum >= fatstart && sectnum < (fatstart + (fatsize * BPB.v.BPB_NumFATs));
+}
+
+void fatDrive::loadFatTable(void) {
+	fatTableLoaded = true;
+	fatTable.clear();
+
+	if (unformatted || CountOfClusters == 0 || CountOfClusters > fat_table_max_clusters) return;
+
+	const uint32_t entries = CountOfClusters + 2;
+	const uint32_t bps = BPB.v.BPB_BytsPerSec;
+	const uint32_t fatsize = BPB.is_fat32() ? BPB.v32.BPB_FATSz32 : BPB.v.BPB_FATSz16;
+	const uint32_t fatstart = BPB.v.BPB_RsvdSecCnt + partSectOff;
+	uint32_t bytes = 0;
+
+	switch (fattype) {
+		case FAT12: bytes = entries + (entries / 2) + 1; break;
+		case FAT16: bytes = entries * 2; break;
+		case FAT32: bytes = entries * 4; break;
+		default: return;
+	}
+
+	const uint32_t sectors = (bytes + bps - 1) / bps;
+	if (sectors > fatsize) return; /* FAT too small for the cluster count, leave it to the range checks in getClusterValue() */
+
+	/* FAT12 entries straddle sectors, so the whole (small) table is read at once. FAT16 and FAT32 are decoded in chunks */
+	const uint32_t chunk = (fattype == FAT12) ? sectors : std::min(sectors, 64u);
+	std::vector<uint8_t> buf((size_t)chunk * bps);
+
+	fatTable.resize(entries);
+	for (uint32_t s = 0;s < sectors;s += chunk) {
+		const uint32_t n = std::min(chunk, sectors - s);
+
+		if (readSectors(fatstart + s, n, &buf[0]) != 0) {
+			LOG(LOG_DOSMISC,LOG_WARN)("FAT: unable to read the FAT, not keeping a decoded copy");
+			fatTable.clear();
+			return;
+		}
+
+		if (fattype == FAT12) {
+			for (uint32_t c = 0;c < entries;c++) {
+				const uint32_t v = var_read((uint16_t*)&buf[c + (c / 2)]);
+				fatTable[c] = (c & 1) ? (v >> 4) : (v & 0xfff);
+			}
+		}
+		else if (fattype == FAT16) {
+			const uint32_t first = (s * bps) / 2;
+			for (uint32_t c = first;c < entries && c < (first + ((n * bps) / 2));c++)
+				fatTable[c] = var_read((uint16_t*)&buf[(c - first) * 2]);
+		}
+		else {
+			const uint32_t first = (s * bps) / 4;
+			for (uint32_t c = first;c < entries && c < (first + ((n * bps) / 4));c++)
+				fatTable[c] = var_read((uint32_t*)&buf[(c - first) * 4]) & 0x0FFFFFFFul;
+		}
+	}
+}
+
+void fatDrive::loadClusterMap(void) {
+	clusterMapLoaded = true;
+	freeClusterCount = 0;
+	clusterMap.assign((CountOfClusters + 63u) / 64u, 0);
+
+	for (uint32_t i = 0;i < CountOfClusters;i++) {
+		if (getClusterValue(i + 2) != 0)
+			clusterMap[i >> 6u] |= (uint64_t)1u << (uint64_t)(i & 63u);
+		else
+			freeClusterCount++;
+	}
+
+	/* bits past the last cluster count as in use so the search never returns them */
+	if (CountOfClusters & 63u)
+		clusterMap.back() |= ~(uint64_t)0u << (uint64_t)(CountOfClusters & 63u);
+}
+
+uint8_t fatDrive::readSectorUncached(uint32_t sectnum, void * data) {
 	if (absolute) return Read_AbsoluteSector(sectnum, data);
     assert(!IS_PC98_ARCH);
 #ifdef OLD_CHS_CONVERSION
@@ -1072,7 +1370,19 @@ uint8_t fatDrive::readSector(uint32_t sectnum, void * data) {
 	return loadedDisk->Read_Sector(head, cylinder, sector, data);
 }	
 
-uint8_t fatDrive::writeSector(uint32_t sectnum, void * data) {
+uint8_t fatDrive::readSectorsUncached(uint32_t sectnum, uint32_t count, void * data) {
+    if (loadedDisk != NULL) {
+        const unsigned int lsz = loadedDisk->getSectSize();
+        const unsigned int c = sector_size / lsz;
+
+        if (c != 0 && (sector_size % lsz) == 0)
+            return loadedDisk->Read_Sectors((sectnum * c) + physToLogAdj, count * c, data) != 0 ? 0x05 : 0;
+    }
+
+    return 0x05;
+}
+
+uint8_t fatDrive::writeSectorUncached(uint32_t sectnum, void * data) {
 	if (absolute) return Write_AbsoluteSector(sectnum, data);
     assert(!IS_PC98_ARCH);
 #ifdef OLD_CHS_CONVERSION
@@ -1166,8 +1476,8 @@ uint32_t fatDrive::getAbsoluteSectFromChain(uint32_t startClustNum, uint32_t log
 	assert(indxClust<=targClust);
 
 	if (ccm != NULL) {
-		ccm->current_cluster_index = currentClust;
-		ccm->current_cluster_no = indxClust;
+		ccm->current_cluster_index = indxClust;
+		ccm->current_cluster_no = currentClust;
 	}
 
 	/* this should not happen! */
@@ -1331,6 +1641,7 @@ bool fatDrive::allocateCluster(uint32_t useCluster, uint32_t prevCluster) {
 }
 
 fatDrive::~fatDrive() {
+	flushBlockCache();
 	if (loadedDisk) {
 		if (partition_index >= 0) loadedDisk->partitionMarkUse(partition_index,false);
 		loadedDisk->Release();
@@ -1466,12 +1777,8 @@ uint8_t fatDrive::Read_AbsoluteSector(uint32_t sectnum, void * data) {
         if (c != 0 && (sector_size % lsz) == 0) {
             uint32_t ssect = (sectnum * c) + physToLogAdj;
 
-            while (c-- != 0) {
-                if (loadedDisk->Read_AbsoluteSector(ssect++,data) != 0)
-                    return 0x05;
-
-                data = (void*)((char*)data + lsz);
-            }
+            if (loadedDisk->Read_Sectors(ssect,c,data) != 0)
+                return 0x05;
 
             return 0;
         }
@@ -1489,12 +1796,8 @@ uint8_t fatDrive::Write_AbsoluteSector(uint32_t sectnum, void * data) {
         if (c != 0 && (sector_size % lsz) == 0) {
             uint32_t ssect = (sectnum * c) + physToLogAdj;
 
-            while (c-- != 0) {
-                if (loadedDisk->Write_AbsoluteSector(ssect++,data) != 0)
-                    return 0x05;
-
-                data = (void*)((char*)data + lsz);
-            }
+            if (loadedDisk->Write_Sectors(ssect,c,data) != 0)
+                return 0x05;
 
             return 0;
         }
@@ -2342,20 +2645,14 @@ void fatDrive::fatDriveInit(const char *sysFilename, uint32_t bytesector, uint32
 #endif
 
 bool fatDrive::AllocationInfo32(uint32_t * _bytes_sector,uint32_t * _sectors_cluster,uint32_t * _total_clusters,uint32_t * _free_clusters) {
-	uint32_t countFree = 0;
-	uint32_t i;
-
 	if (unformatted) return false;
 
-	for(i=0;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2))
-			countFree++;
-	}
+	if (!clusterMapLoaded) loadClusterMap();
 
 	*_bytes_sector = getSectSize();
 	*_sectors_cluster = BPB.v.BPB_SecPerClus;
 	*_total_clusters = CountOfClusters;
-	*_free_clusters = countFree;
+	*_free_clusters = freeClusterCount;
 
 	return true;
 }
@@ -2372,13 +2669,9 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 		return false;
 	}
 	else {
-		uint32_t countFree = 0;
-		uint32_t i;
+		if (!clusterMapLoaded) loadClusterMap();
 
-		for(i=0;i<CountOfClusters;i++) {
-			if(!getClusterValue(i+2))
-				countFree++;
-		}
+		const uint32_t countFree = freeClusterCount;
 
 		/* FAT12/FAT16 should never allow more than 0xFFF6 clusters and partitions larger than 2GB */
 		*_bytes_sector = (uint16_t)getSectSize();
@@ -2391,15 +2684,27 @@ bool fatDrive::AllocationInfo(uint16_t *_bytes_sector, uint8_t *_sectors_cluster
 }
 
 uint32_t fatDrive::getFirstFreeClust(void) {
-	uint32_t i;
-
 	if (unformatted) return 0;
 
-	for(i=searchFreeCluster;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2)) return ((searchFreeCluster=i)+2);
-	}
-	for(i=0;i<CountOfClusters;i++) {
-		if(!getClusterValue(i+2)) return ((searchFreeCluster=i)+2);
+	if (!clusterMapLoaded) loadClusterMap();
+
+	if (freeClusterCount != 0) {
+		const size_t words = clusterMap.size();
+		if (searchFreeCluster >= CountOfClusters) searchFreeCluster = 0;
+
+		/* search from searchFreeCluster to the end, then wrap around to the start */
+		size_t w = searchFreeCluster >> 6u;
+		uint64_t v = clusterMap[w] | ~(~(uint64_t)0u << (uint64_t)(searchFreeCluster & 63u)); /* skip bits below the start */
+
+		for (size_t n = 0;n <= words;n++) {
+			if (v != ~(uint64_t)0u) {
+				const uint32_t i = (uint32_t)(w << 6u) + bitop::bitseqlengthlsb<uint64_t>(v);
+				return ((searchFreeCluster=i)+2);
+			}
+
+			if (++w >= words) w = 0;
+			v = clusterMap[w];
+		}
 	}
 
 	/* No free cluster found */
@@ -2420,6 +2725,9 @@ const FAT_BootSector::bpb_union_t &fatDrive::GetBPB(void) { return BPB; }
 
 void fatDrive::SetBPB(const FAT_BootSector::bpb_union_t &bpb) {
 	if (readonly) return;
+	/* the layout (and possibly the sector size) changes, start over */
+	flushBlockCache();
+	invalidateBlockCache();
 	unformatted = false;
 	BPB.v.BPB_BytsPerSec = bpb.v.BPB_BytsPerSec;
 	BPB.v.BPB_SecPerClus = bpb.v.BPB_SecPerClus;
@@ -3688,6 +3996,15 @@ void fatDrive::checkDiskChange(void) {
 	if (loadedDisk->detectDiskChange() && !BPB.is_fat32() && partSectOff == 0) {
 		LOG(LOG_MISC,LOG_DEBUG)("FAT: disk change");
 
+		/* whatever is cached belongs to the previous disk */
+		for (auto &e : blockCache) {
+			if (e.dirty) {
+				LOG(LOG_DOSMISC,LOG_WARN)("FAT: disk changed with unwritten sectors in the cache, discarding them");
+				break;
+			}
+		}
+		invalidateBlockCache();
+
 		FAT_BootSector bootbuffer = {};
 		loadedDisk->Read_AbsoluteSector(0+partSectOff,&bootbuffer);
 
@@ -40,6 +40,9 @@
 #include <sys/stat.h>
 
 #include "dosbox.h"
+#if C_HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
 #include "dos_inc.h"
 #include "drives.h"
 #include "logging.h"
@@ -49,6 +52,7 @@
 #include "callback.h"
 #include "regs.h"
 #include "timer.h"
+#include "pic.h"
 #include "render.h"
 #include "jfont.h"
 
@@ -2589,6 +2593,21 @@ void localDrive::closedir(void *handle) {
 	close_directory((dir_information*)handle);
 }
 
+int localDrive::add_directory_watch(int fd, const char *name, uint32_t mask) {
+#if C_HAVE_INOTIFY
+    // guest to host code page translation
+    const host_cnv_char_t* host_name = CodePageGuestToHost(name);
+    if (host_name == NULL) return -1;
+
+    return inotify_add_watch(fd, host_name, mask);
+#else
+    (void)fd;
+    (void)name;
+    (void)mask;
+    return -1;
+#endif
+}
+
 bool localDrive::read_directory_first(void *handle, char* entry_name, char* entry_sname, bool& is_directory) {
     host_cnv_char_t tmp[MAX_PATH+1], stmp[MAX_PATH+1];
 
@@ -2744,10 +2763,9 @@ bool LocalFile::Read(uint8_t * data,uint16_t * size) {
 	/* Fake harddrive motion. Inspector Gadget with soundblaster compatible */
 	/* Same for Igor */
 	/* hardrive motion => unmask irq 2. Only do it when it's masked as unmasking is realitively heavy to emulate */
-    if (!IS_PC98_ARCH) {
-        uint8_t mask = IO_Read(0x21);
-        if(mask & 0x4 ) IO_Write(0x21,mask&0xfb);
-    }
+	/* the mask is looked up in the PIC instead of through port 21h on every call */
+	if (!IS_PC98_ARCH && PIC_GetIRQMask(2))
+		PIC_SetIRQMask(2,false);
 
 	return true;
 }
@@ -35,6 +35,11 @@
 #include <string.h>
 #include <time.h>
 #include <errno.h>
+#if defined(WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 #define OVERLAY_DIR 1
 bool logoverlay = false;
@@ -515,6 +520,17 @@ Overlay_Drive::Overlay_Drive(const char * startdir,const char* overlay, uint16_t
 	overlap_folder = dirname;
 
 	update_cache(true);
+
+	for (const auto &opt : options) {
+		if (!strcasecmp(opt.c_str(), "writeback")) ovlwriteback = true;
+	}
+	//A journal left behind by a session that did not end cleanly is applied, whatever the mode of this one.
+	journal_replay();
+}
+
+Overlay_Drive::~Overlay_Drive() {
+	journal_checkpoint();
+	journal_schedule_flush(); //nothing is buffered now, this only unregisters the drive
 }
 
 void Overlay_Drive::convert_overlay_to_DOSname_in_base(char* dirname ) 
@@ -776,6 +792,8 @@ void Overlay_Drive::update_cache(bool read_directory_contents) {
 	std::vector<std::string> dirnames;
 	std::vector<std::string> filenames;
 	if (read_directory_contents) {
+		//The lists are about to be reread from disk, so the markers that only exist in memory have to be written first.
+		journal_checkpoint();
 		//Clear all lists
 		DOSnames_cache.clear();
 		DOSdirs_cache.clear();
@@ -1499,7 +1517,10 @@ void Overlay_Drive::add_deleted_file(const char* name,bool create_on_disk) {
 		strcat(tname,temp_name);
 	if (!is_deleted_file(tname)) {
 		deleted_files_in_base.emplace_back(tname);
-		if (create_on_disk) add_special_file_to_disk(tname, "DEL");
+		if (create_on_disk) {
+			if (ovlwriteback) journal_marker(tname, "DEL", true);
+			else add_special_file_to_disk(tname, "DEL");
+		}
 	}
 }
 
@@ -1688,8 +1709,12 @@ void Overlay_Drive::remove_deleted_file(const char* name,bool create_on_disk) {
 	}
 	for(std::vector<std::string>::iterator it = deleted_files_in_base.begin(); it != deleted_files_in_base.end(); ++it) {
 		if (!strcasecmp((*it).c_str(), name)||!strcasecmp((*it).c_str(), tname)||(strlen(fname)&&!strcasecmp((*it).c_str(), fname))) {
+			std::string entry(*it);
 			deleted_files_in_base.erase(it);
-			if (create_on_disk) remove_special_file_from_disk(name, "DEL");
+			if (create_on_disk) {
+				if (ovlwriteback) journal_marker(entry, "DEL", false);
+				else remove_special_file_from_disk(name, "DEL");
+			}
 			return;
 		}
 	}
@@ -1700,7 +1725,10 @@ void Overlay_Drive::add_deleted_path(const char* name, bool create_on_disk) {
 		deleted_paths_in_base.emplace_back(name);
 		//Add it to deleted files as well, so it gets skipped in FindNext. 
 		//Maybe revise that.
-		if (create_on_disk) add_special_file_to_disk(name,"RMD");
+		if (create_on_disk) {
+			if (ovlwriteback) journal_marker(name, "RMD", true);
+			else add_special_file_to_disk(name,"RMD");
+		}
 		add_deleted_file(name,false);
 	}
 }
@@ -1722,13 +1750,183 @@ bool Overlay_Drive::is_deleted_path(const char* name) {
 void Overlay_Drive::remove_deleted_path(const char* name, bool create_on_disk) {
 	for(std::vector<std::string>::iterator it = deleted_paths_in_base.begin(); it != deleted_paths_in_base.end(); ++it) {
 		if (!strcasecmp((*it).c_str(), name)) {
+			std::string entry(*it);
 			deleted_paths_in_base.erase(it);
 			remove_deleted_file(name,false); //Rethink maybe.
-			if (create_on_disk) remove_special_file_from_disk(name,"RMD");
+			if (create_on_disk) {
+				if (ovlwriteback) journal_marker(entry, "RMD", false);
+				else remove_special_file_from_disk(name,"RMD");
+			}
 			break;
 		}
 	}
 }
+
+std::string Overlay_Drive::journal_filename(void) const {
+	return std::string(overlaydir) + special_prefix + "_JOURNAL";
+}
+
+//Track the marker state that has to end up on disk. Changes that cancel out (a temporary file that
+//hides a base file and is then restored) leave nothing to write.
+void Overlay_Drive::note_marker(const std::string &entry, const char* operation, bool present) {
+	std::string key = std::string(operation) + ":" + entry;
+	for (char &c : key) c = toupper(c);
+
+	std::map<std::string,PendingMarker>::iterator it = pending_markers.find(key);
+	if (it == pending_markers.end()) {
+		PendingMarker m;
+		m.entry = entry;
+		m.operation = operation;
+		m.on_disk = !present;
+		m.wanted = present;
+		pending_markers.insert(std::make_pair(key,m));
+	} else if (it->second.on_disk == present) {
+		pending_markers.erase(it);
+	} else {
+		it->second.entry = entry;
+		it->second.wanted = present;
+	}
+}
+
+//Journal records are "+DEL name" or "-RMD name", one per line. They are appended in batches of up
+//to 64 records, and a tick handler writes a partial batch about a second after the previous write,
+//so a crash loses at most the last second of changes. A record cut short by a crash is ignored on replay.
+void Overlay_Drive::journal_marker(const std::string &entry, const char* operation, bool present) {
+	note_marker(entry, operation, present);
+
+	journal_buffer += present ? '+' : '-';
+	journal_buffer += operation;
+	journal_buffer += ' ';
+	journal_buffer += entry;
+	journal_buffer += '\n';
+	journal_buffered++;
+	journal_records++;
+
+	if (journal_records >= 8192) journal_checkpoint(); //keep the journal, and the replay after a crash, short
+	else if (journal_buffered >= 64 || (GetTicks() - journal_last_flush) >= 1000) journal_flush();
+	journal_schedule_flush();
+}
+
+//drives in write-back mode with journal records not written yet
+static std::vector<Overlay_Drive*> journal_pending_flush;
+
+void Overlay_Drive::journal_flush_tick(void) {
+	const uint32_t now = GetTicks();
+	for (size_t i = 0; i < journal_pending_flush.size();) {
+		Overlay_Drive* drive = journal_pending_flush[i];
+		if (!drive->journal_buffer.empty() && (now - drive->journal_last_flush) < 1000) {
+			i++;
+			continue;
+		}
+		drive->journal_flush();
+		drive->journal_flush_pending = false;
+		journal_pending_flush.erase(journal_pending_flush.begin() + (ptrdiff_t)i);
+	}
+	if (journal_pending_flush.empty()) TIMER_DelTickHandler(journal_flush_tick);
+}
+
+//keeps the tick handler registered exactly while this drive has buffered records
+void Overlay_Drive::journal_schedule_flush(void) {
+	const bool want = !journal_buffer.empty();
+	if (want == journal_flush_pending) return;
+	journal_flush_pending = want;
+	if (want) {
+		if (journal_pending_flush.empty()) TIMER_AddTickHandler(journal_flush_tick);
+		journal_pending_flush.push_back(this);
+		return;
+	}
+	for (size_t i = 0; i < journal_pending_flush.size(); i++) {
+		if (journal_pending_flush[i] != this) continue;
+		journal_pending_flush.erase(journal_pending_flush.begin() + (ptrdiff_t)i);
+		break;
+	}
+	if (journal_pending_flush.empty()) TIMER_DelTickHandler(journal_flush_tick);
+}
+
+void Overlay_Drive::journal_flush(void) {
+	journal_last_flush = GetTicks();
+	if (journal_buffer.empty()) return;
+
+	FILE* f = fopen_wrap(journal_filename().c_str(), "ab");
+	bool ok = f != NULL && fwrite(journal_buffer.data(), 1, journal_buffer.size(), f) == journal_buffer.size() && fflush(f) == 0;
+#if defined(WIN32)
+	if (ok) ok = _commit(_fileno(f)) == 0;
+#else
+	if (ok) ok = fsync(fileno(f)) == 0;
+#endif
+	if (f != NULL) {
+		fclose(f);
+		journal_on_disk = true;
+	}
+	journal_buffer.clear();
+	journal_buffered = 0;
+
+	//Without a working journal the changes go straight to the markers instead.
+	if (!ok) {
+		LOG_MSG("Overlay: failed to write journal %s, writing changes directly", journal_filename().c_str());
+		journal_checkpoint();
+	}
+}
+
+void Overlay_Drive::journal_checkpoint(void) {
+	for (std::map<std::string,PendingMarker>::iterator it = pending_markers.begin(); it != pending_markers.end(); ++it) {
+		if (it->second.on_disk == it->second.wanted) continue;
+		if (it->second.wanted) add_special_file_to_disk(it->second.entry.c_str(), it->second.operation.c_str());
+		else remove_special_file_from_disk(it->second.entry.c_str(), it->second.operation.c_str());
+	}
+	pending_markers.clear();
+	journal_buffer.clear();
+	journal_buffered = 0;
+	journal_records = 0;
+	journal_last_flush = GetTicks();
+
+	//Only once all markers are on disk, so a crash in between replays the same changes again.
+	if (journal_on_disk) {
+		unlink(journal_filename().c_str());
+		journal_on_disk = false;
+	}
+}
+
+void Overlay_Drive::journal_replay(void) {
+	FILE* f = fopen_wrap(journal_filename().c_str(), "rb");
+	if (f == NULL) return;
+	journal_on_disk = true;
+
+	char line[CROSS_LEN + 8];
+	unsigned int replayed = 0;
+	while (fgets(line, sizeof(line), f)) {
+		size_t len = strlen(line);
+		if (len < 7 || line[len-1] != '\n' || (line[0] != '+' && line[0] != '-') || line[4] != ' ') break; //cut short by a crash
+		line[len-1] = 0;
+		const bool present = line[0] == '+';
+		const std::string operation(line + 1, 3);
+		const char* name = line + 5;
+		if (operation != "DEL" && operation != "RMD") break;
+
+		//The marker files read by update_cache may already include part of the journal, if a
+		//checkpoint was interrupted, so only the records that still change something are applied.
+		std::vector<std::string> &list = operation == "RMD" ? deleted_paths_in_base : deleted_files_in_base;
+		std::vector<std::string>::iterator it;
+		for (it = list.begin(); it != list.end(); ++it) {
+			if (!strcasecmp((*it).c_str(), name)) break;
+		}
+		if (present == (it != list.end())) continue;
+
+		if (present) {
+			list.emplace_back(name);
+			if (operation == "RMD") add_deleted_file(name, false);
+		} else {
+			list.erase(it);
+			if (operation == "RMD") remove_deleted_file(name, false);
+		}
+		note_marker(name, operation.c_str(), present);
+		replayed++;
+	}
+	fclose(f);
+
+	if (replayed) LOG_MSG("Overlay: applied %u changes from journal %s", replayed, journal_filename().c_str());
+	journal_checkpoint();
+}
 bool Overlay_Drive::check_if_leading_is_deleted(const char* name){
 	const char* dname = strrchr_dbcs((char *)name,'\\');
 	if (dname != NULL) {
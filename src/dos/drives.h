@@ -21,6 +21,9 @@
 #define _DRIVES_H__
 
 #include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
 #include <sys/types.h>
 #include "dos_system.h"
 #include "shell.h" /* for DOS_Shell */
@@ -97,10 +100,12 @@ public:
 	void closedir(void *handle) override;
 	bool read_directory_first(void *handle, char* entry_name, char* entry_sname, bool& is_directory) override;
 	bool read_directory_next(void *handle, char* entry_name, char* entry_sname, bool& is_directory) override;
+	int add_directory_watch(int fd, const char *dir, uint32_t mask) override;
 	virtual void remove_special_file_from_disk(const char* dosname, const char* operation);
 	virtual std::string create_filename_of_special_operation(const char* dosname, const char* operation, bool expand);
 	virtual bool add_special_file_to_disk(const char* dosname, const char* operation, uint16_t value, bool isdir);
 	void EmptyCache(void) override { dirCache.EmptyCache(); };
+	void WatchHostDirs(void) { dirCache.EnableHostWatch(); };
 	void MediaChange() override {};
 	const char* getBasedir() const {return basedir;};
 	struct {
@@ -395,6 +400,8 @@ public:
 	bool isRemote(void) override;
 	bool isRemovable(void) override;
 	Bits UnMount(void) override;
+	void EmptyCache(void) override;
+	void MediaChange(void) override;
 public:
 	struct clusterChainMemory {
 		uint32_t	current_cluster_no = 0;
@@ -405,6 +412,9 @@ public:
 public:
 	uint8_t readSector(uint32_t sectnum, void * data);
 	uint8_t writeSector(uint32_t sectnum, void * data);
+	uint8_t readSectors(uint32_t sectnum, uint32_t count, void * data);
+	void flushBlockCache(void);
+	unsigned int blockCacheDeferWrites = 0; /* nonzero while a file write is in progress, sector writes are held in the cache until flushBlockCache() */
 	uint32_t getAbsoluteSectFromBytePos(uint32_t startClustNum, uint32_t bytePos,clusterChainMemory *ccm=NULL);
 	uint32_t getSectorCount(void);
 	uint32_t getSectorSize(void);
@@ -495,6 +505,36 @@ private:
 	uint8_t fatSectBuffer[SECTOR_SIZE_MAX * 2] = {};
 	uint32_t curFatSect = 0;
 
+	/* LRU cache of logical sectors (FAT, directories and file data). The front of the list is the most recently used. */
+	struct blockCacheEntry {
+		uint32_t sectnum;
+		bool dirty;
+		std::vector<uint8_t> data;
+	};
+	std::list<blockCacheEntry> blockCache;
+	std::unordered_map<uint32_t,std::list<blockCacheEntry>::iterator> blockCacheMap;
+
+	/* decoded copy of the first FAT, indexed by cluster number. Empty if the volume is too large to keep in memory */
+	std::vector<uint32_t> fatTable;
+	bool fatTableLoaded = false;
+
+	/* one bit per cluster (bit 0 is cluster 2), set if the cluster is in use. Built from the FAT on first use
+	 * and kept current by setClusterValue(), so allocation and free space queries do not have to scan the FAT */
+	std::vector<uint64_t> clusterMap;
+	uint32_t freeClusterCount = 0;
+	bool clusterMapLoaded = false;
+
+	uint8_t readSectorUncached(uint32_t sectnum, void * data);
+	uint8_t readSectorsUncached(uint32_t sectnum, uint32_t count, void * data);
+	uint8_t writeSectorUncached(uint32_t sectnum, void * data);
+	uint8_t readBlock(uint32_t sectnum, void * data, bool fill);
+	uint8_t writeBlock(uint32_t sectnum, void * data);
+	std::list<blockCacheEntry>::iterator allocBlock(uint32_t sectnum);
+	void invalidateBlockCache(void);
+	void loadFatTable(void);
+	void loadClusterMap(void);
+	bool isFatSector(uint32_t sectnum);
+
 	DOS_Drive_Cache labelCache;
 public:
 	/* the driver code must use THESE functions to read the disk, not directly from the disk drive,
@@ -1187,6 +1227,7 @@ private:
 class Overlay_Drive: public localDrive {
 public:
 	Overlay_Drive(const char * startdir,const char* overlay, uint16_t _bytes_sector,uint8_t _sectors_cluster,uint16_t _total_clusters,uint16_t _free_clusters,uint8_t _mediaid,uint8_t &error, std::vector<std::string> &options);
+	~Overlay_Drive() override;
 
 	bool FileOpen(DOS_File * * file,const char * name,uint32_t flags) override;
 	bool FileCreate(DOS_File * * file,const char * name,uint16_t /*attributes*/) override;
@@ -1232,6 +1273,31 @@ private:
 
 	bool is_dir_only_in_overlay(const char* name); //cached
 
+	//Write-back mode (mount -o writeback): DEL and RMD markers are kept in memory and logged to an
+	//append-only journal in the overlay, and only created or removed on disk at a checkpoint.
+	struct PendingMarker {
+		std::string entry;
+		std::string operation;
+		bool on_disk;
+		bool wanted;
+	};
+	bool ovlwriteback = false;
+	bool journal_on_disk = false;
+	std::map<std::string,PendingMarker> pending_markers;
+	std::string journal_buffer;
+	unsigned int journal_buffered = 0;
+	unsigned int journal_records = 0;
+	uint32_t journal_last_flush = 0;
+	bool journal_flush_pending = false;
+	std::string journal_filename(void) const;
+	void note_marker(const std::string &entry, const char* operation, bool present);
+	void journal_marker(const std::string &entry, const char* operation, bool present);
+	void journal_flush(void);
+	void journal_schedule_flush(void);
+	static void journal_flush_tick(void);
+	void journal_checkpoint(void);
+	void journal_replay(void);
+
 
 	void remove_special_file_from_disk(const char* dosname, const char* operation) override;
 	bool add_special_file_to_disk(const char* dosname, const char* operation, uint16_t value = 0, bool isdir = false) override;
@@ -210,6 +210,7 @@ static void CheckX86ExtensionsSupport()
 extern void         GFX_SetTitle(int32_t cycles, int frameskip, Bits timing, bool paused);
 extern void         AddSaveStateMapper(), AddMessages(), JFONT_Init(), J3_SetType(std::string type, std::string back, std::string text);
 extern bool         force_nocachedir;
+extern bool         watch_host_dirs;
 extern bool         convertimg;
 extern bool         wpcolon;
 extern bool         lockmount;
@@ -1151,6 +1152,7 @@ void DOSBOX_RealInit() {
     allow_port_92_reset = section->Get_bool("allow port 92 reset");
 
     force_nocachedir = section->Get_bool("nocachedir");
+    watch_host_dirs = section->Get_bool("watchhostdirs");
     std::string freesizestr = section->Get_string("freesizecap");
     if (freesizestr == "fixed" || freesizestr == "false" || freesizestr == "0") freesizecap = 0;
     else if (freesizestr == "relative" || freesizestr == "2") freesizecap = 2;
@@ -1439,6 +1441,7 @@ void DOSBOX_SetupConfigSections(void) {
     const char* numopt[] = { "on", "off", "", nullptr };
     const char* freesizeopt[] = {"true", "false", "fixed", "relative", "cap", "2", "1", "0", nullptr };
     const char* truefalseautoopt[] = { "true", "false", "1", "0", "auto", nullptr };
+    const char* mapimageopts[] = { "true", "false", "1", "0", "sequential", "random", nullptr };
     const char* truefalsequietopts[] = { "true", "false", "1", "0", "quiet", nullptr };
     const char* pc98fmboards[] = { "auto", "off", "false", "board14", "board26k", "board86", "board86c", nullptr };
     const char* pc98videomodeopt[] = { "", "24khz", "31khz", "15khz", nullptr };
@@ -1723,6 +1726,20 @@ void DOSBOX_SetupConfigSections(void) {
     Pbool = secprop->Add_bool("compresssaveparts", Property::Changeable::WhenIdle,true);
     Pbool->Set_help("If set, DOSBox-X will compress components of saved states to save space.");
 
+    Pbool = secprop->Add_bool("save state in background", Property::Changeable::WhenIdle,true);
+    Pbool->Set_help("If set, saved states are compressed and written to disk on a separate thread while emulation continues.\n"
+                    "The state itself is still captured at the moment of saving. The compressed guest memory and video memory of the last save\n"
+                    "are kept in host memory, so that only the parts changed since are compressed again.");
+
+    Pint = secprop->Add_int("rewind interval", Property::Changeable::WhenIdle,0);
+    Pint->SetMinMax(0,3600);
+    Pint->Set_help("Number of frames between the states kept in memory for the \"Rewind state\" mapper action, which steps back through them.\n"
+                   "Set to 0 to disable rewinding.");
+
+    Pint = secprop->Add_int("rewind memory", Property::Changeable::WhenIdle,256);
+    Pint->SetMinMax(16,4096);
+    Pint->Set_help("Memory in MB for the states kept for rewinding, including the buffers used to capture them. The oldest states are dropped first; if a single state does not fit, nothing is kept.");
+
     Pbool = secprop->Add_bool("show recorded filename", Property::Changeable::WhenIdle,false);
     Pbool->Set_help("If set, DOSBox-X will show message boxes with recorded filenames when making audio or video captures.");
 
@@ -1730,6 +1747,11 @@ void DOSBOX_SetupConfigSections(void) {
     Pbool = secprop->Add_bool("skip encoding unchanged frames",Property::Changeable::WhenIdle,false);
     Pbool->Set_help("Unchanged frames will not be sent to the video codec as a possible performance and bandwidth optimization.");
 
+    Pint = secprop->Add_int("capture encoder queue",Property::Changeable::WhenIdle,8);
+    Pint->SetMinMax(0,64);
+    Pint->Set_help("Number of captured video frames that can wait for the video encoder, which runs on its own thread.\n"
+            "If the encoder falls behind, emulation waits for it. Set to 0 to encode frames on the emulation thread.");
+
     Pstring = secprop->Add_string("capture chroma format", Property::Changeable::OnlyAtStart,"auto");
     Pstring->Set_values(capturechromaformats);
     Pstring->Set_help("Chroma format to use when capturing to H.264. 'auto' picks the best quality option.\n"
@@ -1996,6 +2018,11 @@ void DOSBOX_SetupConfigSections(void) {
     Pbool->Set_help("If set, MOUNT commands will mount with -nocachedir (disable directory caching) by default.");
     Pbool->SetBasic(true);
 
+    Pbool = secprop->Add_bool("watchhostdirs",Property::Changeable::WhenIdle,false);
+    Pbool->Set_help("If set, local directories mounted with MOUNT keep their directory listings cached and are told about\n"
+                    "changes made on the host (Linux inotify), so only the changed directories are read again.\n"
+                    "Has no effect on other hosts, or on drives mounted with -nocachedir.");
+
     Pstring = secprop->Add_string("freesizecap",Property::Changeable::WhenIdle,"cap");
     Pstring->Set_values(freesizeopt);
     Pstring->Set_help("If set to \"cap\" (=\"true\"), the value of MOUNT -freesize will apply only if the actual free size is greater than the specified value.\n"
@@ -3350,7 +3377,8 @@ void DOSBOX_SetupConfigSections(void) {
     Pbool = secprop->Add_bool("sample accurate",Property::Changeable::OnlyAtStart,false);
     Pbool->Set_help("Enable sample accurate mixing, at the expense of some emulation performance. Enable this option for DOS games and demos\n"
             "that require such accuracy for correct Tandy/OPL output including digitized speech. This option can also help eliminate\n"
-            "minor errors in Gravis Ultrasound emulation that result in random echo/attenuation effects.");
+            "minor errors in Gravis Ultrasound emulation that result in random echo/attenuation effects.\n"
+            "Audio is rendered up to the exact emulated time whenever a sound device is accessed, not by a timer per sample.");
     Pbool->SetBasic(true);
 
     Pbool = secprop->Add_bool("swapstereo",Property::Changeable::OnlyAtStart,false);
@@ -3372,6 +3400,11 @@ void DOSBOX_SetupConfigSections(void) {
     Pint->Set_help("How many milliseconds of data to keep on top of the blocksize.");
     Pint->SetBasic(true);
 
+    Pbool = secprop->Add_bool("adaptive prebuffer",Property::Changeable::OnlyAtStart,false);
+    Pbool->Set_help("Adjust the amount of buffered audio at runtime. The buffer grows whenever the audio device runs out of data\n"
+        "and slowly shrinks back toward what the measured audio callback jitter requires, but never below blocksize and prebuffer.\n"
+        "Underrun, drop and jitter counters are shown in the title bar with showdetails=true and by the debugger MIXER command.");
+
     secprop=control->AddSection_prop("midi",&Null_Init,true);//done
 
     Pbool = secprop->Add_bool("roland gs sysex",Property::Changeable::OnlyAtStart,true);
@@ -3572,7 +3605,24 @@ void DOSBOX_SetupConfigSections(void) {
 	Pint->Set_help("Fluidsynth polyphony.");
 
 	Pstring = secprop->Add_string("fluid.cores",Property::Changeable::WhenIdle,"default");
-	Pstring->Set_help("Fluidsynth CPU cores to use, or default.");
+	Pstring->Set_help("Fluidsynth CPU cores to use, or default.\n"
+		"Values above 1 let Fluidsynth render voices in parallel on additional threads.");
+
+	Pbool = secprop->Add_bool("fluid.thread",Property::Changeable::WhenIdle,false);
+	Pbool->Set_help("Fluidsynth rendering in separate thread. Applies to mididevice=synth, which renders into the DOSBox-X mixer.");
+
+	Pint = secprop->Add_int("fluid.chunk",Property::Changeable::WhenIdle,16);
+	Pint->SetMinMax(2,100);
+	Pint->Set_help("Minimum milliseconds of data to render at once. (min 2, max 100)\n"
+		"Increasing this value reduces rendering overhead which may improve performance but also increases audio lag.\n"
+		"Valid for rendering in separate thread only.");
+
+	Pint = secprop->Add_int("fluid.prebuffer",Property::Changeable::WhenIdle,32);
+	Pint->SetMinMax(3,200);
+	Pint->Set_help("How many milliseconds of data to render ahead. (min 3, max 200)\n"
+		"Increasing this value may help to avoid underruns but also increases audio lag.\n"
+		"Cannot be set less than or equal to fluid.chunk value.\n"
+		"Valid for rendering in separate thread only.");
 
 	Pstring = secprop->Add_string("fluid.periods",Property::Changeable::WhenIdle,"default");
 	Pstring->Set_help("Fluidsynth periods, or default.");
@@ -3811,6 +3861,11 @@ void DOSBOX_SetupConfigSections(void) {
             "If stereo playback seems to have artifacts consider enabling this option. For accurate emulation of Sound Blaster\n"
             "hardware, disable this option.");
 
+    Pbool = secprop->Add_bool("dma streaming",Property::Changeable::WhenIdle,false);
+    Pbool->Set_help("Render auto-init 8/16-bit PCM playback in whole mixer blocks, reading across DSP block boundaries\n"
+            "in one pass and scheduling the block IRQ at the exact point the block ends. This reduces per-block overhead\n"
+            "for DOS games that use very small DMA buffers. Other DMA modes are not affected.");
+
     Pstring = secprop->Add_string("dsp require interrupt acknowledge",Property::Changeable::WhenIdle,"auto");
     Pstring->Set_help("If set, the DSP will halt DMA playback until IRQ acknowledgement occurs even in auto-init mode (SB16 behavior).\n"
             "If clear, IRQ acknowledgement will have no effect on auto-init playback (SB Pro and earlier & clone behavior)\n"
@@ -4511,6 +4566,26 @@ void DOSBOX_SetupConfigSections(void) {
                    "The disk I/O performance as in DOSBox SVN can be achieved by setting this to 0.");
     Pint->SetBasic(true);
 
+    Pstring = secprop->Add_string("map read-only images",Property::Changeable::WhenIdle,"false");
+    Pstring->Set_values(mapimageopts);
+    Pstring->Set_help("If set, disk images and CD-ROM image tracks (ISO/BIN) opened read-only are read through a memory mapping\n"
+                      "of the host file instead of buffered file reads. Instances using the same images then share them in the host page cache.\n"
+                      "Set to sequential or random to tell the host how the image will be accessed. Applies to images mounted afterwards.\n"
+                      "Disk images are only mapped on non-Windows hosts. Do not modify an image on the host while it is mapped.");
+
+    Pbool = secprop->Add_bool("map read-only images with huge pages",Property::Changeable::WhenIdle,false);
+    Pbool->Set_help("Ask the host to back memory mapped images with huge pages, if it supports them for the page cache.");
+
+    Pint = secprop->Add_int("chd decoder threads",Property::Changeable::WhenIdle,-1);
+    Pint->SetMinMax(-1,16);
+    Pint->Set_help("Number of host threads that decompress hunks of CHD CD-ROM images ahead of the emulated drive.\n"
+                   "Set to -1 (default) to use a reasonable number for this host, or 0 to decompress only on demand.");
+
+    Pint = secprop->Add_int("chd read-ahead hunks",Property::Changeable::WhenIdle,8);
+    Pint->SetMinMax(0,64);
+    Pint->Set_help("How many hunks of a CHD CD-ROM image past the one being read are decompressed in advance (0 disables read-ahead).\n"
+                   "Decompressed hunks are kept in a cache of twice this size. Applies to images mounted afterwards.");
+
     Pstring = secprop->Add_string("special operation file prefix",Property::Changeable::OnlyAtStart,".DB");
     Pstring->Set_help("The file prefix used by DOSBox-X's special operations on mounted local/overlay drives. It is fixed to \"DB\" in mainline DOSBox.");
 
@@ -5112,6 +5187,14 @@ void DOSBOX_SetupConfigSections(void) {
                 "In this way, you can have DOSBox-X emulate one of the strange quirks of 1995-1997 era\n"
                 "laptop hardware");
 
+        Pbool = secprop->Add_bool("async host io",Property::Changeable::WhenIdle,false);
+        if (i == 0) Pbool->Set_help(
+                "If set, the host read for an ATA or ATAPI read command is started in the background when the command\n"
+                "is issued, and overlaps the emulated busy time instead of stalling emulation. Helps with images on\n"
+                "slow storage such as network filesystems.\n"
+                "Only applies to raw disk images and CD images that are memory mapped (see \"map read-only images\"),\n"
+                "other images are always read synchronously.");
+
         Pint = secprop->Add_int("cd-rom spinup time",Property::Changeable::WhenIdle,0/*use IDE or CD-ROM default*/);
         if (i == 0) Pint->Set_help("Emulated CD-ROM time in ms to spin up if CD is stationary.\n"
                 "Set to 0 to use controller or CD-ROM drive-specific default.");
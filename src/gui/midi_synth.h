@@ -23,6 +23,9 @@
 #endif
 #include <math.h>
 #include <string.h>
+#include <deque>
+#include <vector>
+#include <SDL_thread.h>
 #include "control.h"
 
 /* Protect against multiple inclusions */
@@ -59,18 +62,210 @@ static void synth_log(int level,
 	}
 }
 
+/* A MIDI event waiting for the render thread, with the output frame to apply it at */
+struct SynthEvent {
+	uint64_t frame;
+	std::vector<uint8_t> data;
+};
+
+/* State for rendering in a separate thread (fluid.thread). This is the same scheme
+ * as mt32.thread: the thread renders ahead into a ring buffer of interleaved stereo
+ * samples at renderPos, the mixer callback plays from playPos. MIDI events are queued
+ * with the frame they are due at, one buffer length after the frame being played when
+ * they arrive, and the thread applies each one at that frame. */
+static struct {
+	SDL_Thread *thread;
+	SDL_mutex *lock;
+	SDL_cond *framesInBufferChanged;
+	int16_t *audioBuffer;
+	Bitu audioBufferSize;
+	Bitu framesPerAudioBuffer;
+	Bitu minimumRenderFrames;
+	volatile Bitu renderPos, playPos;
+	uint64_t playedFrames;		/* frames handed to the mixer channel */
+	uint64_t renderedFrames;	/* frames rendered, only used by the thread */
+	SDL_mutex *eventsLock;
+	std::deque<SynthEvent> *events;
+	volatile bool stopProcessing;
+	bool renderInThread;
+} synth_render = {};
+
+static void synth_Render(int16_t *buf,Bitu frames) {
+	fluid_synth_write_s16(synth_soft, (int)frames, buf, 0, 2, buf, 1, 2);
+	if (master_volume < 128) {
+		for (unsigned int i=0;i < (frames*2);i++) {
+			buf[i] = (int16_t)((buf[i] * master_volume) >> 7);
+		}
+	}
+}
+
+static void synth_PlayEvent(const uint8_t *msg, Bitu len) {
+	uint8_t event = msg[0], channel, p1, p2;
+
+	if (roland_gs_sysex) {
+		if (msg[1] == 0x41/*Roland*/ && msg[3] == 0x42/*GS*/ && msg[4] == 0x12/*Send*/ && len >= 9) {
+			const uint32_t addr =
+				((uint32_t)msg[5] << 16) +
+				((uint32_t)msg[6] <<  8) +
+				(uint32_t)msg[7];
+
+			if (addr == 0x400004) { /* MASTER VOLUME */
+				/* Fluidsynth doesn't appear to support this message, so we have to handle it ourself. */
+				master_volume = msg[8];
+				if (master_volume >= 127) master_volume = 128;
+				LOG_MSG("MIDI synth: MASTER VOLUME %u",master_volume);
+				return;
+			}
+		}
+	}
+
+	switch (event) {
+	case 0xf0:
+	case 0xf7:
+		LOG(LOG_MISC,LOG_DEBUG)("SYNTH: sysex 0x%02x len %lu", (int)event, (long unsigned)len);
+		fluid_synth_sysex(synth_soft, (char *)(msg + 1), (int)(len - 1), NULL, NULL, NULL, 0);
+		return;
+	case 0xf9:
+		LOG(LOG_MISC,LOG_DEBUG)("SYNTH: midi tick");
+		return;
+	case 0xff:
+		master_volume = 128;
+		LOG(LOG_MISC,LOG_DEBUG)("SYNTH: system reset");
+		fluid_synth_system_reset(synth_soft);
+		return;
+	case 0xf1: case 0xf2: case 0xf3: case 0xf4:
+	case 0xf5: case 0xf6: case 0xf8: case 0xfa:
+	case 0xfb: case 0xfc: case 0xfd: case 0xfe:
+		LOG(LOG_MISC,LOG_WARN)("SYNTH: unhandled event 0x%02x", (int)event);
+		return;
+	}
+
+	channel = event & 0xf;
+	p1 = len > 1 ? msg[1] : 0;
+	p2 = len > 2 ? msg[2] : 0;
+
+	LOG(LOG_MISC,LOG_DEBUG)("SYNTH: event 0x%02x channel %d, 0x%02x 0x%02x",
+		(int)event, (int)channel, (int)p1, (int)p2);
+
+	switch (event & 0xf0) {
+	case 0x80:
+		fluid_synth_noteoff(synth_soft, channel, p1);
+		break;
+	case 0x90:
+		fluid_synth_noteon(synth_soft, channel, p1, p2);
+		break;
+	case 0xb0:
+		fluid_synth_cc(synth_soft, channel, p1, p2);
+		break;
+	case 0xc0:
+		fluid_synth_program_change(synth_soft, channel, p1);
+		break;
+	case 0xd0:
+		fluid_synth_channel_pressure(synth_soft, channel, p1);
+		break;
+	case 0xe0:
+		fluid_synth_pitch_bend(synth_soft, channel, (p2 << 7) | p1);
+		break;
+	}
+}
+
+static void synth_QueueEvent(const uint8_t *msg, Bitu len) {
+	SynthEvent evt;
+	/* playedFrames counts up to the last mixer tick, add the position within the current millisecond */
+	evt.frame = synth_render.playedFrames + synth_render.framesPerAudioBuffer +
+		(uint64_t)(PIC_TickIndex() * synthsamplerate / 1000.0);
+	evt.data.assign(msg, msg + len);
+	SDL_LockMutex(synth_render.eventsLock);
+	synth_render.events->push_back(std::move(evt));
+	SDL_UnlockMutex(synth_render.eventsLock);
+}
+
+/* renders frames, applying each queued event at its frame; late events apply right away */
+static void synth_RenderEvents(int16_t *buf,Bitu frames) {
+	while (frames > 0) {
+		Bitu todo = frames;
+		SDL_LockMutex(synth_render.eventsLock);
+		while (!synth_render.events->empty()) {
+			const SynthEvent &evt = synth_render.events->front();
+			if (evt.frame > synth_render.renderedFrames) {
+				if (todo > evt.frame - synth_render.renderedFrames)
+					todo = (Bitu)(evt.frame - synth_render.renderedFrames);
+				break;
+			}
+			synth_PlayEvent(evt.data.data(), evt.data.size());
+			synth_render.events->pop_front();
+		}
+		SDL_UnlockMutex(synth_render.eventsLock);
+
+		synth_Render(buf, todo);
+		buf += todo * 2;
+		frames -= todo;
+		synth_render.renderedFrames += todo;
+	}
+}
+
 static void synth_CallBack(Bitu len) {
 	if (synth_soft != NULL) {
-		fluid_synth_write_s16(synth_soft, (int)len, MixTemp, 0, 2, MixTemp, 1, 2);
-		if (master_volume < 128) {
-			for (unsigned int i=0;i < (len*2);i++) {
-				((int16_t*)MixTemp)[i] = (int16_t)(((((int16_t*)MixTemp)[i]) * master_volume) >> 7);
+		if (synth_render.renderInThread) {
+			while (synth_render.renderPos == synth_render.playPos) {
+				SDL_LockMutex(synth_render.lock);
+				SDL_CondWait(synth_render.framesInBufferChanged, synth_render.lock);
+				SDL_UnlockMutex(synth_render.lock);
+				if (synth_render.stopProcessing) return;
+			}
+			const Bitu renderPosSnap = synth_render.renderPos;
+			Bitu playPosSnap = synth_render.playPos;
+			const Bitu samplesReady = (renderPosSnap < playPosSnap) ? synth_render.audioBufferSize - playPosSnap : renderPosSnap - playPosSnap;
+			if (len > (samplesReady >> 1)) len = samplesReady >> 1;
+			synthchan->AddSamples_s16(len, synth_render.audioBuffer + playPosSnap);
+			synth_render.playedFrames += len;
+			playPosSnap += (len << 1);
+			if (playPosSnap >= synth_render.audioBufferSize) playPosSnap -= synth_render.audioBufferSize;
+			synth_render.playPos = playPosSnap;
+			const Bitu renderPosNow = synth_render.renderPos;
+			const Bitu samplesFree = (renderPosNow < playPosSnap) ? playPosSnap - renderPosNow : synth_render.audioBufferSize + playPosSnap - renderPosNow;
+			if (synth_render.minimumRenderFrames <= (samplesFree >> 1)) {
+				SDL_LockMutex(synth_render.lock);
+				SDL_CondSignal(synth_render.framesInBufferChanged);
+				SDL_UnlockMutex(synth_render.lock);
 			}
 		}
-		synthchan->AddSamples_s16(len,(int16_t *)MixTemp);
+		else {
+			synth_Render((int16_t *)MixTemp, len);
+			synthchan->AddSamples_s16(len,(int16_t *)MixTemp);
+		}
 	}
 }
 
+static int synth_RenderingLoop(void *) {
+	while (!synth_render.stopProcessing) {
+		const Bitu renderPosSnap = synth_render.renderPos;
+		const Bitu playPosSnap = synth_render.playPos;
+		Bitu samplesToRender;
+		if (renderPosSnap < playPosSnap) {
+			samplesToRender = playPosSnap - renderPosSnap - 2;
+		} else {
+			samplesToRender = synth_render.audioBufferSize - renderPosSnap;
+			if (playPosSnap == 0) samplesToRender -= 2;
+		}
+		const Bitu framesToRender = samplesToRender >> 1;
+		if ((framesToRender == 0) || ((framesToRender < synth_render.minimumRenderFrames) && (renderPosSnap < playPosSnap))) {
+			SDL_LockMutex(synth_render.lock);
+			SDL_CondWait(synth_render.framesInBufferChanged, synth_render.lock);
+			SDL_UnlockMutex(synth_render.lock);
+		} else {
+			synth_RenderEvents(synth_render.audioBuffer + renderPosSnap, framesToRender);
+			synth_render.renderPos = (renderPosSnap + samplesToRender) % synth_render.audioBufferSize;
+			if (renderPosSnap == synth_render.playPos) {
+				SDL_LockMutex(synth_render.lock);
+				SDL_CondSignal(synth_render.framesInBufferChanged);
+				SDL_UnlockMutex(synth_render.lock);
+			}
+		}
+	}
+	return 0;
+}
+
 #if defined (WIN32) || defined (OS2)
 #	define PATH_SEP "\\"
 #else
@@ -86,73 +281,10 @@ private:
 	bool isOpen;
 
 	void PlayEvent(uint8_t *msg, Bitu len) {
-		uint8_t event = msg[0], channel, p1, p2;
-
-		if (roland_gs_sysex) {
-			if (msg[1] == 0x41/*Roland*/ && msg[3] == 0x42/*GS*/ && msg[4] == 0x12/*Send*/ && len >= 9) {
-				const uint32_t addr =
-					((uint32_t)msg[5] << 16) +
-					((uint32_t)msg[6] <<  8) +
-					(uint32_t)msg[7];
-
-				if (addr == 0x400004) { /* MASTER VOLUME */
-					/* Fluidsynth doesn't appear to support this message, so we have to handle it ourself. */
-					master_volume = msg[8];
-					if (master_volume >= 127) master_volume = 128;
-					LOG_MSG("MIDI synth: MASTER VOLUME %u",master_volume);
-					return;
-				}
-			}
-		}
-
-		switch (event) {
-		case 0xf0:
-		case 0xf7:
-			LOG(LOG_MISC,LOG_DEBUG)("SYNTH: sysex 0x%02x len %lu", (int)event, (long unsigned)len);
-			fluid_synth_sysex(synth_soft, (char *)(msg + 1), (int)(len - 1), NULL, NULL, NULL, 0);
-			return;
-		case 0xf9:
-			LOG(LOG_MISC,LOG_DEBUG)("SYNTH: midi tick");
-			return;
-		case 0xff:
-			master_volume = 128;
-			LOG(LOG_MISC,LOG_DEBUG)("SYNTH: system reset");
-			fluid_synth_system_reset(synth_soft);
-			return;
-		case 0xf1: case 0xf2: case 0xf3: case 0xf4:
-		case 0xf5: case 0xf6: case 0xf8: case 0xfa:
-		case 0xfb: case 0xfc: case 0xfd: case 0xfe:
-			LOG(LOG_MISC,LOG_WARN)("SYNTH: unhandled event 0x%02x", (int)event);
-			return;
-		}
-
-		channel = event & 0xf;
-		p1 = len > 1 ? msg[1] : 0;
-		p2 = len > 2 ? msg[2] : 0;
-
-		LOG(LOG_MISC,LOG_DEBUG)("SYNTH: event 0x%02x channel %d, 0x%02x 0x%02x",
-			(int)event, (int)channel, (int)p1, (int)p2);
-
-		switch (event & 0xf0) {
-		case 0x80:
-			fluid_synth_noteoff(synth_soft, channel, p1);
-			break;
-		case 0x90:
-			fluid_synth_noteon(synth_soft, channel, p1, p2);
-			break;
-		case 0xb0:
-			fluid_synth_cc(synth_soft, channel, p1, p2);
-			break;
-		case 0xc0:
-			fluid_synth_program_change(synth_soft, channel, p1);
-			break;
-		case 0xd0:
-			fluid_synth_channel_pressure(synth_soft, channel, p1);
-			break;
-		case 0xe0:
-			fluid_synth_pitch_bend(synth_soft, channel, (p2 << 7) | p1);
-			break;
-		}
+		if (synth_render.renderInThread)
+			synth_QueueEvent(msg, len);
+		else
+			synth_PlayEvent(msg, len);
 	};
 
 public:
@@ -223,6 +355,14 @@ public:
 		fluid_settings_setnum(settings, "synth.sample-rate", (double)synthsamplerate);
 		//fluid_settings_setnum(settings, "synth.gain", 0.5);
 
+		Section_prop *section = static_cast<Section_prop *>(control->GetSection("midi"));
+		fluid_settings_setint(settings, "synth.polyphony", section->Get_int("fluid.polyphony"));
+		/* cpu-cores > 1 makes FluidSynth render voices in parallel on its own worker threads */
+		if (strcmp(section->Get_string("fluid.cores"), "default") != 0)
+			fluid_settings_setint(settings, "synth.cpu-cores", atoi(section->Get_string("fluid.cores")));
+		/* with fluid.thread, MIDI events are applied by the render thread, so the synth is only used from one thread at a time */
+		synth_render.renderInThread = section->Get_bool("fluid.thread");
+
 		/* Create the synthesizer. */
 		synth_soft = new_fluid_synth(settings);
 		if (synth_soft == NULL) {
@@ -251,6 +391,36 @@ public:
 		master_volume = 128;
 		synthchan = MIXER_AddChannel(synth_CallBack, (unsigned int)synthsamplerate, "SYNTH");
 		synthchan->Enable(false);
+
+		if (synth_render.renderInThread) {
+			const int chunkSize = section->Get_int("fluid.chunk");
+			int latency = section->Get_int("fluid.prebuffer");
+			if (latency <= chunkSize) {
+				latency = 2 * chunkSize;
+				LOG_MSG("SYNTH: chunk length must be less than prebuffer length, prebuffer length reset to %i ms.", latency);
+			}
+			const Bitu framesPerAudioBuffer = ((Bitu)latency * (Bitu)synthsamplerate) / 1000u;
+			synth_render.framesPerAudioBuffer = framesPerAudioBuffer;
+			synth_render.minimumRenderFrames = ((Bitu)chunkSize * (Bitu)synthsamplerate) / 1000u;
+			synth_render.audioBufferSize = framesPerAudioBuffer << 1;
+			synth_render.audioBuffer = new int16_t[synth_render.audioBufferSize];
+			synth_Render(synth_render.audioBuffer, framesPerAudioBuffer - 1);
+			synth_render.renderPos = (framesPerAudioBuffer - 1) << 1;
+			synth_render.playPos = 0;
+			synth_render.renderedFrames = framesPerAudioBuffer - 1;
+			synth_render.playedFrames = 0;
+			synth_render.eventsLock = SDL_CreateMutex();
+			synth_render.events = new std::deque<SynthEvent>();
+			synth_render.stopProcessing = false;
+			synth_render.lock = SDL_CreateMutex();
+			synth_render.framesInBufferChanged = SDL_CreateCond();
+#if defined(C_SDL2)
+			synth_render.thread = SDL_CreateThread(synth_RenderingLoop, "SYNTH", NULL);
+#else
+			synth_render.thread = SDL_CreateThread(synth_RenderingLoop, NULL);
+#endif
+		}
+
 		isOpen = true;
 		return true;
 	};
@@ -259,6 +429,25 @@ public:
 		if (!isOpen) return;
 
 		synthchan->Enable(false);
+		if (synth_render.renderInThread) {
+			synth_render.stopProcessing = true;
+			SDL_LockMutex(synth_render.lock);
+			SDL_CondSignal(synth_render.framesInBufferChanged);
+			SDL_UnlockMutex(synth_render.lock);
+			SDL_WaitThread(synth_render.thread, NULL);
+			synth_render.thread = NULL;
+			SDL_DestroyMutex(synth_render.lock);
+			synth_render.lock = NULL;
+			SDL_DestroyCond(synth_render.framesInBufferChanged);
+			synth_render.framesInBufferChanged = NULL;
+			delete[] synth_render.audioBuffer;
+			synth_render.audioBuffer = NULL;
+			SDL_DestroyMutex(synth_render.eventsLock);
+			synth_render.eventsLock = NULL;
+			delete synth_render.events;
+			synth_render.events = NULL;
+			synth_render.renderInThread = false;
+		}
 		MIXER_DelChannel(synthchan);
 		delete_fluid_synth(synth_soft);
 		delete_fluid_settings(settings);
@@ -402,7 +591,7 @@ public:
 		fluid_settings_setnum(settings, "synth.gain", atof(section->Get_string("fluid.gain")));
 		fluid_settings_setint(settings, "synth.polyphony", section->Get_int("fluid.polyphony"));
 		if (strcmp(section->Get_string("fluid.cores"), "default") != 0) {
-			fluid_settings_setnum(settings, "synth.cpu-cores", atof(section->Get_string("fluid.cores")));
+			fluid_settings_setint(settings, "synth.cpu-cores", atoi(section->Get_string("fluid.cores")));
 		}
 		
 		std::string period=section->Get_string("fluid.periods"), periodsize=section->Get_string("fluid.periodsize");
@@ -305,6 +305,7 @@ static void RENDER_FinishLineHandler(const void * s) {
         }
     }
     render.scale.cacheRead += render.scale.cachePitch;
+    if (s) RENDER_SourceLineChanged();
 }
 
 
@@ -321,6 +322,9 @@ static void RENDER_ClearCacheHandler(const void * src) {
 
 extern void GFX_SetTitle(int32_t cycles, int frameskip, Bits timing, bool paused);
 
+/* Scaler_ChangedSourceLines was cleared when this frame started, so video capture can use it */
+static bool render_changed_lines_valid = false;
+
 bool RENDER_StartUpdate(void) {
     if (GCC_UNLIKELY(render.updating))
         return false;
@@ -341,6 +345,9 @@ bool RENDER_StartUpdate(void) {
     render.scale.outPitch = 0;
     Scaler_ChangedLines[0] = 0;
     Scaler_ChangedLineIndex = 0;
+    render_changed_lines_valid = (CaptureState & CAPTURE_VIDEO) != 0;
+    if (render_changed_lines_valid)
+        memset(Scaler_ChangedSourceLines, 0, sizeof(Scaler_ChangedSourceLines));
     if (GCC_UNLIKELY( render.scale.clearCache) ) {
 //      LOG_MSG("Clearing cache");
         //Will always have to update the screen with this one anyway, so let's update already
@@ -417,7 +424,8 @@ void RENDER_EndUpdate( bool abort ) {
             flags |= CAPTURE_FLAG_NOCHANGE;
 
         CAPTURE_AddImage( render.src.width, render.src.height, render.src.bpp, pitch,
-            flags, fps, (uint8_t *)&scalerSourceCache, (uint8_t*)&render.pal.rgb );
+            flags, fps, (uint8_t *)&scalerSourceCache, (uint8_t*)&render.pal.rgb,
+            render_changed_lines_valid ? Scaler_ChangedSourceLines : NULL );
     }
     if ( render.scale.outWrite ) {
         GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
@@ -27,6 +27,7 @@
 
 uint8_t Scaler_Aspect[SCALER_MAXHEIGHT];
 uint16_t Scaler_ChangedLines[SCALER_MAXHEIGHT];
+uint8_t Scaler_ChangedSourceLines[SCALER_MAXHEIGHT];	/* per source line, for video capture */
 Bitu Scaler_ChangedLineIndex;
 
 static union {
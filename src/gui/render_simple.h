@@ -178,6 +178,7 @@ static inline void conc4d_func(const void *s) {
 			render.src.width * SCALERWIDTH * PSIZE);
 	}
 #endif
+	if (hadChange) RENDER_SourceLineChanged();
 	ScalerAddLines( hadChange, scaleLines );
 }
 
@@ -258,6 +258,7 @@ static inline void conc3d(Cache,SBPP,DBPP) (const void * s) {
 		src += SCALER_BLOCKSIZE;
 	}
 	if (hadChange) {
+		RENDER_SourceLineChanged();
 		CC[render.scale.inLine+0][0] = 1;
 		CC[render.scale.inLine+1][0] = 1;
 		CC[render.scale.inLine+2][0] = 1;
@@ -131,6 +131,7 @@ bool kana_input = false; // true if a half-width kana was typed
 #include "inout.h"
 #include "jfont.h"
 #include "render.h"
+#include "mixer.h"
 #include "../dos/cdrom.h"
 #include "../dos/drives.h"
 #include "../ints/int10.h"
@@ -1058,6 +1059,11 @@ void GFX_SetTitle(int32_t cycles, int frameskip, Bits timing, bool paused) {
         char *p = title + strlen(title); // append to end of string
 
         sprintf(p,", %2d%%/RT",(int)floor((rtdelta / 10) + 0.5));
+
+        MixerStats st;
+        MIXER_GetStats(st);
+        p = title + strlen(title); // append to end of string
+        sprintf(p,", audio %ums U%llu D%llu",st.queue_ms,st.underruns,st.dropped_samples);
     }
 
     if (titlebar != NULL && *titlebar != 0) {
@@ -194,6 +194,7 @@ static void disney_write(Bitu port,Bitu val,Bitu iolen) {
     (void)iolen;//UNUSED
 	//LOG_MSG("write disney time %f addr%x val %x",PIC_FullIndex(),port,val);
 	disney.last_used=PIC_Ticks;
+	if (Mixer_SampleAccurate() && disney.chan) disney.chan->FillUp();
 	switch (port-DISNEY_BASE) {
 	case 0:		/* Data Port */
 	{
@@ -27,6 +27,7 @@
 #include "paging.h"
 #include "setup.h"
 #include "control.h"
+#include "mixer.h"
 
 #ifdef _MSC_VER
 # define MIN(a,b) ((a) < (b) ? (a) : (b))
@@ -114,6 +115,12 @@ template <const unsigned int dma_mode> static void DMA_BlockRead4KB(const PhysPt
     PhysPt xfer;
 
     DMA_BlockReadCommonSetup<dma_mode>(/*&*/xfer,/*&*/o_size,spage,offset,size,dma16,DMA16_ADDRMASK);
+    /* fast path: incrementing transfer entirely within system RAM is one span copy.
+     * phys_readw/host_writew are both little endian so this is valid for 16-bit DMA too. */
+    if (dma_mode == DMA_INCREMENT && (size_t)xfer + o_size <= MemSize) {
+        memcpy(write,MemBase+xfer,o_size);
+        return;
+    }
     if (!dma16) { // 8-bit
         for ( ; o_size ; o_size--, (dma_mode == DMA_DECREMENT ? (xfer--) : (xfer++)) ) *write++ = phys_readb(xfer);
     }
@@ -132,6 +139,11 @@ template <const unsigned int dma_mode> static void DMA_BlockWrite4KB(PhysPt spag
     PhysPt xfer;
 
     DMA_BlockReadCommonSetup<dma_mode>(/*&*/xfer,/*&*/o_size,spage,offset,size,dma16,DMA16_ADDRMASK);
+    /* fast path, see DMA_BlockRead4KB */
+    if (dma_mode == DMA_INCREMENT && (size_t)xfer + o_size <= MemSize) {
+        memcpy(MemBase+xfer,read,o_size);
+        return;
+    }
     if (!dma16) { // 8-bit
         for ( ; o_size ; o_size--, (dma_mode == DMA_DECREMENT ? (xfer--) : (xfer++)) ) phys_writeb(xfer,*read++);
     }
@@ -364,6 +376,9 @@ void DmaController::WriteControllerReg(Bitu reg,Bitu val,Bitu /*len*/) {
 
 Bitu DmaController::ReadControllerReg(Bitu reg,Bitu /*len*/) {
 	DmaChannel * chan;Bitu ret;
+	/* sound devices that transfer DMA while rendering audio must catch up before the
+	 * address, count or status is read back */
+	if (reg <= 0x8) Mixer_SampleAccurateFillUp();
 	switch (reg) {
 	/* read base address of DMA transfer (1st byte low part, 2nd byte high part) */
 	case 0x0:case 0x2:case 0x4:case 0x6:
@@ -432,7 +447,10 @@ DmaChannel::DmaChannel(uint8_t num, bool dma16) {
 	request = false;
 }
 
-Bitu DmaChannel::Read(Bitu want, uint8_t * buffer) {
+/* Common DMA read (memory to device) loop. BlockOp is handed each piece of the transfer
+ * that does not cross a 4KB boundary and returns false to stop the transfer before that
+ * piece, in which case the channel state is left exactly where the piece would start. */
+template <class BlockOp> Bitu DmaChannel::ReadBlocks(Bitu want, BlockOp &op) {
 	Bitu done=0;
 	curraddr &= dma_wrapping;
 
@@ -477,17 +495,16 @@ Bitu DmaChannel::Read(Bitu want, uint8_t * buffer) {
 
         if (increment) {
             assert((curraddr & (~addrmask)) == ((curraddr + ((uint32_t)cando - 1u)) & (~addrmask)));//check our work, must not cross a 4KB boundary
-            DMA_BlockRead4KB<DMA_INCREMENT>(pagebase,curraddr,buffer,cando,DMA16,DMA16_ADDRMASK);
+            if (!op(*this,cando)) break;
             curraddr += (uint32_t)cando;
         }
         else {
             assert((curraddr & (~addrmask)) == ((curraddr - ((uint32_t)cando - 1u)) & (~addrmask)));//check our work, must not cross a 4KB boundary
-            DMA_BlockRead4KB<DMA_DECREMENT>(pagebase,curraddr,buffer,cando,DMA16,DMA16_ADDRMASK);
+            if (!op(*this,cando)) break;
             curraddr -= (uint32_t)cando;
         }
 
         curraddr &= dma_wrapping;
-        buffer += cando << DMA16;
         currcnt -= (uint16_t)cando;
         want -= cando;
         done += cando;
@@ -548,6 +565,62 @@ Bitu DmaChannel::Read(Bitu want, uint8_t * buffer) {
 	return done;
 }
 
+/* copy each piece into the caller's buffer */
+struct DmaReadCopyOp {
+    uint8_t *buffer;
+
+    bool operator()(DmaChannel &ch,const Bitu cando) {
+        if (ch.increment)
+            DMA_BlockRead4KB<DMA_INCREMENT>(ch.pagebase,ch.curraddr,buffer,cando,ch.DMA16,ch.DMA16_ADDRMASK);
+        else
+            DMA_BlockRead4KB<DMA_DECREMENT>(ch.pagebase,ch.curraddr,buffer,cando,ch.DMA16,ch.DMA16_ADDRMASK);
+
+        buffer += cando << ch.DMA16;
+        return true;
+    }
+};
+
+/* map each piece to a host pointer into guest RAM, merging pieces that are contiguous in host memory */
+struct DmaReadSpanOp {
+    DmaSpan *spans;
+    unsigned int max_spans;
+    unsigned int count;
+
+    bool operator()(DmaChannel &ch,const Bitu cando) {
+        if (!ch.increment) return false; /* decrement mode data would have to be read backwards */
+
+        unsigned int o_size;
+        PhysPt xfer;
+
+        DMA_BlockReadCommonSetup<DMA_INCREMENT>(/*&*/xfer,/*&*/o_size,ch.pagebase,ch.curraddr,cando,ch.DMA16,ch.DMA16_ADDRMASK);
+        if ((size_t)xfer + o_size > MemSize) return false; /* not system RAM */
+
+        const uint8_t *p = MemBase + xfer;
+        if (count != 0 && (spans[count-1].ptr + (spans[count-1].units << ch.DMA16)) == p) {
+            spans[count-1].units += cando;
+            return true;
+        }
+        if (count >= max_spans) return false;
+
+        spans[count].ptr = p;
+        spans[count].units = cando;
+        count++;
+        return true;
+    }
+};
+
+Bitu DmaChannel::Read(Bitu want, uint8_t * buffer) {
+    DmaReadCopyOp op = { buffer };
+    return ReadBlocks(want,op);
+}
+
+Bitu DmaChannel::ReadSpans(Bitu want, DmaSpan * spans, unsigned int max_spans, unsigned int &nspans) {
+    DmaReadSpanOp op = { spans, max_spans, 0 };
+    const Bitu done = (max_spans != 0) ? ReadBlocks(want,op) : 0;
+    nspans = op.count;
+    return done;
+}
+
 Bitu DmaChannel::Write(Bitu want, uint8_t * buffer) {
 	Bitu done=0;
 	curraddr &= dma_wrapping;
@@ -766,16 +766,33 @@ void FloppyController::on_fdc_in_command() {
 						break;
 					}
 
-					/* DMA transfer */
+					/* DMA transfer. If the sector is one contiguous run of guest RAM, write it to the image
+					 * from there directly, otherwise gather it into the sector buffer. */
 					dma->Register_Callback(nullptr);
-					if (dma->Read(sector_size_bytes,sector) != sector_size_bytes) {
+					const uint8_t *src = sector;
+					DmaSpan spans[2];
+					unsigned int nspans = 0;
+					Bitu got = dma->ReadSpans(sector_size_bytes,spans,2,nspans);
+					if (nspans == 1 && got == sector_size_bytes) {
+						src = spans[0].ptr;
+					}
+					else {
+						Bitu ofs = 0;
+						for (unsigned int s=0;s < nspans;s++) {
+							memcpy(sector+ofs,spans[s].ptr,spans[s].units);
+							ofs += spans[s].units;
+						}
+						if (got < sector_size_bytes && !dma->masked)
+							got += dma->Read(sector_size_bytes-got,sector+got);
+					}
+					if (got != sector_size_bytes) {
                         LOG(LOG_MISC,LOG_DEBUG)("FDC: DMA read failed");
                         fail = true;
                         break;
                     }
 
 					/* write sector */
-					uint8_t err = image->Write_Sector(in_cmd[3]/*head*/,in_cmd[2]/*cylinder*/,in_cmd[4]/*sector*/,sector,sector_size_bytes);
+					uint8_t err = image->Write_Sector(in_cmd[3]/*head*/,in_cmd[2]/*cylinder*/,in_cmd[4]/*sector*/,src,sector_size_bytes);
 					if (err != 0x00) {
 						fail = true;
 						break;
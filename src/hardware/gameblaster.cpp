@@ -41,6 +41,7 @@ static saa1099_device* device[2];
 
 static void write_cms(Bitu port, Bitu val, Bitu /* iolen */) {
 	if(cms_chan && (!cms_chan->enabled)) cms_chan->Enable(true);
+	if(cms_chan && Mixer_SampleAccurate()) cms_chan->FillUp();
 	lastWriteTicks = (uint32_t)PIC_Ticks;
 	switch ( port - cmsBase ) {
 	case 1:
@@ -96,6 +96,8 @@ static IO_Callout_t gus_iocallout2 = IO_Callout_t_none;
 
 class GUSChannels;
 static void CheckVoiceIrq(void);
+static void GUS_ScheduleVoiceIRQ(void);
+static void GUS_VoiceIRQEvent(Bitu val);
 
 struct GFGus {
 	uint8_t gRegSelectData;		// what is read back from 3X3. not necessarily the index selected, but
@@ -308,6 +310,30 @@ class GUSChannels {
 			if (myGUS.RampIRQ & irqmask) ret|=0x80;
 			return ret;
 		}
+		/* samples until WaveUpdate() or RampUpdate() raise this voice's IRQ, or ~0u if neither will.
+		 * Wrapping at the end of GUS memory and volume clamping are not accounted for. */
+		uint32_t SamplesUntilIRQ(void) const {
+			uint32_t ret = ~0u;
+			if ((WaveCtrl & (WCTRL_STOP | WCTRL_STOPPED)) == 0 && (WaveCtrl & WCTRL_IRQENABLED) &&
+				WaveAdd != 0 && !(myGUS.WaveIRQ & irqmask)) {
+				uint32_t dist;
+				if (WaveCtrl & WCTRL_DECREASING)
+					dist = (WaveAddr > WaveStart) ? (WaveAddr - WaveStart) : 0;
+				else
+					dist = (WaveEnd > WaveAddr) ? (WaveEnd - WaveAddr) : 0;
+				ret = dist / WaveAdd + 1u;
+			}
+			if ((RampCtrl & 0x3) == 0 && (RampCtrl & 0x20) && RampAdd != 0 && !(myGUS.RampIRQ & irqmask)) {
+				uint32_t dist;
+				if (RampCtrl & 0x40)
+					dist = (RampVol > RampStart) ? (RampVol - RampStart) : 0;
+				else
+					dist = (RampEnd > RampVol) ? (RampEnd - RampVol) : 0;
+				const uint32_t samples = (dist + RampAdd - 1u) / RampAdd;
+				if (ret > samples) ret = (samples != 0) ? samples : 1u;
+			}
+			return ret;
+		}
 		void WriteRampRate(uint8_t val) {
 			RampRate = val;
 			if (myGUS.fixed_sample_rate_output) {
@@ -669,6 +695,7 @@ static void GUSReset(void) {
 		myGUS.timers[1].running = false;
 
 		PIC_RemoveEvents(GUS_TimerEvent);
+		PIC_RemoveEvents(GUS_VoiceIRQEvent);
 
 		myGUS.ChangeIRQDMA = false;
 		myGUS.DMAControl = 0x00;
@@ -791,6 +818,12 @@ static void CheckVoiceIrq(void) {
 	}
 }
 
+/* "sample accurate" mode: voice positions and voice IRQs only advance as GUS audio is rendered,
+ * so render up to the current time before the guest reads them */
+static INLINE void GUS_SampleAccurateFillUp(void) {
+	if (gus_chan != NULL && Mixer_SampleAccurate()) gus_chan->FillUp();
+}
+
 static uint16_t ExecuteReadRegister(void) {
 	uint8_t tmpreg,effective = myGUS.gRegSelect;
 
@@ -820,6 +853,9 @@ static uint16_t ExecuteReadRegister(void) {
 
 //	LOG_MSG("Read global reg %x",myGUS.gRegSelect,effective);
 
+	if (effective >= 0x80 && effective <= 0x8F)
+		GUS_SampleAccurateFillUp();
+
 	switch (effective) {
 		case 0x8E:  // read active channel register
 			// NTS: The GUS SDK documents the active channel count as bits 5-0, which is wrong. it's bits 4-0. bits 7-5 are always 1 on real hardware.
@@ -1499,6 +1535,8 @@ static Bitu read_gus(Bitu port,Bitu iolen) {
 
 	switch(port - GUS_BASE) {
 	case 0x206:
+		GUS_SampleAccurateFillUp();
+
 		if (myGUS.clearTCIfPollingIRQStatus) {
 			double t = PIC_FullIndex();
 
@@ -1800,6 +1838,7 @@ static void write_gus(Bitu port,Bitu val,Bitu iolen) {
 
 			myGUS.gRegData=(uint16_t)val;
 			ExecuteGlobRegister();
+			GUS_ScheduleVoiceIRQ();
 		} else {
 			if (gus_type < GUS_INTERWAVE) // Versions prior to the Interwave will reflect last I/O to 3X2-3X5 when read back from 3X3
 				myGUS.gRegSelectData = val;
@@ -1813,6 +1852,7 @@ static void write_gus(Bitu port,Bitu val,Bitu iolen) {
 
 		myGUS.gRegData = (uint16_t)((0x00ff & myGUS.gRegData) | val << 8);
 		ExecuteGlobRegister();
+		GUS_ScheduleVoiceIRQ();
 		break;
 	case 0x307:
 		if (warn_out_of_bounds_dram_access && myGUS.gDramAddr >= myGUS.memsize)
@@ -2089,6 +2129,29 @@ static void GUS_DMA_Callback(DmaChannel * chan,DMAEvent event) {
 	}
 }
 
+/* "sample accurate" mode: render GUS audio when the next voice IRQ is due, so that the IRQ is raised
+ * then and not at the next 1ms mixer tick. GUS_CallBack() schedules the one after. */
+static void GUS_VoiceIRQEvent(Bitu /*val*/) {
+	if (gus_chan != NULL) gus_chan->FillUp();
+}
+
+static void GUS_ScheduleVoiceIRQ(void) {
+	if (gus_chan == NULL || !Mixer_SampleAccurate()) return;
+
+	PIC_RemoveEvents(GUS_VoiceIRQEvent);
+	if ((GUS_reset_reg & 0x01/*!master reset*/) == 0 || !myGUS.irqenabled) return;
+
+	uint32_t samples = ~0u;
+	for (Bitu i = 0; i < myGUS.ActiveChannels; i++) {
+		const uint32_t s = guschan[i]->SamplesUntilIRQ();
+		if (samples > s) samples = s;
+	}
+	if (samples == ~0u) return;
+
+	const double rate = myGUS.fixed_sample_rate_output ? (double)GUS_RATE : (double)myGUS.basefreq;
+	if (rate > 0) PIC_AddEvent(GUS_VoiceIRQEvent,(pic_tickindex_t)(((double)samples * 1000.0) / rate));
+}
+
 static void GUS_CallBack(Bitu len) {
     int32_t buffer[MIXER_BUFSIZE][2];
     memset(buffer, 0, len * sizeof(buffer[0]));
@@ -2166,6 +2229,7 @@ static void GUS_CallBack(Bitu len) {
 
     gus_chan->AddSamples_s32(len, buffer[0]);
     CheckVoiceIrq();
+    GUS_ScheduleVoiceIRQ();
 }
 
 // Generate logarithmic to linear volume conversion tables
@@ -2591,6 +2655,8 @@ public:
 	}
 
 	~GUS() {
+        PIC_RemoveEvents(GUS_VoiceIRQEvent);
+
         if (gus_iocallout != IO_Callout_t_none) {
             IO_FreeCallout(gus_iocallout);
             gus_iocallout = IO_Callout_t_none;
@@ -2662,6 +2728,7 @@ void GUS_Init() {
 
 // save state support
 void *GUS_TimerEvent_PIC_Event = (void*)((uintptr_t)GUS_TimerEvent);
+void *GUS_VoiceIRQEvent_PIC_Event = (void*)((uintptr_t)GUS_VoiceIRQEvent);
 void *GUS_DMA_Callback_Func = (void*)((uintptr_t)GUS_DMA_Callback);
 
 
@@ -36,6 +36,7 @@
 #include "mixer.h"
 #include "render.h"
 #include "cross.h"
+#include "timer.h"
 #include "wave_mmreg.h"
 
 #if (C_SSHOT) || (C_AVCODEC)
@@ -49,6 +50,21 @@
 #include "rawint.h"
 
 #include <map>
+#include <vector>
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# if (C_SSHOT)
+#  define CAPTURE_ASYNC_ENCODER 1
+# endif
+# if !defined(C_EMSCRIPTEN)
+#  define CAPTURE_ASYNC_AUDIO 1
+# endif
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <deque>
+# include <memory>
+#endif
 
 #if (C_AVCODEC)
 extern "C" {
@@ -69,6 +85,7 @@ extern "C" {
 
 bool video_debug_overlay = false;
 bool skip_encoding_unchanged_frames = false, show_recorded_filename = true;
+unsigned int capture_encoder_queue = 8;
 std::string pathvid = "", pathwav = "", pathmtw = "", pathmid = "", pathopl = "", pathscr = "", pathprt = "", pathpcap = "";
 bool systemmessagebox(char const * aTitle, char const * aMessage, char const * aDialogType, char const * aIconType, int aDefaultButton);
 
@@ -343,7 +360,7 @@ extern unsigned int hostkeyalt, sendkeymap;
 extern const char* RunningProgram;
 Bitu CaptureState = 0;
 
-void OPL_SaveRawEvent(bool pressed), SetGameState_Run(int value), ResolvePath(std::string& in);
+void OPL_SaveRawEvent(bool pressed), SetGameState_Run(int value), REWIND_SetConfig(Section_prop *section), ResolvePath(std::string& in);
 
 #define WAVE_BUF 16*1024
 #define MIDI_BUF 4*1024
@@ -351,8 +368,7 @@ void OPL_SaveRawEvent(bool pressed), SetGameState_Run(int value), ResolvePath(st
 static struct {
 	struct {
 		riff_wav_writer *writer;
-		int16_t buf[WAVE_BUF][2];
-		Bitu used;
+		std::vector<int16_t> buf;
 		uint32_t length;
 		uint32_t freq;
     } wave = {};
@@ -360,6 +376,7 @@ static struct {
         avi_writer  *writer;
 		Bitu		audiorate;
         std::map<std::string,size_t> name_to_stream_index;
+        std::vector< std::vector<int16_t> > pending;	/* per AVI stream, not yet written */
     } multitrack_wave = {};
 	struct {
 		FILE * handle;
@@ -649,6 +666,139 @@ static void CAPTURE_AddAviChunk(const char * tag, uint32_t size, void * data, ui
 		}
 	}
 }
+
+/* A video frame for the capture encoder, with the audio that goes into the file after it.
+ * Queued frames carry their own copy of the pixels, palette and audio, because the render
+ * buffer is reused for the next frame. Frames encoded on the spot point at the caller's data. */
+struct CaptureVideoFrame {
+	Bitu			width = 0,height = 0,bpp = 0,flags = 0;	/* as given to CAPTURE_AddImage, after doubling */
+	Bitu			pitch = 0;
+	const uint8_t*		data = NULL;
+	const uint8_t*		pal = NULL;
+	zmbv_format_t		format = ZMBV_FORMAT_NONE;
+	Bitu			frame = 0;				/* frame number, for keyframes and timestamps */
+	int			codecFlags = 0;
+	bool			unchanged = false;			/* write a null frame instead */
+	const int16_t*		audio = NULL;
+	Bitu			audioused = 0;				/* stereo samples */
+	const uint8_t*		changed = NULL;				/* per source line, NULL if all of them */
+
+	std::vector<uint8_t>	pixels;
+	std::vector<uint8_t>	changedbuf;
+	std::vector<int16_t>	audiobuf;
+	uint32_t		palette[256];
+};
+
+static bool CAPTURE_EncodeVideoFrame(const CaptureVideoFrame &f);
+
+#if defined(CAPTURE_ASYNC_ENCODER)
+/* Compresses and writes captured frames on its own thread, so that ZMBV deflate or H.264
+ * encoding does not run inside the render callback. The queue is bounded by the
+ * "capture encoder queue" setting: if the encoder falls behind, emulation waits for it
+ * instead of dropping frames, and those waits are counted and reported when capture stops. */
+class CaptureVideoEncoder {
+public:
+	~CaptureVideoEncoder() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!thread.joinable()) return;
+			stopping = true;
+		}
+		work_ready.notify_all();
+		thread.join();
+	}
+
+	/* returns a frame to fill in and Submit(), waiting while the queue is full */
+	CaptureVideoFrame *Acquire(const size_t limit) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (!thread.joinable()) thread = std::thread(&CaptureVideoEncoder::Loop,this);
+		if (queue.size() >= limit) {
+			const uint32_t start = GetTicks();
+			work_done.wait(guard,[this,limit]{ return queue.size() < limit; });
+			stalls++;
+			stall_ms += GetTicks() - start;
+		}
+		if (spare.empty()) {
+			pool.emplace_back(new CaptureVideoFrame());
+			return pool.back().get();
+		}
+		CaptureVideoFrame *f = spare.back();
+		spare.pop_back();
+		return f;
+	}
+
+	void Submit(CaptureVideoFrame *f) {
+		std::lock_guard<std::mutex> guard(lock);
+		queue.push_back(f);
+		frames++;
+		if (peak < queue.size()) peak = queue.size();
+		work_ready.notify_one();
+	}
+
+	/* wait until every queued frame is written. Returns false if any of them failed,
+	 * after which the encoder skips frames until drained. */
+	bool Drain(void) {
+		std::unique_lock<std::mutex> guard(lock);
+		work_done.wait(guard,[this]{ return queue.empty(); });
+		const bool ok = !failed;
+		failed = false;
+		return ok;
+	}
+
+	bool Failed(void) {
+		std::lock_guard<std::mutex> guard(lock);
+		return failed;
+	}
+
+	void Report(void) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (frames != 0)
+			LOG_MSG("Capture encoder: %lu frames, up to %lu queued, emulation waited %lu times for %lu ms",
+				(unsigned long)frames,(unsigned long)peak,(unsigned long)stalls,(unsigned long)stall_ms);
+		frames = peak = stalls = stall_ms = 0;
+	}
+private:
+	void Loop(void) {
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			work_ready.wait(guard,[this]{ return stopping || !queue.empty(); });
+			if (queue.empty()) break;
+
+			/* stays at the head of the queue while encoding, so that it counts against the limit */
+			CaptureVideoFrame *f = queue.front();
+			const bool skip = failed;
+			guard.unlock();
+			const bool ok = skip || CAPTURE_EncodeVideoFrame(*f);
+			guard.lock();
+			queue.pop_front();
+			if (!ok) failed = true;
+			spare.push_back(f);
+			work_done.notify_all();
+		}
+	}
+
+	std::thread					thread;
+	std::mutex					lock;
+	std::condition_variable				work_ready,work_done;
+	std::deque<CaptureVideoFrame*>			queue;
+	std::vector<CaptureVideoFrame*>			spare;
+	std::vector< std::unique_ptr<CaptureVideoFrame> >	pool;
+	size_t						frames = 0,peak = 0,stalls = 0,stall_ms = 0;
+	bool						failed = false;
+	bool						stopping = false;
+};
+
+static CaptureVideoEncoder capture_video_encoder;
+#endif
+
+/* finish writing queued frames, before the writer or codec is changed on this thread */
+static bool CAPTURE_DrainVideo(void) {
+#if defined(CAPTURE_ASYNC_ENCODER)
+	return capture_video_encoder.Drain();
+#else
+	return true;
+#endif
+}
 #endif
 
 #if defined(USE_TTF)
@@ -667,6 +817,10 @@ void CAPTURE_VideoEvent(bool pressed) {
 #if defined(USE_TTF)
 		if (!(CaptureState & CAPTURE_IMAGE) && !(CaptureState & CAPTURE_VIDEO))
 			ttf_switch_on();
+#endif
+		CAPTURE_DrainVideo();
+#if defined(CAPTURE_ASYNC_ENCODER)
+		capture_video_encoder.Report();
 #endif
 		if (capture.video.writer != NULL) {
 			if ( capture.video.audioused ) {
@@ -801,6 +955,200 @@ void CAPTURE_VideoStop() {
 #endif
 }
 
+#if (C_SSHOT)
+/* compresses one frame and writes it, with its audio, to the capture file */
+static bool CAPTURE_EncodeVideoFrame(const CaptureVideoFrame &f) {
+	const Bitu width = f.width, height = f.height, bpp = f.bpp, flags = f.flags, pitch = f.pitch;
+	const Bitu countWidth = (flags & CAPTURE_FLAG_DBLW) ? (width >> 1) : width;
+	const uint8_t *data = f.data;
+	uint8_t doubleRow[SCALER_MAXWIDTH*4];
+	Bitu i;
+
+	if (native_zmbv) {
+		const int codecFlags = f.codecFlags;
+
+        if (f.unchanged) {
+            /* write null non-keyframe */
+            CAPTURE_AddAviChunk( "00dc", (uint32_t)0, capture.video.buf, (uint32_t)(0x0), 0u);
+        }
+        else {
+            if (!capture.video.codec->PrepareCompressFrame( codecFlags, f.format, (char *)f.pal, capture.video.buf, capture.video.bufSize))
+                return false;
+
+            for (i=0;i<height;i++) {
+                void * rowPointer;
+                /* the codec still has the line from the last frame */
+                if (f.changed != NULL && !f.changed[(flags & CAPTURE_FLAG_DBLH) ? (i >> 1) : i]) {
+                    capture.video.codec->SkipLines( 1 );
+                    continue;
+                }
+                if (flags & CAPTURE_FLAG_DBLW) {
+                    const void *srcLine;
+                    Bitu x;
+                    if (flags & CAPTURE_FLAG_DBLH)
+                        srcLine=(data+(i >> 1)*pitch);
+                    else
+                        srcLine=(data+(i >> 0)*pitch);
+                    switch ( bpp) {
+                        case 8:
+                            for (x=0;x<countWidth;x++)
+                                ((uint8_t *)doubleRow)[x*2+0] =
+                                    ((uint8_t *)doubleRow)[x*2+1] = ((const uint8_t *)srcLine)[x];
+                            break;
+                        case 15:
+                        case 16:
+                            for (x=0;x<countWidth;x++)
+                                ((uint16_t *)doubleRow)[x*2+0] =
+                                    ((uint16_t *)doubleRow)[x*2+1] = ((const uint16_t *)srcLine)[x];
+                            break;
+                        case 32:
+                            for (x=0;x<countWidth;x++)
+                                ((uint32_t *)doubleRow)[x*2+0] =
+                                    ((uint32_t *)doubleRow)[x*2+1] = ((const uint32_t *)srcLine)[x];
+                            break;
+                    }
+                    rowPointer=doubleRow;
+                } else {
+                    if (flags & CAPTURE_FLAG_DBLH)
+                        rowPointer=(void*)(data+(i >> 1)*pitch);
+                    else
+                        rowPointer=(void*)(data+(i >> 0)*pitch);
+                }
+                capture.video.codec->CompressLines( 1, &rowPointer );
+            }
+
+            int written = capture.video.codec->FinishCompressFrame();
+            if (written < 0)
+                return false;
+
+            CAPTURE_AddAviChunk( "00dc", (uint32_t)written, capture.video.buf, (uint32_t)(codecFlags & 1 ? 0x10 : 0x0), 0u);
+        }
+
+		if ( f.audioused )
+			CAPTURE_AddAviChunk( "01wb", (uint32_t)(f.audioused * 4u), (void*)f.audio, /*keyframe*/0x10u, 1u);
+	}
+#if (C_AVCODEC)
+	else if (export_ffmpeg && ffmpeg_fmt_ctx != NULL) {
+		signed long long saved_dts;
+		AVPacket* pkt = av_packet_alloc();
+		int r;
+
+		if (!pkt) E_Exit("Error: Unable to alloc packet");
+		{
+			const unsigned char *srcline;
+			unsigned char *dstline;
+			const uint32_t *palette = (const uint32_t*)f.pal;
+			Bitu x;
+
+			// copy from source to vidrgb frame
+			if (bpp == 8 && ffmpeg_vidrgb_frame->format != AV_PIX_FMT_PAL8) {
+				for (i=0;i<height;i++) {
+					dstline = ffmpeg_vidrgb_frame->data[0] + ((unsigned int)i * (unsigned int)ffmpeg_vidrgb_frame->linesize[0]);
+
+					if (flags & CAPTURE_FLAG_DBLH)
+						srcline=(data+(i >> 1)*pitch);
+					else
+						srcline=(data+(i >> 0)*pitch);
+
+					if (flags & CAPTURE_FLAG_DBLW) {
+						for (x=0;x < countWidth;x++)
+							((uint32_t *)dstline)[(x*2)+0] =
+								((uint32_t *)dstline)[(x*2)+1] = palette[srcline[x]];
+					}
+					else {
+						for (x=0;x < width;x++)
+							((uint32_t *)dstline)[x] = palette[srcline[x]];
+					}
+				}
+			}
+			else {
+				for (i=0;i<height;i++) {
+					dstline = ffmpeg_vidrgb_frame->data[0] + ((unsigned int)i * (unsigned int)ffmpeg_vidrgb_frame->linesize[0]);
+
+					if (flags & CAPTURE_FLAG_DBLW) {
+						if (flags & CAPTURE_FLAG_DBLH)
+							srcline=(data+(i >> 1)*pitch);
+						else
+							srcline=(data+(i >> 0)*pitch);
+
+						switch (bpp) {
+							case 8:
+								for (x=0;x<countWidth;x++)
+									((uint8_t *)dstline)[x*2+0] =
+										((uint8_t *)dstline)[x*2+1] = ((const uint8_t *)srcline)[x];
+								break;
+							case 15:
+							case 16:
+								for (x=0;x<countWidth;x++)
+									((uint16_t *)dstline)[x*2+0] =
+										((uint16_t *)dstline)[x*2+1] = ((const uint16_t *)srcline)[x];
+								break;
+							case 32:
+								for (x=0;x<countWidth;x++)
+									((uint32_t *)dstline)[x*2+0] =
+										((uint32_t *)dstline)[x*2+1] = ((const uint32_t *)srcline)[x];
+								break;
+						}
+					} else {
+						if (flags & CAPTURE_FLAG_DBLH)
+							srcline=(data+(i >> 1)*pitch);
+						else
+							srcline=(data+(i >> 0)*pitch);
+
+						memcpy(dstline,srcline,width*((bpp+7)/8));
+					}
+				}
+			}
+
+			// convert colorspace
+			if (sws_scale(ffmpeg_sws_ctx,
+				// source
+				ffmpeg_vidrgb_frame->data,
+				ffmpeg_vidrgb_frame->linesize,
+				0,ffmpeg_vidrgb_frame->height,
+				// dest
+				ffmpeg_vid_frame->data,
+				ffmpeg_vid_frame->linesize) <= 0)
+				LOG_MSG("WARNING: sws_scale() failed");
+
+			// encode it
+			ffmpeg_vid_frame->pts = (int64_t)f.frame; // or else libx264 complains about non-monotonic timestamps
+			ffmpeg_vid_frame->key_frame = ((f.frame % 15) == 0)?1:0;
+
+			r=avcodec_send_frame(ffmpeg_vid_ctx,ffmpeg_vid_frame);
+			if (r < 0 && r != AVERROR(EAGAIN))
+				LOG_MSG("WARNING: avcodec_send_frame() video failed to encode (err=%d)",r);
+
+			while ((r=avcodec_receive_packet(ffmpeg_vid_ctx,pkt)) >= 0) {
+				saved_dts = pkt->dts;
+				pkt->stream_index = ffmpeg_vid_stream->index;
+				av_packet_rescale_ts(pkt,ffmpeg_vid_ctx->time_base,ffmpeg_vid_stream->time_base);
+				pkt->pts += (int64_t)ffmpeg_video_frame_time_offset;
+				pkt->dts += (int64_t)ffmpeg_video_frame_time_offset;
+
+				if (av_interleaved_write_frame(ffmpeg_fmt_ctx,pkt) < 0)
+					LOG_MSG("WARNING: av_interleaved_write_frame failed");
+
+				pkt->pts = (int64_t)saved_dts + (int64_t)1;
+				pkt->dts = (int64_t)saved_dts + (int64_t)1;
+				av_packet_rescale_ts(pkt,ffmpeg_vid_ctx->time_base,ffmpeg_vid_stream->time_base);
+				ffmpeg_video_frame_last_time = (uint64_t)pkt->pts;
+			}
+
+			if (r != AVERROR(EAGAIN))
+				LOG_MSG("WARNING: avcodec_receive_packet() video failed to encode (err=%d)",r);
+		}
+		av_packet_free(&pkt);
+
+		if ( f.audioused )
+			ffmpeg_take_audio((int16_t*)f.audio,(unsigned int)f.audioused);
+	}
+#endif
+
+	return true;
+}
+#endif
+
 #ifdef PNG_pHYs_SUPPORTED
 static inline unsigned long math_gcd_png_uint_32(const png_uint_32 a,const png_uint_32 b) {
         if (b) return math_gcd_png_uint_32(b,a%b);
@@ -808,7 +1156,7 @@ static inline unsigned long math_gcd_png_uint_32(const png_uint_32 a,const png_u
 }
 #endif
 
-void CAPTURE_AddImage(Bitu width, Bitu height, Bitu bpp, Bitu pitch, Bitu flags, float fps, uint8_t * data, uint8_t * pal) {
+void CAPTURE_AddImage(Bitu width, Bitu height, Bitu bpp, Bitu pitch, Bitu flags, float fps, uint8_t * data, uint8_t * pal, const uint8_t * changedLines) {
 #if (C_SSHOT)
 	Bitu i;
 	uint8_t doubleRow[SCALER_MAXWIDTH*4];
@@ -989,6 +1337,7 @@ skip_shot:
 			capture.video.height != height ||
 			capture.video.bpp != bpp ||
 			capture.video.fps != fps) {
+			CAPTURE_DrainVideo();
 			if (native_zmbv && capture.video.writer != NULL)
 				CAPTURE_VideoEvent(true);
 #if (C_AVCODEC)
@@ -1376,196 +1725,87 @@ skip_shot:
 		}
 #endif
 
-		if (native_zmbv) {
-			int codecFlags;
-
-			if (capture.video.frames % 300 == 0)
-				codecFlags = 1;
-			else
-				codecFlags = 0;
-
-            if ((flags & CAPTURE_FLAG_NOCHANGE) && skip_encoding_unchanged_frames) {
-                /* advance unless at keyframe */
-                if (codecFlags == 0) capture.video.frames++;
-
-                /* write null non-keyframe */
-                CAPTURE_AddAviChunk( "00dc", (uint32_t)0, capture.video.buf, (uint32_t)(0x0), 0u);
-            }
-            else {
-                if (!capture.video.codec->PrepareCompressFrame( codecFlags, format, (char *)pal, capture.video.buf, capture.video.bufSize))
-                    goto skip_video;
-
-                for (i=0;i<height;i++) {
-                    void * rowPointer;
-                    if (flags & CAPTURE_FLAG_DBLW) {
-                        void *srcLine;
-                        Bitu x;
-                        Bitu countWidth = width >> 1;
-                        if (flags & CAPTURE_FLAG_DBLH)
-                            srcLine=(data+(i >> 1)*pitch);
-                        else
-                            srcLine=(data+(i >> 0)*pitch);
-                        switch ( bpp) {
-                            case 8:
-                                for (x=0;x<countWidth;x++)
-                                    ((uint8_t *)doubleRow)[x*2+0] =
-                                        ((uint8_t *)doubleRow)[x*2+1] = ((uint8_t *)srcLine)[x];
-                                break;
-                            case 15:
-                            case 16:
-                                for (x=0;x<countWidth;x++)
-                                    ((uint16_t *)doubleRow)[x*2+0] =
-                                        ((uint16_t *)doubleRow)[x*2+1] = ((uint16_t *)srcLine)[x];
-                                break;
-                            case 32:
-                                for (x=0;x<countWidth;x++)
-                                    ((uint32_t *)doubleRow)[x*2+0] =
-                                        ((uint32_t *)doubleRow)[x*2+1] = ((uint32_t *)srcLine)[x];
-                                break;
-                        }
-                        rowPointer=doubleRow;
-                    } else {
-                        if (flags & CAPTURE_FLAG_DBLH)
-                            rowPointer=(data+(i >> 1)*pitch);
-                        else
-                            rowPointer=(data+(i >> 0)*pitch);
-                    }
-                    capture.video.codec->CompressLines( 1, &rowPointer );
-                }
-
-                int written = capture.video.codec->FinishCompressFrame();
-                if (written < 0)
-                    goto skip_video;
-
-                CAPTURE_AddAviChunk( "00dc", (uint32_t)written, capture.video.buf, (uint32_t)(codecFlags & 1 ? 0x10 : 0x0), 0u);
-                capture.video.frames++;
-            }
-
-			if ( capture.video.audioused ) {
-				CAPTURE_AddAviChunk( "01wb", (uint32_t)(capture.video.audioused * 4u), capture.video.audiobuf, /*keyframe*/0x10u, 1u);
-				capture.video.audiowritten = capture.video.audioused*4;
-				capture.video.audioused = 0;
-			}
-		}
+		bool encode = native_zmbv;
 #if (C_AVCODEC)
-		else if (export_ffmpeg && ffmpeg_fmt_ctx != NULL) {
-			signed long long saved_dts;
-			AVPacket* pkt = av_packet_alloc();
-			int r;
-
-			if (!pkt) E_Exit("Error: Unable to alloc packet");
-			{
-				unsigned char *srcline,*dstline;
-				Bitu x;
-
-				// copy from source to vidrgb frame
-				if (bpp == 8 && ffmpeg_vidrgb_frame->format != AV_PIX_FMT_PAL8) {
-					for (i=0;i<height;i++) {
-						dstline = ffmpeg_vidrgb_frame->data[0] + ((unsigned int)i * (unsigned int)ffmpeg_vidrgb_frame->linesize[0]);
-
-						if (flags & CAPTURE_FLAG_DBLH)
-							srcline=(data+(i >> 1)*pitch);
-						else
-							srcline=(data+(i >> 0)*pitch);
+		if (export_ffmpeg && ffmpeg_fmt_ctx != NULL) encode = true;
+#endif
+		if (encode) {
+			CaptureVideoFrame local,*f = &local;
+#if defined(CAPTURE_ASYNC_ENCODER)
+			if (capture_encoder_queue != 0) {
+				/* an earlier frame failed to encode */
+				if (capture_video_encoder.Failed())
+					goto skip_video;
+				f = capture_video_encoder.Acquire(capture_encoder_queue);
+			}
+#endif
+			f->width = width;
+			f->height = height;
+			f->bpp = bpp;
+			f->flags = flags;
+			f->format = format;
+			f->frame = capture.video.frames;
+			f->codecFlags = 0;
+			f->unchanged = false;
+			if (native_zmbv) {
+				if (capture.video.frames % 300 == 0)
+					f->codecFlags = 1;
+
+				f->unchanged = (flags & CAPTURE_FLAG_NOCHANGE) && skip_encoding_unchanged_frames;
+				/* advance unless at keyframe */
+				if (!f->unchanged || f->codecFlags == 0) capture.video.frames++;
+			}
+			else {
+				capture.video.frames++;
+			}
 
-						if (flags & CAPTURE_FLAG_DBLW) {
-							for (x=0;x < width;x++)
-								((uint32_t *)dstline)[(x*2)+0] =
-									((uint32_t *)dstline)[(x*2)+1] = GFX_palette32bpp[srcline[x]];
-						}
-						else {
-							for (x=0;x < width;x++)
-								((uint32_t *)dstline)[x] = GFX_palette32bpp[srcline[x]];
-						}
-					}
-				}
-				else {
-					for (i=0;i<height;i++) {
-						dstline = ffmpeg_vidrgb_frame->data[0] + ((unsigned int)i * (unsigned int)ffmpeg_vidrgb_frame->linesize[0]);
-
-						if (flags & CAPTURE_FLAG_DBLW) {
-							if (flags & CAPTURE_FLAG_DBLH)
-								srcline=(data+(i >> 1)*pitch);
-							else
-								srcline=(data+(i >> 0)*pitch);
-
-							switch (bpp) {
-								case 8:
-									for (x=0;x<countWidth;x++)
-										((uint8_t *)dstline)[x*2+0] =
-											((uint8_t *)dstline)[x*2+1] = ((uint8_t *)srcline)[x];
-									break;
-								case 15:
-								case 16:
-									for (x=0;x<countWidth;x++)
-										((uint16_t *)dstline)[x*2+0] =
-											((uint16_t *)dstline)[x*2+1] = ((uint16_t *)srcline)[x];
-									break;
-								case 32:
-									for (x=0;x<countWidth;x++)
-										((uint32_t *)dstline)[x*2+0] =
-											((uint32_t *)dstline)[x*2+1] = ((uint32_t *)srcline)[x];
-									break;
-							}
-						} else {
-							if (flags & CAPTURE_FLAG_DBLH)
-								srcline=(data+(i >> 1)*pitch);
-							else
-								srcline=(data+(i >> 0)*pitch);
-
-							memcpy(dstline,srcline,width*((bpp+7)/8));
-						}
+			/* ZMBV takes the palette of the frame, H.264 expands 8bpp through the display palette */
+			const uint8_t *framePal = pal;
+#if (C_AVCODEC)
+			if (!native_zmbv) framePal = (const uint8_t*)GFX_palette32bpp;
+#endif
+			/* ZMBV keeps the last frame, so lines the renderer did not change are neither
+			 * copied nor compared again. The first frame has nothing to keep yet. */
+			f->changed = (native_zmbv && f->frame != 0) ? changedLines : NULL;
+			const Bitu rows = (flags & CAPTURE_FLAG_DBLH) ? ((height + 1) >> 1) : height;
+			if (f != &local) {
+				const Bitu rowlen = countWidth * ((bpp + 7) / 8);
+				if (!f->unchanged) {
+					f->pixels.resize(rows * rowlen);
+					for (i=0;i<rows;i++) {
+						if (f->changed == NULL || f->changed[i])
+							memcpy(&f->pixels[i*rowlen],data+i*pitch,rowlen);
 					}
 				}
-
-				// convert colorspace
-				if (sws_scale(ffmpeg_sws_ctx,
-					// source
-					ffmpeg_vidrgb_frame->data,
-					ffmpeg_vidrgb_frame->linesize,
-					0,ffmpeg_vidrgb_frame->height,
-					// dest
-					ffmpeg_vid_frame->data,
-					ffmpeg_vid_frame->linesize) <= 0)
-					LOG_MSG("WARNING: sws_scale() failed");
-
-				// encode it
-				ffmpeg_vid_frame->pts = (int64_t)capture.video.frames; // or else libx264 complains about non-monotonic timestamps
-				ffmpeg_vid_frame->key_frame = ((capture.video.frames % 15) == 0)?1:0;
-
-				r=avcodec_send_frame(ffmpeg_vid_ctx,ffmpeg_vid_frame);
-				if (r < 0 && r != AVERROR(EAGAIN))
-					LOG_MSG("WARNING: avcodec_send_frame() video failed to encode (err=%d)",r);
-
-				while ((r=avcodec_receive_packet(ffmpeg_vid_ctx,pkt)) >= 0) {
-					saved_dts = pkt->dts;
-					pkt->stream_index = ffmpeg_vid_stream->index;
-					av_packet_rescale_ts(pkt,ffmpeg_vid_ctx->time_base,ffmpeg_vid_stream->time_base);
-					pkt->pts += (int64_t)ffmpeg_video_frame_time_offset;
-					pkt->dts += (int64_t)ffmpeg_video_frame_time_offset;
-
-					if (av_interleaved_write_frame(ffmpeg_fmt_ctx,pkt) < 0)
-						LOG_MSG("WARNING: av_interleaved_write_frame failed");
-
-					pkt->pts = (int64_t)saved_dts + (int64_t)1;
-					pkt->dts = (int64_t)saved_dts + (int64_t)1;
-					av_packet_rescale_ts(pkt,ffmpeg_vid_ctx->time_base,ffmpeg_vid_stream->time_base);
-					ffmpeg_video_frame_last_time = (uint64_t)pkt->pts;
+				if (f->changed != NULL) {
+					f->changedbuf.assign(f->changed,f->changed + rows);
+					f->changed = f->changedbuf.data();
 				}
-
-				if (r != AVERROR(EAGAIN))
-					LOG_MSG("WARNING: avcodec_receive_packet() video failed to encode (err=%d)",r);
+				memcpy(f->palette,framePal,sizeof(f->palette));
+				f->audiobuf.assign(&capture.video.audiobuf[0][0],&capture.video.audiobuf[0][0] + (capture.video.audioused * 2));
+				f->data = f->pixels.data();
+				f->pitch = rowlen;
+				f->pal = (const uint8_t*)f->palette;
+				f->audio = f->audiobuf.data();
 			}
-			av_packet_free(&pkt);
-			capture.video.frames++;
-
-			if ( capture.video.audioused ) {
-				ffmpeg_take_audio((int16_t*)capture.video.audiobuf/*NTS: Ewwwwww.... what if the compiler pads the 2-dimensional array?*/,capture.video.audioused);
-				capture.video.audiowritten = capture.video.audioused*4;
-				capture.video.audioused = 0;
+			else {
+				f->data = data;
+				f->pitch = pitch;
+				f->pal = framePal;
+				f->audio = &capture.video.audiobuf[0][0];
 			}
-		}
+			f->audioused = capture.video.audioused;
+			capture.video.audiowritten = capture.video.audioused*4;
+			capture.video.audioused = 0;
+
+#if defined(CAPTURE_ASYNC_ENCODER)
+			if (f != &local)
+				capture_video_encoder.Submit(f);
+			else
 #endif
+			if (!CAPTURE_EncodeVideoFrame(*f))
+				goto skip_video;
+		}
 		else {
 			capture.video.audiowritten = capture.video.audioused*4;
 			capture.video.audioused = 0;
@@ -1583,6 +1823,7 @@ skip_shot:
 #endif
     return;
 skip_video:
+	CAPTURE_DrainVideo();
 	capture.video.writer = avi_writer_destroy(capture.video.writer);
 # if (C_AVCODEC)
 	ffmpeg_flushout();
@@ -1618,6 +1859,156 @@ void CAPTURE_RawScreenShotEvent(bool pressed) {
 }
 #endif
 
+#if !defined(C_EMSCRIPTEN)
+/* write one buffer of captured audio, to the WAV file or to a stream of the multitrack AVI */
+static void CAPTURE_WriteWaveBlock(riff_wav_writer *wav,avi_writer *avi,size_t stream,std::vector<int16_t> &data) {
+	if (wav != NULL)
+		riff_wav_writer_data_write(wav,data.data(),data.size()*sizeof(int16_t));
+	else if (avi != NULL)
+		avi_writer_stream_write(avi,avi->avi_stream + stream,data.data(),data.size()*sizeof(int16_t),/*keyframe*/0x10);
+}
+
+#if defined(CAPTURE_ASYNC_AUDIO)
+/* Writes captured audio on its own thread. The mixer hands over whole buffers of WAVE_BUF
+ * sample frames, so the file I/O, and for multitrack capture the AVI chunk and index
+ * bookkeeping, happens once per buffer and stream instead of inside every mixer tick.
+ * Written buffers are recycled, so capturing does not allocate once it is running. */
+class CaptureAudioWriter {
+public:
+	~CaptureAudioWriter() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (!thread.joinable()) return;
+			stopping = true;
+		}
+		work_ready.notify_all();
+		thread.join();
+	}
+
+	/* queue data for writing, leaving an empty buffer in its place */
+	void Submit(riff_wav_writer *wav,avi_writer *avi,size_t stream,std::vector<int16_t> &data) {
+		std::unique_lock<std::mutex> guard(lock);
+		if (!thread.joinable()) thread = std::thread(&CaptureAudioWriter::Loop,this);
+		if (queue.size() >= queue_limit) {
+			const uint32_t start = GetTicks();
+			work_done.wait(guard,[this]{ return queue.size() < queue_limit; });
+			stalls++;
+			stall_ms += GetTicks() - start;
+		}
+		queue.emplace_back();
+		Block &b = queue.back();
+		b.wav = wav;
+		b.avi = avi;
+		b.stream = stream;
+		b.data.swap(data);
+		blocks++;
+		if (peak < queue.size()) peak = queue.size();
+		work_ready.notify_one();
+
+		if (!spare.empty()) {
+			data.swap(spare.back());
+			spare.pop_back();
+		}
+	}
+
+	/* wait until every queued buffer is written, before the file is finished or closed */
+	void Drain(void) {
+		std::unique_lock<std::mutex> guard(lock);
+		work_done.wait(guard,[this]{ return queue.empty(); });
+	}
+
+	void Report(void) {
+		std::lock_guard<std::mutex> guard(lock);
+		if (blocks != 0)
+			LOG_MSG("Capture audio writer: %lu buffers, up to %lu queued, emulation waited %lu times for %lu ms",
+				(unsigned long)blocks,(unsigned long)peak,(unsigned long)stalls,(unsigned long)stall_ms);
+		blocks = peak = stalls = stall_ms = 0;
+	}
+private:
+	struct Block {
+		riff_wav_writer			*wav = NULL;
+		avi_writer			*avi = NULL;
+		size_t				stream = 0;
+		std::vector<int16_t>		data;
+	};
+
+	void Loop(void) {
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			work_ready.wait(guard,[this]{ return stopping || !queue.empty(); });
+			if (queue.empty()) break;
+
+			/* stays at the head of the queue while writing, so that Drain() waits for it */
+			Block &b = queue.front();
+			guard.unlock();
+			CAPTURE_WriteWaveBlock(b.wav,b.avi,b.stream,b.data);
+			b.data.clear();
+			guard.lock();
+			spare.emplace_back();
+			spare.back().swap(b.data);
+			queue.pop_front();
+			work_done.notify_all();
+		}
+	}
+
+	/* 64 buffers of WAVE_BUF stereo frames is 4MB, several seconds of audio even with a dozen tracks */
+	static const size_t				queue_limit = 64;
+
+	std::thread					thread;
+	std::mutex					lock;
+	std::condition_variable				work_ready,work_done;
+	std::deque<Block>				queue;
+	std::vector< std::vector<int16_t> >		spare;
+	size_t						blocks = 0,peak = 0,stalls = 0,stall_ms = 0;
+	bool						stopping = false;
+};
+
+static CaptureAudioWriter capture_audio_writer;
+#endif
+
+/* append len stereo sample frames to buf, and write it out each time it holds WAVE_BUF frames */
+static void CAPTURE_BufferWave(riff_wav_writer *wav,avi_writer *avi,size_t stream,std::vector<int16_t> &buf,const int16_t *data,Bitu len) {
+	while (len > 0) {
+		if (buf.capacity() < WAVE_BUF*2) buf.reserve(WAVE_BUF*2);
+
+		Bitu left = WAVE_BUF - (Bitu)(buf.size() / 2);
+		if (left > len)
+			left = len;
+		buf.insert(buf.end(),data,data + left*2);
+		data += left*2;
+		len -= left;
+
+		if (buf.size() >= WAVE_BUF*2) {
+#if defined(CAPTURE_ASYNC_AUDIO)
+			capture_audio_writer.Submit(wav,avi,stream,buf);
+#else
+			CAPTURE_WriteWaveBlock(wav,avi,stream,buf);
+			buf.clear();
+#endif
+		}
+	}
+}
+
+/* write what is left in buf, and wait for everything queued before the file is finished */
+static void CAPTURE_FlushWave(riff_wav_writer *wav,avi_writer *avi,size_t stream,std::vector<int16_t> &buf) {
+	if (!buf.empty()) {
+#if defined(CAPTURE_ASYNC_AUDIO)
+		capture_audio_writer.Submit(wav,avi,stream,buf);
+#else
+		CAPTURE_WriteWaveBlock(wav,avi,stream,buf);
+#endif
+	}
+	buf.clear();
+}
+
+static void CAPTURE_DrainWave(void) {
+#if defined(CAPTURE_ASYNC_AUDIO)
+	capture_audio_writer.Drain();
+	capture_audio_writer.Report();
+#endif
+}
+#endif
+
 MixerChannel * MIXER_FirstChannel(void);
 
 void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const char *name) {
@@ -1675,6 +2066,7 @@ void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const
 			__w_le_u32(&mheader->dwHeight,0);
 
 			capture.multitrack_wave.name_to_stream_index.clear();
+			capture.multitrack_wave.pending.clear();
 			{
 				MixerChannel *c = MIXER_FirstChannel();
 				while (c != NULL) {
@@ -1748,8 +2140,11 @@ void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const
 				size_t index = ni->second;
 
 				if (index < (size_t)capture.multitrack_wave.writer->avi_stream_alloc) {
-					avi_writer_stream *os = capture.multitrack_wave.writer->avi_stream + index;
-					avi_writer_stream_write(capture.multitrack_wave.writer,os,data,len * 2 * 2,/*keyframe*/0x10);
+					/* buffered per stream, so that each track is written in large chunks */
+					if (capture.multitrack_wave.pending.size() <= index)
+						capture.multitrack_wave.pending.resize(index + 1);
+
+					CAPTURE_BufferWave(NULL,capture.multitrack_wave.writer,index,capture.multitrack_wave.pending[index],data,len);
 				}
 				else {
 					LOG_MSG("Multitrack: Ignoring unknown track '%s', out of range\n",name);
@@ -1763,6 +2158,7 @@ void CAPTURE_MultiTrackAddWave(uint32_t freq, uint32_t len, int16_t * data,const
 
 	return;
 skip_mt_wav:
+	capture.multitrack_wave.pending.clear();
 	capture.multitrack_wave.writer = avi_writer_destroy(capture.multitrack_wave.writer);
 #endif
 }
@@ -1881,7 +2277,7 @@ void CAPTURE_AddWave(uint32_t freq, uint32_t len, int16_t * data) {
 			}
 
 			capture.wave.length = 0;
-			capture.wave.used = 0;
+			capture.wave.buf.clear();
 			capture.wave.freq = freq;
 #if defined(WIN32)
             char fullpath[MAX_PATH];
@@ -1892,22 +2288,8 @@ void CAPTURE_AddWave(uint32_t freq, uint32_t len, int16_t * data) {
 #endif
 			LOG_MSG("Started capturing wave output to: %s", path.c_str());
 		}
-		int16_t * read = data;
-		while (len > 0 ) {
-			Bitu left = WAVE_BUF - capture.wave.used;
-			if (!left) {
-				riff_wav_writer_data_write(capture.wave.writer,capture.wave.buf,2*2*WAVE_BUF);
-				capture.wave.length += 4*WAVE_BUF;
-				capture.wave.used = 0;
-				left = WAVE_BUF;
-			}
-			if (left > len)
-				left = len;
-			memcpy( &capture.wave.buf[capture.wave.used], read, left*4);
-			capture.wave.used += left;
-			read += left*2;
-			len -= (uint32_t)left;
-		}
+		CAPTURE_BufferWave(capture.wave.writer,NULL,0,capture.wave.buf,data,len);
+		capture.wave.length += len*4;
 	}
 #endif
 }
@@ -1921,6 +2303,10 @@ void CAPTURE_MTWaveEvent(bool pressed) {
         if (capture.multitrack_wave.writer != NULL) {
             LOG_MSG("Stopped capturing multitrack wave output.");
             capture.multitrack_wave.name_to_stream_index.clear();
+            for (size_t i=0;i < capture.multitrack_wave.pending.size();i++)
+                CAPTURE_FlushWave(NULL,capture.multitrack_wave.writer,i,capture.multitrack_wave.pending[i]);
+            capture.multitrack_wave.pending.clear();
+            CAPTURE_DrainWave();
             avi_writer_end_data(capture.multitrack_wave.writer);
             avi_writer_finish(capture.multitrack_wave.writer);
             avi_writer_close_file(capture.multitrack_wave.writer);
@@ -1966,8 +2352,8 @@ void CAPTURE_WaveEvent(bool pressed) {
         if (capture.wave.writer != NULL) {
             LOG_MSG("Stopped capturing wave output.");
             /* Write last piece of audio in buffer */
-            riff_wav_writer_data_write(capture.wave.writer,capture.wave.buf,2*2*capture.wave.used);
-            capture.wave.length+=(uint32_t)(capture.wave.used*4);
+            CAPTURE_FlushWave(capture.wave.writer,NULL,0,capture.wave.buf);
+            CAPTURE_DrainWave();
             riff_wav_writer_end_data(capture.wave.writer);
             capture.wave.writer = riff_wav_writer_destroy(capture.wave.writer);
             CaptureState &= ~((unsigned int)CAPTURE_WAVE);
@@ -2149,6 +2535,7 @@ void CAPTURE_Init() {
     force_load_state = section->Get_bool("forceloadstate");
     mainMenu.get_item("force_loadstate").check(force_load_state).refresh_item(mainMenu);
     show_recorded_filename = section->Get_bool("show recorded filename");
+    REWIND_SetConfig(section);
     savefilename = section->Get_string("savefile");
     trim(savefilename);
     if (savefilename.size()) {
@@ -2188,6 +2575,7 @@ void CAPTURE_Init() {
     else sendkeymap=0;
 
     skip_encoding_unchanged_frames = section->Get_bool("skip encoding unchanged frames");
+    capture_encoder_queue = (unsigned int)section->Get_int("capture encoder queue");
 
     std::string ffmpeg_pixfmt = section->Get_string("capture chroma format");
 
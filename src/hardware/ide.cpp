@@ -36,6 +36,17 @@
 #include "../src/dos/cdrom.h"
 #include "bios.h"
 
+#include <functional>
+#include <vector>
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define IDE_ASYNC_HOST_IO 1
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <deque>
+#endif
+
 #if defined(_MSC_VER)
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
 # pragma warning(disable:4305) /* truncation from double to float */
@@ -145,6 +156,99 @@ enum {
 
 class IDEController;
 
+/* Host read issued when an ATA or ATAPI read command starts, so that slow host storage
+ * (network filesystems, compressed images) is read while the emulated busy time runs
+ * instead of stalling emulation inside IDE_DelayedCommand. The data lands in a side buffer
+ * because the guest may still be reading the device's sector buffer, and is copied in when
+ * the delayed command joins it. Only images that can be read without touching state the
+ * emulation thread also uses (memory mapped raw disk images and CD tracks) are read this way,
+ * everything else is read synchronously. Builds without threads always read synchronously. */
+struct IDEHostRead {
+    std::function<bool(unsigned char*)> op;
+    std::vector<unsigned char>  data;
+    const void*                 source = NULL;  /* imageDisk or CDROM_Interface read from */
+    uint32_t                    lba = 0;        /* first sector */
+    uint32_t                    count = 0;      /* sectors */
+    uint32_t                    sector_size = 0;
+    bool                        valid = false;  /* issued and not yet discarded */
+    bool                        ok = false;
+    bool                        done = true;
+};
+
+#if defined(IDE_ASYNC_HOST_IO)
+class IDEHostIOWorker {
+public:
+    ~IDEHostIOWorker() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            if (!thread.joinable()) return;
+            stopping = true;
+        }
+        work_ready.notify_all();
+        thread.join();
+    }
+
+    void Submit(IDEHostRead &r) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!thread.joinable()) thread = std::thread(&IDEHostIOWorker::Loop,this);
+        r.done = false;
+        queue.push_back(&r);
+        work_ready.notify_one();
+    }
+
+    void Wait(IDEHostRead &r) {
+        std::unique_lock<std::mutex> guard(lock);
+        if (r.done) return;
+
+        /* not picked up yet, run it here rather than wait behind other requests */
+        for (auto i=queue.begin();i != queue.end();i++) {
+            if (*i == &r) {
+                queue.erase(i);
+                guard.unlock();
+                r.ok = r.op(r.data.data());
+                r.done = true;
+                return;
+            }
+        }
+
+        work_done.wait(guard,[&r]{ return r.done; });
+    }
+
+    void WaitIdle(void) {
+        std::unique_lock<std::mutex> guard(lock);
+        work_done.wait(guard,[this]{ return queue.empty() && !busy; });
+    }
+private:
+    void Loop(void) {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            work_ready.wait(guard,[this]{ return stopping || !queue.empty(); });
+            if (stopping) break;
+
+            IDEHostRead *r = queue.front();
+            queue.pop_front();
+            busy = true;
+            guard.unlock();
+            const bool ok = r->op(r->data.data());
+            guard.lock();
+            busy = false;
+            r->ok = ok;
+            r->done = true;
+            work_done.notify_all();
+        }
+    }
+
+    std::thread                 thread;
+    std::mutex                  lock;
+    std::condition_variable     work_ready,work_done;
+    std::deque<IDEHostRead*>    queue;
+    bool                        busy = false;
+    bool                        stopping = false;
+};
+
+static IDEHostIOWorker ide_host_io;
+#endif
+
 #if 0//unused
 static inline bool drivehead_is_lba48(uint8_t val) {
     return (val&0xE0) == 0x40;
@@ -217,6 +321,12 @@ public:
     virtual void data_write(Bitu v,Bitu iolen);/* write to 1F0h data port to IDE device */
     virtual bool command_interruption_ok(uint8_t cmd);
     virtual void abort_silent();
+public:
+    /* read-ahead of the current read command, see IDEHostRead */
+    void host_read_issue(const void *source,uint32_t first,uint32_t n,uint32_t sector_size,std::function<bool(unsigned char*)> op);
+    bool host_read_take(const void *source,uint32_t first,uint32_t n,uint32_t sector_size,unsigned char *dst);
+    void host_read_discard();
+    IDEHostRead host_read;
 };
 
 class IDEATADevice:public IDEDevice {
@@ -238,6 +348,9 @@ public:
     virtual void prepare_write(Bitu offset,Bitu size);
     virtual void io_completion();
     virtual bool increment_current_address(Bitu count=1);
+    bool current_sector(uint32_t &sectorn);
+    void issue_read_ahead();
+    int read_sectors(imageDisk *disk,uint32_t sectorn,uint32_t n,unsigned char *dst);
 public:
     Bitu multiple_sector_max,multiple_sector_count;
     Bitu heads,sects,cyls,progress_count;
@@ -282,6 +395,8 @@ public:
     virtual void io_completion();
     virtual void atapi_cmd_completion();
     virtual void on_atapi_busy_time();
+    void issue_read_ahead();
+    bool read_sectors_host(CDROM_Interface *cdrom,unsigned char *dst,bool raw,unsigned long sector,unsigned long n);
     virtual void mechanism_status();
     virtual void read_subchannel();
     virtual void play_audio_msf();
@@ -319,6 +434,7 @@ public:
     int IRQ;
     bool int13fakeio;       /* on certain INT 13h calls, force IDE state as if BIOS had carried them out */
     bool int13fakev86io;        /* on certain INT 13h calls in virtual 8086 mode, trigger fake CPU I/O traps */
+    bool async_host_io;     /* start host reads when a read command is issued, overlapped with the emulated busy time */
     bool enable_pio32;      /* enable 32-bit PIO (if disabled, attempts at 32-bit PIO are handled as if two 16-bit I/O) */
     bool ignore_pio32;      /* if 32-bit PIO enabled, but ignored, writes do nothing, reads return 0xFFFFFFFF */
     bool register_pnp;
@@ -1203,7 +1319,7 @@ void IDEATAPICDROMDevice::on_atapi_busy_time() {
             else {
                 /* OK, try to read */
                 CDROM_Interface *cdrom = getMSCDEXDrive();
-                bool res = (cdrom != NULL ? cdrom->ReadSectorsHost(/*buffer*/sector,false,LBA,TransferLength) : false);
+                bool res = (cdrom != NULL ? read_sectors_host(cdrom,/*buffer*/sector,false,LBA,TransferLength) : false);
                 if (res) {
                     prepare_read(0,MIN((unsigned int)(TransferLength*2048),(unsigned int)host_maximum_byte_count));
                     LBAnext = LBA + TransferLength;
@@ -1259,7 +1375,7 @@ void IDEATAPICDROMDevice::on_atapi_busy_time() {
                 /* TODO: Implement remaining types and better comply with the standard (i.e. validate track type, don't allow reading across data and CDDA tracks) */
                 if (TransferSectorType == 2/*Mode 1*/ || TransferSectorType == 4/*Mode 2 form 1*/) {
                     if (TransferSectorSize == 2048) {
-                        if (cdrom && cdrom->ReadSectorsHost(/*buffer*/sector,false,(unsigned long)LBA,(unsigned long)TransferLength)) {
+                        if (cdrom && read_sectors_host(cdrom,/*buffer*/sector,false,(unsigned long)LBA,(unsigned long)TransferLength)) {
                             res = true;
                             prepare_read(0,MIN((unsigned int)(TransferLength*2048),(unsigned int)host_maximum_byte_count));
                         }
@@ -1271,7 +1387,7 @@ void IDEATAPICDROMDevice::on_atapi_busy_time() {
                 }
                 else if (TransferSectorType == 0/*raw*/ || TransferSectorType == 1/*CDDA*/) {
                     if (TransferSectorSize == 2352) {
-                        if (cdrom && cdrom->ReadSectorsHost(/*buffer*/sector,true,(unsigned long)LBA,(unsigned long)TransferLength)) {
+                        if (cdrom && read_sectors_host(cdrom,/*buffer*/sector,true,(unsigned long)LBA,(unsigned long)TransferLength)) {
                             res = true;
                             prepare_read(0,MIN((unsigned int)(TransferLength*2352),(unsigned int)host_maximum_byte_count));
                         }
@@ -1609,6 +1725,7 @@ void IDEATAPICDROMDevice::atapi_io_completion() {
                     state = IDE_DEV_ATAPI_BUSY;
                     status = IDE_STATUS_BUSY;
                     /* TODO: Emulate CD-ROM spin-up delay, and seek delay */
+                    issue_read_ahead();
                     PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
                     PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 3)/*ms*/,pk);
 		    return;
@@ -1649,6 +1766,7 @@ void IDEATAPICDROMDevice::atapi_io_completion() {
                     state = IDE_DEV_ATAPI_BUSY;
                     status = IDE_STATUS_BUSY;
                     /* TODO: Emulate CD-ROM spin-up delay, and seek delay */
+                    issue_read_ahead();
                     PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
                     PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 3)/*ms*/,pk);
 		    return;
@@ -2061,6 +2179,7 @@ void IDEATAPICDROMDevice::atapi_cmd_completion() {
                 state = IDE_DEV_ATAPI_BUSY;
                 status = IDE_STATUS_BUSY;
                 /* TODO: Emulate CD-ROM spin-up delay, and seek delay */
+                issue_read_ahead();
                 PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
                 PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 3)/*ms*/,pk);
             }
@@ -2123,6 +2242,7 @@ void IDEATAPICDROMDevice::atapi_cmd_completion() {
                 state = IDE_DEV_ATAPI_BUSY;
                 status = IDE_STATUS_BUSY;
                 /* TODO: Emulate CD-ROM spin-up delay, and seek delay */
+                issue_read_ahead();
                 PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
                 PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 3)/*ms*/,pk);
             }
@@ -2183,6 +2303,7 @@ void IDEATAPICDROMDevice::atapi_cmd_completion() {
                 state = IDE_DEV_ATAPI_BUSY;
                 status = IDE_STATUS_BUSY;
                 /* TODO: Emulate CD-ROM spin-up delay, and seek delay */
+                issue_read_ahead();
                 PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
                 PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 3)/*ms*/,pk);
             }
@@ -2636,11 +2757,85 @@ IDEATADevice::IDEATADevice(IDEController *c,unsigned char disk_index,bool _slave
 IDEATADevice::~IDEATADevice() {
 }
 
+/* the sector addressed by the task file, without the error reporting of IDE_DelayedCommand */
+bool IDEATADevice::current_sector(uint32_t &sectorn) {
+    if (drivehead_is_lba(drivehead)) {
+        sectorn = (((unsigned int)drivehead & 0xFu) << 24u) | (unsigned int)lba[0] |
+            ((unsigned int)lba[1] << 8u) |
+            ((unsigned int)lba[2] << 16u);
+        return true;
+    }
+
+    const unsigned int cyl = (unsigned int)lba[1] | ((unsigned int)lba[2] << 8u);
+    if (lba[0] == 0 || (unsigned int)(drivehead & 0xFu) >= (unsigned int)heads ||
+        (unsigned int)lba[0] > (unsigned int)sects || cyl >= (unsigned int)cyls)
+        return false;
+
+    sectorn = ((drivehead & 0xFu) * sects) + (cyl * sects * heads) + ((unsigned int)lba[0] - 1u);
+    return true;
+}
+
+/* start reading every sector of the read command just issued */
+void IDEATADevice::issue_read_ahead() {
+    imageDisk *disk = getBIOSdisk();
+    uint32_t sectorn;
+
+    if (disk == NULL || !disk->CanReadConcurrently() || !current_sector(sectorn)) {
+        host_read_discard();
+        return;
+    }
+
+    const uint32_t n = (count & 0xFF) ? (count & 0xFF) : 256;
+    host_read_issue(disk,sectorn,n,512,[disk,sectorn,n](unsigned char *buf) {
+        return disk->Read_Sectors(sectorn,n,buf) == 0;
+    });
+}
+
+int IDEATADevice::read_sectors(imageDisk *disk,uint32_t sectorn,uint32_t n,unsigned char *dst) {
+    if (host_read_take(disk,sectorn,n,512,dst)) return 0;
+    return disk->Read_Sectors(sectorn,n,dst);
+}
+
 imageDisk *IDEATADevice::getBIOSdisk() {
     if (bios_disk_index >= (2 + MAX_HDD_IMAGES)) return NULL;
     return imageDiskList[bios_disk_index];
 }
 
+/* start reading the sectors the pending READ command will return once its busy time is up */
+void IDEATAPICDROMDevice::issue_read_ahead() {
+    CDROM_Interface *cdrom = getMSCDEXDrive();
+    bool raw;
+
+    if (cdrom == NULL || !cdrom->CanReadConcurrently()) {
+        host_read_discard();
+        return;
+    }
+
+    if (atapi_cmd[0] == 0xBE/*READ CD*/) {
+        if ((TransferSectorType == 2 || TransferSectorType == 4) && TransferSectorSize == 2048)
+            raw = false;
+        else if ((TransferSectorType == 0 || TransferSectorType == 1) && TransferSectorSize == 2352)
+            raw = true;
+        else {
+            host_read_discard();
+            return;
+        }
+    }
+    else {
+        raw = false;
+    }
+
+    const unsigned long first = (unsigned long)LBA,n = (unsigned long)TransferLength;
+    host_read_issue(cdrom,(uint32_t)first,(uint32_t)n,raw ? 2352 : 2048,[cdrom,raw,first,n](unsigned char *buf) {
+        return cdrom->ReadSectorsHost(buf,raw,first,n);
+    });
+}
+
+bool IDEATAPICDROMDevice::read_sectors_host(CDROM_Interface *cdrom,unsigned char *dst,bool raw,unsigned long sector,unsigned long n) {
+    if (host_read_take(cdrom,(uint32_t)sector,(uint32_t)n,raw ? 2352 : 2048,dst)) return true;
+    return cdrom->ReadSectorsHost(dst,raw,sector,n);
+}
+
 CDROM_Interface *IDEATAPICDROMDevice::getMSCDEXDrive() {
     CDROM_Interface *cdrom=NULL;
 
@@ -2739,6 +2934,13 @@ bool IDE_controller_occupied(signed char index, bool slave) { // Return true if
     }
 }
 
+/* called before a disk or CD-ROM image is closed, so that no read-ahead is still using it */
+void IDE_WaitHostIO(void) {
+#if defined(IDE_ASYNC_HOST_IO)
+    ide_host_io.WaitIdle();
+#endif
+}
+
 /* drive_index = drive letter 0...A to 25...Z */
 void IDE_ATAPI_MediaChangeNotify(unsigned char drive_index) {
     for (unsigned int ide=0;ide < MAX_IDE_CONTROLLERS;ide++) {
@@ -2752,6 +2954,7 @@ void IDE_ATAPI_MediaChangeNotify(unsigned char drive_index) {
                 IDEATAPICDROMDevice *atapi = (IDEATAPICDROMDevice*)dev;
                 if (drive_index == atapi->drive_index) {
                     LOG_MSG("IDE ATAPI acknowledge media change for drive %c\n",drive_index+'A');
+                    atapi->host_read_discard();
                     atapi->has_changed = true;
                     atapi->loading_mode = LOAD_INSERT_CD;
                     PIC_RemoveSpecificEvents(IDE_ATAPI_SpinDown,pk);
@@ -3521,7 +3724,7 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                         ((unsigned int)ata->lba[0] - 1u);
                 }
 
-                if (disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
+                if (ata->read_sectors(disk, sectorn, 1, ata->sector) != 0) {
                     LOG_MSG("ATA read failed\n");
                     ata->abort_error();
                     dev->raise_irq();
@@ -3585,7 +3788,7 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                         ((unsigned int)ata->lba[0] - 1u);
                 }
 
-                if (disk->Read_AbsoluteSector(sectorn, ata->sector) != 0) {
+                if (ata->read_sectors(disk, sectorn, 1, ata->sector) != 0) {
                     LOG_MSG("ATA read failed\n");
                     ata->abort_error();
                     dev->raise_irq();
@@ -3665,14 +3868,11 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                 if ((512*ata->multiple_sector_count) > sizeof(ata->sector))
                     E_Exit("SECTOR OVERFLOW");
 
-                for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-                    /* it would be great if the disk object had a "read multiple sectors" member function */
-                    if (disk->Read_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-                        LOG_MSG("ATA read failed\n");
-                        ata->abort_error();
-                        dev->raise_irq();
-                        return;
-                    }
+                if (ata->read_sectors(disk, sectorn, (uint32_t)MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount), ata->sector) != 0) {
+                    LOG_MSG("ATA read failed\n");
+                    ata->abort_error();
+                    dev->raise_irq();
+                    return;
                 }
 
                 /* NTS: the way this command works is that the drive reads ONE sector, then fires the IRQ
@@ -3731,14 +3931,11 @@ static void IDE_DelayedCommand(Bitu pk/*which IDE device*/) {
                         ((unsigned int)ata->lba[0] - 1);
                 }
 
-                for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
-                    /* it would be great if the disk object had a "write multiple sectors" member function */
-                    if (disk->Write_AbsoluteSector(sectorn+cc, ata->sector+(cc*512)) != 0) {
-                        LOG_MSG("Failed to write sector\n");
-                        ata->abort_error();
-                        dev->raise_irq();
-                        return;
-                    }
+                if (disk->Write_Sectors(sectorn, (uint32_t)MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount), ata->sector) != 0) {
+                    LOG_MSG("Failed to write sector\n");
+                    ata->abort_error();
+                    dev->raise_irq();
+                    return;
                 }
 
                 for (unsigned int cc=0;cc < MIN((Bitu)ata->multiple_sector_count,(Bitu)sectcount);cc++) {
@@ -3960,6 +4157,53 @@ void IDEDevice::host_reset_begin() {
 }
 
 IDEDevice::~IDEDevice() {
+    host_read_discard();
+}
+
+void IDEDevice::host_read_issue(const void *source,uint32_t first,uint32_t n,uint32_t sector_size,std::function<bool(unsigned char*)> op) {
+    host_read_discard();
+#if defined(IDE_ASYNC_HOST_IO)
+    if (!controller->async_host_io || faked_command || source == NULL || n == 0) return;
+
+    host_read.op = std::move(op);
+    host_read.data.resize((size_t)n * sector_size);
+    host_read.source = source;
+    host_read.lba = first;
+    host_read.count = n;
+    host_read.sector_size = sector_size;
+    host_read.ok = false;
+    host_read.valid = true;
+    ide_host_io.Submit(host_read);
+#else
+    (void)first;
+    (void)sector_size;
+    (void)op;
+#endif
+}
+
+/* copy sectors out of the read-ahead if it covers them. false means the caller reads them
+ * itself, which is also how a failed read-ahead reports its error to the guest. */
+bool IDEDevice::host_read_take(const void *source,uint32_t first,uint32_t n,uint32_t sector_size,unsigned char *dst) {
+    if (!host_read.valid || host_read.source != source || host_read.sector_size != sector_size) return false;
+    if (first < host_read.lba || n > host_read.count || (first - host_read.lba) > (host_read.count - n)) return false;
+
+#if defined(IDE_ASYNC_HOST_IO)
+    ide_host_io.Wait(host_read);
+#endif
+    if (!host_read.ok) {
+        host_read.valid = false;
+        return false;
+    }
+
+    memcpy(dst,host_read.data.data() + ((size_t)(first - host_read.lba) * sector_size),(size_t)n * sector_size);
+    return true;
+}
+
+void IDEDevice::host_read_discard() {
+#if defined(IDE_ASYNC_HOST_IO)
+    if (host_read.valid) ide_host_io.Wait(host_read);
+#endif
+    host_read.valid = false;
 }
 
 void IDEDevice::abort_silent() {
@@ -4203,6 +4447,7 @@ void IDEATADevice::writecommand(uint8_t cmd) {
             progress_count = 0;
             state = IDE_DEV_BUSY;
             status = IDE_STATUS_BUSY;
+            issue_read_ahead();
             PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
             PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 0.1)/*ms*/,pk);
             break;
@@ -4210,6 +4455,7 @@ void IDEATADevice::writecommand(uint8_t cmd) {
             /* the drive does NOT signal an interrupt. it sets DRQ and waits for a sector
              * to be transferred to it before executing the command */
             progress_count = 0;
+            host_read_discard();
             state = IDE_DEV_DATA_WRITE;
             status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRQ;
             prepare_write(0,512);
@@ -4219,6 +4465,7 @@ void IDEATADevice::writecommand(uint8_t cmd) {
             progress_count = 0;
             state = IDE_DEV_BUSY;
             status = IDE_STATUS_BUSY;
+            issue_read_ahead();
             PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
             PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 0.1)/*ms*/,pk);
             break;
@@ -4258,6 +4505,7 @@ void IDEATADevice::writecommand(uint8_t cmd) {
             progress_count = 0;
             state = IDE_DEV_BUSY;
             status = IDE_STATUS_BUSY;
+            issue_read_ahead();
             PIC_RemoveSpecificEvents(IDE_DelayedCommand,pk);
             PIC_AddEvent(IDE_DelayedCommand,(faked_command ? 0.000001 : 0.1)/*ms*/,pk);
             break;
@@ -4265,6 +4513,7 @@ void IDEATADevice::writecommand(uint8_t cmd) {
             /* the drive does NOT signal an interrupt. it sets DRQ and waits for a sector
              * to be transferred to it before executing the command */
             progress_count = 0;
+            host_read_discard();
             state = IDE_DEV_DATA_WRITE;
             status = IDE_STATUS_DRIVE_READY|IDE_STATUS_DRQ;
             prepare_write(0UL,512UL*MIN((unsigned long)multiple_sector_count,(unsigned long)(count == 0 ? 256 : count)));
@@ -4367,6 +4616,7 @@ IDEController::IDEController(Section* configuration,unsigned char index):Module_
     register_pnp = section->Get_bool("pnp");
     int13fakeio = section->Get_bool("int13fakeio");
     int13fakev86io = section->Get_bool("int13fakev86io");
+    async_host_io = section->Get_bool("async host io");
     enable_pio32 = section->Get_bool("enable pio32");
     ignore_pio32 = section->Get_bool("ignore pio32");
     spinup_time = section->Get_int("cd-rom spinup time");
@@ -43,6 +43,7 @@ static void innova_write(Bitu port,Bitu val,Bitu iolen) {
 		innova.chan->Enable(true);
 	}
 	innova.last_used=PIC_Ticks;
+	if (Mixer_SampleAccurate()) innova.chan->FillUp();
 
 	Bitu sidPort = port-innova.basePort;
 	innova.sid->write((reg8)sidPort, (reg8)val);
@@ -941,6 +941,23 @@ void MEM_BlockWrite(LinearPt pt, const void *data, size_t size) {
     }
 }
 
+HostPt MEM_GetBlockHostPt(LinearPt pt, size_t size, bool writing) {
+    if (size == 0) return NULL;
+
+    /* the TLB entry holds the host address minus the linear address, so the pages of the
+     * range are contiguous on the host if every page has the same entry */
+    const HostPt tlb_addr = writing ? get_tlb_write(pt) : get_tlb_read(pt);
+    if (!tlb_addr) return NULL;
+
+    const LinearPt last = (LinearPt)(pt + size - 1);
+    if (last < pt) return NULL; /* wraps around the 4GB linear space */
+    for (LinearPt page = (pt & ~((LinearPt)0xFFF)) + 0x1000; page <= last && page != 0; page += 0x1000) {
+        if ((writing ? get_tlb_write(page) : get_tlb_read(page)) != tlb_addr) return NULL;
+    }
+
+    return tlb_addr + pt;
+}
+
 void MEM_BlockRead32(LinearPt pt,void * data,Bitu size) {
     uint32_t * write=(uint32_t *) data;
     size>>=2;
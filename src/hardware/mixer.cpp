@@ -27,6 +27,7 @@
 #include <sys/types.h>
 #define _USE_MATH_DEFINES // needed for M_PI in Visual Studio as documented [https://msdn.microsoft.com/en-us/library/4hwaceh6.aspx]
 #include <math.h>
+#include <chrono>
 
 #if defined(_MSC_VER)
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
@@ -101,9 +102,94 @@ static struct {
     bool            sampleaccurate;
     bool            prebuffer_wait;
     Bitu            prebuffer_samples;
+    Bitu            prebuffer_samples_user;
+    Bitu            keep_samples;           // buffer target the drop logic works toward (blocksize, or adaptive)
+    bool            adaptive;
     bool            mute;
 } mixer;
 
+/* audio pipeline statistics, updated by the audio callback, see MIXER_GetStats() */
+static struct {
+    unsigned long long  underruns;
+    unsigned long long  dropped_samples;
+    unsigned long long  callbacks;
+    unsigned int        queue_samples;
+    double              jitter_ms;
+    double              max_jitter_ms;
+    std::chrono::steady_clock::time_point last_callback;
+    std::chrono::steady_clock::time_point last_underrun;
+} mixer_stats;
+
+void MIXER_GetStats(MixerStats &st) {
+#ifdef C_SDL2
+    SDL_LockAudioDevice(SDL2_AudioDevice);
+#else
+    SDL_LockAudio();
+#endif
+    st.underruns = mixer_stats.underruns;
+    st.dropped_samples = mixer_stats.dropped_samples;
+    st.callbacks = mixer_stats.callbacks;
+    st.queue_ms = mixer.freq ? (mixer_stats.queue_samples * 1000u) / mixer.freq : 0;
+    st.target_ms = mixer.freq ? (unsigned int)((mixer.keep_samples * 1000u) / mixer.freq) : 0;
+    st.jitter_ms = mixer_stats.jitter_ms;
+    st.max_jitter_ms = mixer_stats.max_jitter_ms;
+    st.adaptive = mixer.adaptive;
+#ifdef C_SDL2
+    SDL_UnlockAudioDevice(SDL2_AudioDevice);
+#else
+    SDL_UnlockAudio();
+#endif
+}
+
+void MIXER_ResetStats(void) {
+#ifdef C_SDL2
+    SDL_LockAudioDevice(SDL2_AudioDevice);
+#else
+    SDL_LockAudio();
+#endif
+    mixer_stats.underruns = 0;
+    mixer_stats.dropped_samples = 0;
+    mixer_stats.callbacks = 0;
+    mixer_stats.jitter_ms = 0;
+    mixer_stats.max_jitter_ms = 0;
+#ifdef C_SDL2
+    SDL_UnlockAudioDevice(SDL2_AudioDevice);
+#else
+    SDL_UnlockAudio();
+#endif
+}
+
+/* most samples the prebuffer and the kept samples may hold, for the user setting and the adaptive one alike */
+static Bitu MIXER_PrebufferLimit(void) {
+    return mixer.work_wrap / 2;
+}
+
+/* adaptive prebuffer: grow the buffer target quickly when the audio device runs dry,
+ * shrink it slowly back toward what the measured callback jitter requires. */
+static void MIXER_AdaptBuffer(bool underrun,const std::chrono::steady_clock::time_point &now) {
+    const Bitu limit = MIXER_PrebufferLimit();
+    const Bitu floor = mixer.blocksize;
+
+    if (underrun) {
+        mixer.keep_samples += mixer.blocksize / 4u + 1u;
+        if (mixer.keep_samples > limit) mixer.keep_samples = limit;
+        mixer.prebuffer_samples += mixer.blocksize / 4u + 1u;
+        if (mixer.prebuffer_samples > limit) mixer.prebuffer_samples = limit;
+        return;
+    }
+
+    /* only shrink after two seconds without an underrun */
+    if (std::chrono::duration_cast<std::chrono::milliseconds>(now - mixer_stats.last_underrun).count() < 2000)
+        return;
+
+    const Bitu jitter_samples = (Bitu)((mixer_stats.jitter_ms * 4.0 * mixer.freq) / 1000.0);
+    const Bitu want = std::max(floor,floor + jitter_samples);
+    if (mixer.keep_samples > want) mixer.keep_samples -= (mixer.keep_samples - want + 63u) / 64u;
+
+    const Bitu want_pre = std::max(mixer.prebuffer_samples_user,jitter_samples);
+    if (mixer.prebuffer_samples > want_pre) mixer.prebuffer_samples -= (mixer.prebuffer_samples - want_pre + 63u) / 64u;
+}
+
 uint32_t Mixer_MIXQ(void) {
     return  ((uint32_t)mixer.freq) |
             ((uint32_t)2u/*channels*/ << (uint32_t)20u) |
@@ -860,9 +946,8 @@ void MixerChannel::FillUp(void) {
     MIXER_FillUp();
 }
 
-void MIXER_MixSingle(Bitu /*val*/) {
-    MIXER_FillUp();
-    PIC_AddEvent(MIXER_MixSingle,1000.0 / mixer.freq);
+void Mixer_SampleAccurateFillUp() {
+    if (mixer.sampleaccurate) MIXER_FillUp();
 }
 
 static void MIXER_Mix(void) {
@@ -915,6 +1000,18 @@ static void SDLCALL MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
     Bitu need = (Bitu)len/MIXER_SSIZE;
     int16_t *output = (int16_t*)stream;
     int remains;
+    bool underrun = false;
+
+    /* callback jitter: deviation of the interval between callbacks from the time this callback plays */
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (mixer_stats.callbacks++ != 0 && mixer.freq != 0) {
+        const double interval = std::chrono::duration<double,std::milli>(now - mixer_stats.last_callback).count();
+        const double nominal = (need * 1000.0) / mixer.freq;
+        const double dev = fabs(interval - nominal);
+        mixer_stats.jitter_ms += (dev - mixer_stats.jitter_ms) / 16.0;
+        if (mixer_stats.max_jitter_ms < dev) mixer_stats.max_jitter_ms = dev;
+    }
+    mixer_stats.last_callback = now;
 
     if (mixer.mute) {
         if ((CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO|CAPTURE_MULTITRACK_WAVE)) != 0)
@@ -947,8 +1044,14 @@ static void SDLCALL MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
         }
     }
 
-    if (need > 0)
+    if (need > 0) {
+        if (!mixer.prebuffer_wait && !mixer.mute) {
+            mixer_stats.underruns++;
+            mixer_stats.last_underrun = now;
+            underrun = true;
+        }
         mixer.prebuffer_wait = true;
+    }
 
     while (need > 0) {
         *output++ = 0;
@@ -959,21 +1062,26 @@ static void SDLCALL MIXER_CallBack(void * userdata, Uint8 *stream, int len) {
     remains = (int)mixer.work_in - (int)mixer.work_out;
     if (remains < 0) remains += (int)mixer.work_wrap;
 
-    if ((unsigned long)remains >= (mixer.blocksize*2UL)) {
+    if ((unsigned long)remains >= (mixer.keep_samples*2UL)) {
         /* drop some samples to keep time */
         unsigned int drop;
 
-        if ((unsigned long)remains >= (mixer.blocksize*3UL)) // hard drop
-            drop = ((unsigned int)remains - (unsigned int)(mixer.blocksize));
+        if ((unsigned long)remains >= (mixer.keep_samples*3UL)) // hard drop
+            drop = ((unsigned int)remains - (unsigned int)(mixer.keep_samples));
         else // subtle drop
-            drop = (((unsigned int)remains - (unsigned int)(mixer.blocksize*2)) / 50U) + 1;
+            drop = (((unsigned int)remains - (unsigned int)(mixer.keep_samples*2)) / 50U) + 1;
 
+        mixer_stats.dropped_samples += drop;
+        remains -= (int)drop;
         while (drop > 0) {
             mixer.work_out++;
             if (mixer.work_out >= mixer.work_wrap) mixer.work_out = 0;
             drop--;
         }
     }
+
+    mixer_stats.queue_samples = (unsigned int)remains;
+    if (mixer.adaptive) MIXER_AdaptBuffer(underrun,now);
 }
 
 std::string mixerinfo() {
@@ -1202,6 +1310,7 @@ void MIXER_Init() {
     mixer.blocksize=(unsigned int)section->Get_int("blocksize");
     mixer.swapstereo=section->Get_bool("swapstereo");
     mixer.sampleaccurate=section->Get_bool("sample accurate");
+    mixer.adaptive=section->Get_bool("adaptive prebuffer");
     mixer.mute=false;
     if (control->opt_silent) mixer.nosound = true;
 
@@ -1262,8 +1371,10 @@ void MIXER_Init() {
 
         mixer.freq=(unsigned int)obtained.freq;
         mixer.blocksize=obtained.samples;
+        /* sample accurate mode does not need a timer event per sample. Sound devices call FillUp()
+         * from their I/O handlers, which renders every channel up to PIC_TickIndex() before the
+         * state change, and MIXER_Mix() renders the remainder of each millisecond. */
         TIMER_AddTickHandler(MIXER_Mix);
-        if (mixer.sampleaccurate) PIC_AddEvent(MIXER_MixSingle,1000.0 / mixer.freq);
 #ifdef C_SDL2
         SDL_PauseAudioDevice(SDL2_AudioDevice, 0);
 #else
@@ -1282,9 +1393,15 @@ void MIXER_Init() {
         if (ms < 0) ms = 20;
 
         mixer.prebuffer_samples = ((unsigned int)ms * (unsigned int)mixer.freq) / 1000u;
-        if (mixer.prebuffer_samples > (mixer.work_wrap / 2))
-            mixer.prebuffer_samples = (mixer.work_wrap / 2);
+        if (mixer.prebuffer_samples > MIXER_PrebufferLimit()) {
+            mixer.prebuffer_samples = MIXER_PrebufferLimit();
+            LOG(LOG_MISC,LOG_WARN)("Mixer: prebuffer of %dms limited to %ums",
+                ms,(unsigned int)((mixer.prebuffer_samples * 1000u) / mixer.freq));
+        }
+        mixer.prebuffer_samples_user = mixer.prebuffer_samples;
     }
+    mixer.keep_samples = mixer.blocksize;
+    mixer_stats.last_underrun = std::chrono::steady_clock::now();
 
     // how many samples per millisecond? compute as improper fraction (sample rate / 1000)
     mixer.samples_per_ms.w = mixer.freq / 1000U;
@@ -596,6 +596,11 @@ void PIC_SetIRQMask(Bitu irq, bool masked) {
     pic->set_imr(newmask);
 }
 
+bool PIC_GetIRQMask(Bitu irq) {
+    Bitu t = irq>7 ? (irq - 8): irq;
+    return (pics[irq>7 ? 1 : 0].imr & (1u << t)) != 0;
+}
+
 void DEBUG_PICSignal(int irq,bool raise) {
     if (irq >= 0 && irq <= 15) {
         if (raise)
@@ -1105,6 +1110,7 @@ void DEBUG_LogPIC(void) {
 extern void *cmos_timerevent_PIC_Event;						// Cmos.cpp
 extern void *DISNEY_disable_PIC_Event;						// Disney.cpp
 extern void *GUS_TimerEvent_PIC_Event;						// Gus.cpp
+extern void *GUS_VoiceIRQEvent_PIC_Event;
 #if C_IPX
 //extern void *IPX_AES_EventHandler_PIC_Event;			// Ipx.cpp
 #endif
@@ -1116,6 +1122,7 @@ extern void *DMA_DAC_Event_PIC_Event;
 extern void *DSP_FinishReset_PIC_Event;
 extern void *DSP_RaiseIRQEvent_PIC_Event;
 extern void *END_DMA_Event_PIC_Event;
+extern void *DMA_Stream_Event_PIC_Event;
 extern void *Serial_EventHandler_PIC_Event;				// Serialport.cpp
 extern void *PIT0_Event_PIC_Event;								// Timer.cpp
 extern void *VGA_DisplayStartLatch_PIC_Event;			// Vga.cpp
@@ -1178,6 +1185,8 @@ const void *pic_state_event_table[] = {
 	fmport_a_pic_event_PIC_Event,
 	fmport_b_pic_event_PIC_Event,
 	PIC_IRQCheckDelayed_PIC_Event,
+	DMA_Stream_Event_PIC_Event,
+	GUS_VoiceIRQEvent_PIC_Event,
 
 	//NE2000_TX_Event_PIC_Event,
 };
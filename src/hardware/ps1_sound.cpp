@@ -151,6 +151,7 @@ static void PS1SOUNDWrite(Bitu port,Bitu data,Bitu iolen) {
 			ps1.chanSN->Enable(true);
 			ps1.enabledSN=true;
 		}
+		if (Mixer_SampleAccurate()) ps1.chanSN->FillUp();
 	}
 
 #if C_DEBUG != 0
@@ -192,6 +192,7 @@ struct SB_INFO {
                   The DMA emulation here does not handle that well. */
     bool goldplay;
     bool goldplay_stereo;
+    bool dma_streaming; /* render plain auto-init PCM playback in whole mixer blocks across DSP block boundaries */
     bool write_status_must_return_7f; // WRITE_STATUS (port base+0xC) must return 0x7F or 0xFF if set. Some very early demos rely on it.
     bool busy_cycle_always;
     bool ess_playback_mode;
@@ -398,7 +399,8 @@ static void CheckDMAEnd();
 static void DMA_DAC_Event(Bitu);
 static void END_DMA_Event(Bitu);
 static void DMA_Silent_Event(Bitu val);
-static void GenerateDMASound(Bitu size);
+static void DMA_Stream_Event(Bitu val);
+static Bitu GenerateDMASound(Bitu size);
 
 static void DSP_SetSpeaker(bool how) {
     if (sb.speaker==how) return;
@@ -770,13 +772,40 @@ static void gen_input(Bitu dmabytes,unsigned char *buf) {
 	}
 }
 
-static void GenerateDMASound(Bitu size) {
+/* Play mono 8/16-bit PCM in place out of guest RAM instead of copying it into sb.dma.buf first.
+ * Returns how many DMA units were played, which can be less than size if part of the transfer
+ * cannot be mapped. The caller reads the remainder the normal way. */
+static Bitu SB_PlayDMASpans(Bitu size) {
+	DmaSpan spans[4];
+	unsigned int nspans = 0;
+
+	const Bitu read = sb.dma.chan->ReadSpans(size,spans,4,nspans);
+	for (unsigned int s=0;s < nspans;s++) {
+		if (sb.dma.mode == DSP_DMA_8) {
+			if (!sb.dma.sign) sb.chan->AddSamples_m8(spans[s].units,spans[s].ptr);
+			else sb.chan->AddSamples_m8s(spans[s].units,(const int8_t*)spans[s].ptr);
+		}
+		else {
+#if defined(WORDS_BIGENDIAN)
+			if (sb.dma.sign) sb.chan->AddSamples_m16_nonnative(spans[s].units,(const int16_t*)spans[s].ptr);
+			else sb.chan->AddSamples_m16u_nonnative(spans[s].units,(const uint16_t*)spans[s].ptr);
+#else
+			if (sb.dma.sign) sb.chan->AddSamples_m16(spans[s].units,(const int16_t*)spans[s].ptr);
+			else sb.chan->AddSamples_m16u(spans[s].units,(const uint16_t*)spans[s].ptr);
+#endif
+		}
+	}
+
+	return read;
+}
+
+static Bitu GenerateDMASound(Bitu size) {
 	Bitu read=0;Bitu done=0;Bitu i=0;
 
 	// don't read if the DMA channel is masked
-	if (sb.dma.chan->masked) return;
+	if (sb.dma.chan->masked) return 0;
 
-	if (sb.dma_dac_mode) return;
+	if (sb.dma_dac_mode) return 0;
 
 	last_dma_callback = PIC_FullIndex();
 
@@ -868,7 +897,7 @@ static void GenerateDMASound(Bitu size) {
 			default:
 				LOG_MSG("Unhandled dma record mode %d",sb.dma.mode);
 				sb.mode=MODE_NONE;
-				return;
+				return 0;
 		}
 	}
 	else {
@@ -929,9 +958,13 @@ static void GenerateDMASound(Bitu size) {
 						sb.dma.buf.b8[0]=sb.dma.buf.b8[total-1];
 					} else sb.dma.remain_size=0;
 				} else {
-					read=sb.dma.chan->Read(size,sb.dma.buf.b8);
-					if (!sb.dma.sign) sb.chan->AddSamples_m8(read,sb.dma.buf.b8);
-					else sb.chan->AddSamples_m8s(read,(int8_t *)sb.dma.buf.b8);
+					const Bitu spanned=SB_PlayDMASpans(size);
+					if (spanned < size && !sb.dma.chan->masked) {
+						read=sb.dma.chan->Read(size-spanned,sb.dma.buf.b8);
+						if (!sb.dma.sign) sb.chan->AddSamples_m8(read,sb.dma.buf.b8);
+						else sb.chan->AddSamples_m8s(read,(int8_t *)sb.dma.buf.b8);
+					}
+					read+=spanned;
 				}
 				break;
 			case DSP_DMA_16:
@@ -955,15 +988,20 @@ static void GenerateDMASound(Bitu size) {
 						sb.dma.buf.b16[0]=sb.dma.buf.b16[total-1];
 					} else sb.dma.remain_size=0;
 				} else {
-					read=sb.dma.chan->Read(size,(uint8_t *)sb.dma.buf.b16)
-						>> (sb.dma.mode==DSP_DMA_16_ALIASED ? 1:0);
+					/* aliased 16-bit over 8-bit DMA can end on half a sample, so it is always copied */
+					const Bitu spanned=(sb.dma.mode==DSP_DMA_16) ? SB_PlayDMASpans(size) : 0;
+					if (spanned < size && !sb.dma.chan->masked) {
+						read=sb.dma.chan->Read(size-spanned,(uint8_t *)sb.dma.buf.b16)
+							>> (sb.dma.mode==DSP_DMA_16_ALIASED ? 1:0);
 #if defined(WORDS_BIGENDIAN)
-					if (sb.dma.sign) sb.chan->AddSamples_m16_nonnative(read,sb.dma.buf.b16);
-					else sb.chan->AddSamples_m16u_nonnative(read,(uint16_t *)sb.dma.buf.b16);
+						if (sb.dma.sign) sb.chan->AddSamples_m16_nonnative(read,sb.dma.buf.b16);
+						else sb.chan->AddSamples_m16u_nonnative(read,(uint16_t *)sb.dma.buf.b16);
 #else
-					if (sb.dma.sign) sb.chan->AddSamples_m16(read,sb.dma.buf.b16);
-					else sb.chan->AddSamples_m16u(read,(uint16_t *)sb.dma.buf.b16);
+						if (sb.dma.sign) sb.chan->AddSamples_m16(read,sb.dma.buf.b16);
+						else sb.chan->AddSamples_m16u(read,(uint16_t *)sb.dma.buf.b16);
 #endif
+					}
+					read+=spanned;
 				}
 				//restore buffer length value to byte size in aliased mode
 				if (sb.dma.mode==DSP_DMA_16_ALIASED) read=read<<1;
@@ -971,11 +1009,50 @@ static void GenerateDMASound(Bitu size) {
 			default:
 				LOG_MSG("Unhandled dma playback mode %d",sb.dma.mode);
 				sb.mode=MODE_NONE;
-				return;
+				return 0;
 		}
 	}
 	sb.dma.left-=read;
 	if (!sb.dma.left) SB_OnEndOfDMA();
+	return read;
+}
+
+/* DMA streaming applies only to plain auto-init 8/16-bit PCM playback where the
+ * DSP and the DMA controller both loop over the same buffer. Everything else
+ * (ADPCM, recording, Goldplay, single-cycle) keeps the per-block path. */
+static bool SB_DMA_Streaming(void) {
+    if (!sb.dma_streaming || sb.dma.chan == NULL) return false;
+    if (sb.dma.recording || sb.dma_dac_mode || !sb.dma.autoinit || !sb.dma.chan->autoinit) return false;
+    return sb.dma.mode == DSP_DMA_8 || sb.dma.mode == DSP_DMA_16 || sb.dma.mode == DSP_DMA_16_ALIASED;
+}
+
+/* Render up to "len" DMA units in as few channel reads as possible. Rendering stops at
+ * the end of a DSP block, which raises the IRQ, and the next callback goes on from there:
+ * the guest has to see and acknowledge each IRQ before the next one (SB16 halts playback
+ * when an IRQ is still unacknowledged). */
+static void SB_StreamDMA(Bitu len) {
+    while (len > 0 && sb.mode == MODE_DMA && sb.dma.left > 0) {
+        Bitu todo = len;
+        if (todo > sb.dma.left) todo = sb.dma.left;
+        if (todo > (DMA_BUFSIZE - 2)) todo = DMA_BUFSIZE - 2; /* leave room for the stereo remainder */
+
+        const Bitu left = sb.dma.left;
+        const Bitu read = GenerateDMASound(todo);
+        if (read == 0 || read >= left) break; /* stalled, or the block ended and raised the IRQ */
+        len -= (read < len) ? read : len;
+    }
+
+    /* If the next block boundary falls before the next mixer tick, schedule an event at
+     * exactly that point so the IRQ is not delayed until the end of the millisecond.
+     * Longer blocks are handled entirely by the mixer callback with no events at all. */
+    PIC_RemoveEvents(DMA_Stream_Event);
+    if (sb.mode == MODE_DMA && sb.dma.left > 0 && sb.dma.rate > 0 && sb.dma.left < sb.dma.rate / 1000u)
+        PIC_AddEvent(DMA_Stream_Event,(sb.dma.left*1000.0)/sb.dma.rate);
+}
+
+static void DMA_Stream_Event(Bitu /*val*/) {
+    /* catching up the mixer to now renders through the block boundary and raises the IRQ */
+    sb.chan->FillUp();
 }
 
 static void DMA_Silent_Event(Bitu val) {
@@ -1256,6 +1333,7 @@ static void DSP_DoDMATransfer(DMA_MODES mode,Bitu freq,bool stereo,bool dontInit
     sb.dma.mode=sb.dma.mode_assigned=mode;
     PIC_RemoveEvents(DMA_DAC_Event);
     PIC_RemoveEvents(END_DMA_Event);
+    PIC_RemoveEvents(DMA_Stream_Event);
 
     if (sb.dma_dac_mode)
         PIC_AddEvent(DMA_DAC_Event,1000.0 / sb.dma_dac_srcrate);
@@ -1499,6 +1577,7 @@ static void DSP_Reset(void) {
 //  DSP_SetSpeaker(false);
     PIC_RemoveEvents(END_DMA_Event);
     PIC_RemoveEvents(DMA_DAC_Event);
+    PIC_RemoveEvents(DMA_Stream_Event);
 }
 
 static void DSP_DoReset(uint8_t val) {
@@ -1602,6 +1681,7 @@ static void ESS_StopDMA() {
     if (sb.dma.chan) sb.dma.chan->Clear_Request();
     PIC_RemoveEvents(END_DMA_Event);
     PIC_RemoveEvents(DMA_DAC_Event);
+    PIC_RemoveEvents(DMA_Stream_Event);
 }
 
 static void ESS_UpdateDMATotal() {
@@ -2188,6 +2268,7 @@ static void DSP_DoCommand(void) {
         sb.mode=MODE_DMA_PAUSE;
         PIC_RemoveEvents(END_DMA_Event);
         PIC_RemoveEvents(DMA_DAC_Event);
+        PIC_RemoveEvents(DMA_Stream_Event);
         break;
     case 0xd1:  /* Enable Speaker */
         sb.chan->FillUp();
@@ -3372,6 +3453,10 @@ static void SBLASTER_CallBack(Bitu len) {
         len*=sb.dma.mul;
         if (len&SB_SH_MASK) len+=1 << SB_SH;
         len>>=SB_SH;
+        if (SB_DMA_Streaming()) {
+            SB_StreamDMA(len);
+            break;
+        }
         if (len>sb.dma.left) len=sb.dma.left;
         GenerateDMASound(len);
         break;
@@ -3843,6 +3928,7 @@ public:
         sb.goldplay=section->Get_bool("goldplay");
         sb.min_dma_user=section->Get_int("mindma");
         sb.goldplay_stereo=section->Get_bool("goldplay stereo");
+        sb.dma_streaming=section->Get_bool("dma streaming");
         sb.emit_blaster_var=section->Get_bool("blaster environment variable");
         sb.sample_rate_limits=section->Get_bool("sample rate limits");
         sb.sbpro_stereo_bit_strict_mode=section->Get_bool("stereo control with sbpro only");
@@ -4384,6 +4470,7 @@ void *DMA_Silent_Event_PIC_Event = (void*)((uintptr_t)DMA_Silent_Event);
 void *DSP_FinishReset_PIC_Event = (void*)((uintptr_t)DSP_FinishReset);
 void *DSP_RaiseIRQEvent_PIC_Event = (void*)((uintptr_t)DSP_RaiseIRQEvent);
 void *END_DMA_Event_PIC_Event = (void*)((uintptr_t)END_DMA_Event);
+void *DMA_Stream_Event_PIC_Event = (void*)((uintptr_t)DMA_Stream_Event);
 
 void *SB_DSP_DMA_CallBack_Func = (void*)((uintptr_t)DSP_DMA_CallBack);
 void *SB_DSP_ADC_CallBack_Func = (void*)((uintptr_t)DSP_ADC_CallBack);
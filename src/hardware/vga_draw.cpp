@@ -277,6 +277,7 @@ extern std::map<int, int> lowboxdrawmap, pc98boxdrawmap;
 extern bool isemptyhit(uint16_t code), CodePageGuestToHostUTF16(uint16_t *d/*CROSS_LEN*/,const char *s/*CROSS_LEN*/);
 void SetGameState_Run(int value), SaveGameState_Run(void), DOSBOX_UnlockSpeed2( bool pressed ), ttf_switch_off(bool ss=true);
 size_t GetGameState_Run(void);
+void REWIND_Frame(void);
 uint8_t lead[6], ccount = 0, *GetDbcsFont(Bitu code), *GetDbcs14Font(Bitu code, bool &is14);
 uint32_t ticksPrev = 0;
 
@@ -6141,6 +6142,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			ticksPrev=ticksNew;
 		}
 	}
+	REWIND_Frame();
 
 	int sec = static_cast<Section_prop *>(control->GetSection("cpu"))->Get_int("stop turbo after second");
 	if (ticksLocked && turbolasttick && sec>0 && GetTicks()-turbolasttick>=1000*sec) DOSBOX_UnlockSpeed2(true);
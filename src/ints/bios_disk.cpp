@@ -31,6 +31,12 @@
 #include "mapper.h"
 #include "ide.h"
 #include "cpu.h"
+#include "mapped_file.h"
+
+#if !defined(WIN32)
+#include <errno.h>
+#include <unistd.h>
+#endif
 
 #if defined(_MSC_VER)
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
@@ -1336,32 +1342,151 @@ uint8_t imageDisk::Read_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,v
 uint8_t imageDisk::Read_AbsoluteSector(uint32_t sectnum, void * data) {
 	if (ffdd) return ffdd->ReadSector(sectnum, data);
 
-    uint64_t bytenum,res;
-    int got;
+    return Read_Raw(sectnum, 1, data);
+}
 
-    bytenum = (uint64_t)sectnum * (uint64_t)sector_size;
-    if ((bytenum + sector_size) > this->image_length) {
+/* memory map the image on first use, if enabled and the image is read-only */
+void imageDisk::TryMapping(void) {
+    if (mapped_tried) return;
+    mapped_tried = true;
+    if (MappedFile::enabled && diskimg != NULL) {
+        mapped = new MappedFile();
+        if (mapped->Map(diskimg)) {
+            LOG(LOG_MISC,LOG_DEBUG)("Disk image %s is memory mapped",diskname.c_str());
+        }
+        else {
+            delete mapped;
+            mapped = NULL;
+        }
+    }
+}
+
+/* Only raw images served from a memory mapping are read without touching state shared with
+ * other accesses: the stdio stream, or the table and bitmap caches of VHD and QCOW2 images.
+ * Subclasses have their own class_id and stay synchronous, except QCOW2 which overrides this. */
+bool imageDisk::CanReadConcurrently(void) {
+    if (class_id != ID_BASE || ffdd != NULL) return false;
+    TryMapping();
+    return mapped != NULL;
+}
+
+/* Read or write count sectors of the image file in one go. On POSIX hosts this is a single
+ * pread()/pwrite() on the file descriptor, which leaves the stdio file position alone. The
+ * stream is flushed first so that stdio users of diskimg (geometry probing at mount time,
+ * subclasses) and these calls never see stale data from each other. */
+uint8_t imageDisk::Read_Raw(uint32_t sectnum, uint32_t count, void * data) {
+    uint64_t bytenum = (uint64_t)sectnum * (uint64_t)sector_size;
+    const uint64_t len = (uint64_t)count * (uint64_t)sector_size;
+
+    if (diskimg == NULL || (bytenum + len) > this->image_length) {
         LOG_MSG("Attempt to read invalid sector in Read_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
         return 0x05;
     }
     bytenum += image_base;
 
-    //LOG_MSG("Reading sectors %ld at bytenum %I64d", sectnum, bytenum);
+    TryMapping();
+    if (mapped != NULL)
+        return mapped->Read(data, bytenum, (size_t)len) ? 0x00 : 0x05;
 
+#if defined(WIN32)
     fseeko64(diskimg,(fseek_ofs_t)bytenum,SEEK_SET);
-    res = (uint64_t)ftello64(diskimg);
+    const uint64_t res = (uint64_t)ftello64(diskimg);
     if (res != bytenum) {
         LOG_MSG("fseek() failed in Read_AbsoluteSector for sector %lu. Want=%llu Got=%llu\n",
             (unsigned long)sectnum,(unsigned long long)bytenum,(unsigned long long)res);
         return 0x05;
     }
 
-    got = (int)fread(data, 1, sector_size, diskimg);
-    if ((unsigned int)got != sector_size) {
-        LOG_MSG("fread() failed in Read_AbsoluteSector for sector %lu. Want=%u got=%d\n",
-            (unsigned long)sectnum,sector_size,(unsigned int)got);
+    const size_t got = fread(data, 1, (size_t)len, diskimg);
+    if (got != (size_t)len) {
+        LOG_MSG("fread() failed in Read_AbsoluteSector for sector %lu. Want=%llu got=%llu\n",
+            (unsigned long)sectnum,(unsigned long long)len,(unsigned long long)got);
         return 0x05;
     }
+#else
+    fflush(diskimg);
+
+    const int fd = fileno(diskimg);
+    uint8_t *p = (uint8_t*)data;
+    uint64_t left = len;
+    while (left > 0) {
+        const ssize_t got = pread(fd, p, (size_t)left, (off_t)bytenum);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) {
+            LOG_MSG("pread() failed in Read_AbsoluteSector for sector %lu. Want=%llu got=%lld\n",
+                (unsigned long)sectnum,(unsigned long long)left,(long long)got);
+            return 0x05;
+        }
+        p += got;
+        left -= (uint64_t)got;
+        bytenum += (uint64_t)got;
+    }
+#endif
+
+    return 0x00;
+}
+
+uint8_t imageDisk::Write_Raw(uint32_t sectnum, uint32_t count, const void * data) {
+    uint64_t bytenum = (uint64_t)sectnum * (uint64_t)sector_size;
+    const uint64_t len = (uint64_t)count * (uint64_t)sector_size;
+
+    if (diskimg == NULL || (bytenum + len) > this->image_length) {
+        LOG_MSG("Attempt to read invalid sector in Write_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
+        return 0x05;
+    }
+    bytenum += image_base;
+
+#if defined(WIN32)
+    fseeko64(diskimg,(fseek_ofs_t)bytenum,SEEK_SET);
+    if ((uint64_t)ftello64(diskimg) != bytenum)
+        LOG_MSG("WARNING: fseek() failed in Write_AbsoluteSector for sector %lu\n",(unsigned long)sectnum);
+
+    size_t ret=fwrite(data, (size_t)len, 1, diskimg);
+
+    return ((ret>0)?0x00:0x05);
+#else
+    fflush(diskimg);
+
+    const int fd = fileno(diskimg);
+    const uint8_t *p = (const uint8_t*)data;
+    uint64_t left = len;
+    while (left > 0) {
+        const ssize_t got = pwrite(fd, p, (size_t)left, (off_t)bytenum);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return 0x05;
+        p += got;
+        left -= (uint64_t)got;
+        bytenum += (uint64_t)got;
+    }
+
+    return 0x00;
+#endif
+}
+
+/* The default works for every image type, one sector at a time. Plain images without a
+ * subclass go straight to the file. */
+uint8_t imageDisk::Read_Sectors(uint32_t sectnum, uint32_t count, void * data) {
+    if (class_id == ID_BASE && ffdd == NULL && diskimg != NULL)
+        return Read_Raw(sectnum, count, data);
+
+    uint8_t *p = (uint8_t*)data;
+    for (uint32_t i=0;i < count;i++,p += sector_size) {
+        const uint8_t r = Read_AbsoluteSector(sectnum+i, p);
+        if (r != 0x00) return r;
+    }
+
+    return 0x00;
+}
+
+uint8_t imageDisk::Write_Sectors(uint32_t sectnum, uint32_t count, const void * data) {
+    if (class_id == ID_BASE && ffdd == NULL && diskimg != NULL)
+        return Write_Raw(sectnum, count, data);
+
+    const uint8_t *p = (const uint8_t*)data;
+    for (uint32_t i=0;i < count;i++,p += sector_size) {
+        const uint8_t r = Write_AbsoluteSector(sectnum+i, p);
+        if (r != 0x00) return r;
+    }
 
     return 0x00;
 }
@@ -1383,25 +1508,7 @@ uint8_t imageDisk::Write_Sector(uint32_t head,uint32_t cylinder,uint32_t sector,
 uint8_t imageDisk::Write_AbsoluteSector(uint32_t sectnum, const void *data) {
 	if (ffdd) return ffdd->WriteSector(sectnum, data);
 
-    uint64_t bytenum;
-
-    bytenum = (uint64_t)sectnum * sector_size;
-    if ((bytenum + sector_size) > this->image_length) {
-        LOG_MSG("Attempt to read invalid sector in Write_AbsoluteSector for sector %lu.\n", (unsigned long)sectnum);
-        return 0x05;
-    }
-    bytenum += image_base;
-
-    //LOG_MSG("Writing sectors to %ld at bytenum %d", sectnum, bytenum);
-
-    fseeko64(diskimg,(fseek_ofs_t)bytenum,SEEK_SET);
-    if ((uint64_t)ftello64(diskimg) != bytenum)
-        LOG_MSG("WARNING: fseek() failed in Write_AbsoluteSector for sector %lu\n",(unsigned long)sectnum);
-
-    size_t ret=fwrite(data, sector_size, 1, diskimg);
-
-    return ((ret>0)?0x00:0x05);
-
+    return Write_Raw(sectnum, 1, data);
 }
 
 void imageDisk::Set_Reserved_Cylinders(Bitu resCyl) {
@@ -1674,6 +1781,8 @@ imageDisk::imageDisk(class DOS_Drive *useDrive, unsigned int letter, uint32_t fr
 
 imageDisk::~imageDisk()
 {
+    delete mapped;
+    mapped = NULL;
     if(diskimg != NULL) {
         fclose(diskimg);
         diskimg=NULL;
@@ -1826,10 +1935,64 @@ char INT13_ElTorito_NoEmuCDROMDrive = 0;
 
 bool GetMSCDEXDrive(unsigned char drive_letter, CDROM_Interface **_cdrom);
 
+/* DOS drives mounted from this disk cache sectors in the FAT driver. Before INT 13h reads, write back
+ * what they hold. Before INT 13h writes, also make them forget it. */
+static void INT13_SyncFATDrives(imageDisk *disk,bool writing) {
+    for (unsigned int i=0;i < DOS_DRIVES;i++) {
+        fatDrive *fdp = dynamic_cast<fatDrive*>(Drives[i]);
+        if (fdp != NULL && fdp->loadedDisk == disk) {
+            if (writing) fdp->MediaChange();
+            else fdp->flushBlockCache();
+        }
+    }
+}
+
+/* Multi-sector requests are transferred with a single Read_Sectors()/Write_Sectors() call through
+ * this buffer. Image types with their own track layout override Read_Sector(), so a C/H/S run is not
+ * a run of absolute sectors on those and they stay one sector at a time. */
+static std::vector<uint8_t> int13_xferbuf;
+
+static bool INT13_CanBatch(imageDisk *disk,uint32_t count,bool chs) {
+    if (count < 2 || count > 128 || disk->sector_size > 2048) return false;
+    if (chs) {
+        if ((reg_cl & 63) == 0) return false;
+        switch (disk->class_id) {
+            case imageDisk::ID_VFD:
+            case imageDisk::ID_D88:
+            case imageDisk::ID_NFD:
+            case imageDisk::ID_EMPTY_DRIVE:
+            case imageDisk::ID_INT13:
+                return false;
+            default:
+                break;
+        }
+    }
+    return true;
+}
+
+static uint32_t INT13_CHSToAbsolute(imageDisk *disk) {
+    const uint32_t cylinder = (uint32_t)(reg_ch | ((reg_cl & 0xc0) << 2));
+    return ((cylinder * disk->heads + reg_dh) * disk->sectors) + (uint32_t)(reg_cl & 63) - 1u;
+}
+
+/* returns NULL if the request should be read sector by sector, which also reports errors */
+static uint8_t *INT13_ReadBatch(imageDisk *disk,uint32_t sectnum,uint32_t count,bool chs) {
+    if (!INT13_CanBatch(disk,count,chs) || disk->sector_size != 512) return NULL;
+    int13_xferbuf.resize((size_t)count * disk->sector_size);
+    if (disk->Read_Sectors(sectnum,count,&int13_xferbuf[0]) != 0x00) return NULL;
+    return &int13_xferbuf[0];
+}
+
+static uint8_t *INT13_WriteBatch(imageDisk *disk,uint32_t count,bool chs) {
+    if (!INT13_CanBatch(disk,count,chs)) return NULL;
+    int13_xferbuf.resize((size_t)count * disk->sector_size);
+    return &int13_xferbuf[0];
+}
 
 static Bitu INT13_DiskHandler(void) {
     uint16_t segat, bufptr;
     uint8_t sectbuf[2048/*CD-ROM support*/];
+    uint8_t *xfer;
     uint8_t  drivenum;
     Bitu  i,t;
     last_drive = reg_dl;
@@ -1944,10 +2107,19 @@ static Bitu INT13_DiskHandler(void) {
             return CBRET_NONE;
         }
 
+        INT13_SyncFATDrives(imageDiskList[drivenum],false);
+
         segat = SegValue(es);
         bufptr = reg_bx;
+        xfer = INT13_ReadBatch(imageDiskList[drivenum],INT13_CHSToAbsolute(imageDiskList[drivenum]),reg_al,true);
         for(i=0;i<reg_al;i++) {
-            last_status = imageDiskList[drivenum]->Read_Sector((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0)<< 2)), (uint32_t)((reg_cl & 63)+i), sectbuf);
+            if (xfer != NULL) {
+                memcpy(sectbuf,xfer+(i*512),512);
+                last_status = 0x00;
+            }
+            else {
+                last_status = imageDiskList[drivenum]->Read_Sector((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0)<< 2)), (uint32_t)((reg_cl & 63)+i), sectbuf);
+            }
 
             if (drivenum < 2)
                 diskio_delay(512, 0); // Floppy
@@ -1994,7 +2166,10 @@ static Bitu INT13_DiskHandler(void) {
             return CBRET_NONE;
         }
 
+        INT13_SyncFATDrives(imageDiskList[drivenum],true);
+
         bufptr = reg_bx;
+        xfer = INT13_WriteBatch(imageDiskList[drivenum],reg_al,true);
         for(i=0;i<reg_al;i++) {
             for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
                 sectbuf[t] = real_readb(SegValue(es),bufptr);
@@ -2006,12 +2181,24 @@ static Bitu INT13_DiskHandler(void) {
             else
                 diskio_delay(512);
 
+            if (xfer != NULL) {
+                memcpy(xfer+(i*imageDiskList[drivenum]->sector_size),sectbuf,imageDiskList[drivenum]->sector_size);
+                continue;
+            }
+
             last_status = imageDiskList[drivenum]->Write_Sector((uint32_t)reg_dh, (uint32_t)(reg_ch | ((reg_cl & 0xc0) << 2)), (uint32_t)((reg_cl & 63) + i), &sectbuf[0]);
             if(last_status != 0x00) {
             CALLBACK_SCF(true);
                 return CBRET_NONE;
             }
         }
+        if (xfer != NULL) {
+            last_status = imageDiskList[drivenum]->Write_Sectors(INT13_CHSToAbsolute(imageDiskList[drivenum]), reg_al, xfer);
+            if(last_status != 0x00) {
+                CALLBACK_SCF(true);
+                return CBRET_NONE;
+            }
+        }
         reg_ah = 0x00;
         CALLBACK_SCF(false);
         break;
@@ -2272,10 +2459,19 @@ static Bitu INT13_DiskHandler(void) {
             return CBRET_NONE;
         }
 
+        INT13_SyncFATDrives(imageDiskList[drivenum],false);
+
         segat = dap.seg;
         bufptr = dap.off;
+        xfer = INT13_ReadBatch(imageDiskList[drivenum],dap.sector,dap.num,false);
         for(i=0;i<dap.num;i++) {
-            last_status = imageDiskList[drivenum]->Read_AbsoluteSector(dap.sector+i, sectbuf);
+            if (xfer != NULL) {
+                memcpy(sectbuf,xfer+(i*512),512);
+                last_status = 0x00;
+            }
+            else {
+                last_status = imageDiskList[drivenum]->Read_AbsoluteSector(dap.sector+i, sectbuf);
+            }
 
             if(drivenum < 2)
                 diskio_delay(512, 0); // Floppy
@@ -2316,7 +2512,10 @@ static Bitu INT13_DiskHandler(void) {
             return CBRET_NONE;
         }
 
+        INT13_SyncFATDrives(imageDiskList[drivenum],true);
+
         bufptr = dap.off;
+        xfer = INT13_WriteBatch(imageDiskList[drivenum],dap.num,false);
         for(i=0;i<dap.num;i++) {
             for(t=0;t<imageDiskList[drivenum]->getSectSize();t++) {
                 sectbuf[t] = real_readb(dap.seg,bufptr);
@@ -2328,12 +2527,24 @@ static Bitu INT13_DiskHandler(void) {
             else
                 diskio_delay(512);
 
+            if (xfer != NULL) {
+                memcpy(xfer+(i*imageDiskList[drivenum]->sector_size),sectbuf,imageDiskList[drivenum]->sector_size);
+                continue;
+            }
+
             last_status = imageDiskList[drivenum]->Write_AbsoluteSector(dap.sector+i, &sectbuf[0]);
             if(last_status != 0x00) {
                 CALLBACK_SCF(true);
                 return CBRET_NONE;
             }
         }
+        if (xfer != NULL) {
+            last_status = imageDiskList[drivenum]->Write_Sectors(dap.sector, dap.num, xfer);
+            if(last_status != 0x00) {
+                CALLBACK_SCF(true);
+                return CBRET_NONE;
+            }
+        }
         reg_ah = 0x00;
         CALLBACK_SCF(false);
         break;
@@ -330,11 +330,7 @@ uint8_t imageDiskMemory::Write_AbsoluteSector(uint32_t sectnum, const void * dat
 			//if this is the last chunk, don't read past the end of the original image
 			if ((chunknum + 1) == this->total_chunks) sectorsToCopy = this->total_sectors - chunkFirstSector;
 			//copy the sectors
-			uint8_t* target = datalocation;
-			for (uint32_t i = 0; i < sectorsToCopy; i++) {
-				this->underlyingImage->Read_AbsoluteSector(i + chunkFirstSector, target);
-				datalocation += this->sector_size;
-			}
+			this->underlyingImage->Read_Sectors(chunkFirstSector, sectorsToCopy, datalocation);
 		}
 	}
 
@@ -346,6 +342,73 @@ uint8_t imageDiskMemory::Write_AbsoluteSector(uint32_t sectnum, const void * dat
 	return 0x00;
 }
 
+// Read consecutive sectors from the ramdrive, a whole chunk at a time
+uint8_t imageDiskMemory::Read_Sectors(uint32_t sectnum, uint32_t count, void * data) {
+	//verify the sector range is valid
+	if (sectnum >= total_sectors || count > (total_sectors - sectnum)) {
+		LOG_MSG("Invalid sector number in Read_Sectors for sector %lu.\n", (unsigned long)sectnum);
+		return 0x05;
+	}
+
+	uint8_t* target = (uint8_t*)data;
+	while (count > 0) {
+		uint32_t chunknum = sectnum / sectors_per_chunk;
+		uint32_t chunksect = sectnum % sectors_per_chunk;
+		uint32_t run = sectors_per_chunk - chunksect;
+		if (run > count) run = count;
+
+		uint8_t* datalocation = ChunkMap[chunknum];
+		if (datalocation) {
+			memcpy(target, &datalocation[chunksect * sector_size], (size_t)run * sector_size);
+		}
+		else if (this->underlyingImage) {
+			uint8_t result = this->underlyingImage->Read_Sectors(sectnum, run, target);
+			if (result != 0x00) return result;
+		}
+		else {
+			memset(target, 0, (size_t)run * sector_size);
+		}
+
+		target += (size_t)run * sector_size;
+		sectnum += run;
+		count -= run;
+	}
+	return 0x00;
+}
+
+// Write consecutive sectors to the ramdrive; chunks that still need allocating go through Write_AbsoluteSector
+uint8_t imageDiskMemory::Write_Sectors(uint32_t sectnum, uint32_t count, const void * data) {
+	//verify the sector range is valid
+	if (sectnum >= total_sectors || count > (total_sectors - sectnum)) {
+		LOG_MSG("Invalid sector number in Write_Sectors for sector %lu.\n", (unsigned long)sectnum);
+		return 0x05;
+	}
+
+	const uint8_t* source = (const uint8_t*)data;
+	while (count > 0) {
+		uint32_t chunknum = sectnum / sectors_per_chunk;
+		uint32_t chunksect = sectnum % sectors_per_chunk;
+		uint32_t run = sectors_per_chunk - chunksect;
+		if (run > count) run = count;
+
+		uint8_t* datalocation = ChunkMap[chunknum];
+		if (datalocation) {
+			memcpy(&datalocation[chunksect * sector_size], source, (size_t)run * sector_size);
+		}
+		else {
+			for (uint32_t i = 0; i < run; i++) {
+				uint8_t result = Write_AbsoluteSector(sectnum + i, source + ((size_t)i * sector_size));
+				if (result != 0x00) return result;
+			}
+		}
+
+		source += (size_t)run * sector_size;
+		sectnum += run;
+		count -= run;
+	}
+	return 0x00;
+}
+
 // Partition and format the ramdrive
 uint8_t imageDiskMemory::Format() {
 	//verify that the geometry of the drive is valid
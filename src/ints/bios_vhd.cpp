@@ -29,6 +29,8 @@
 #include "dos_inc.h" /* for Drives[] */
 #include "../dos/drives.h"
 #include "mapper.h"
+#include "timer.h"
+#include "ide.h"
 #include "SDL.h"
 
 /*
@@ -132,12 +134,14 @@ imageDiskVHD::ErrorCodes imageDiskVHD::Open(const char* fileName, const bool rea
 	if ((int64_t)footerPosition < 0LL) { fclose(file); return INVALID_DATA; }
 	VHDFooter originalfooter;
 	VHDFooter footer;
+	bool footerFromHeader = false;
 	if (fread(&originalfooter, 512, 1, file) != 1) { fclose(file); return INVALID_DATA; }
 	//convert from big-endian if necessary
 	footer = originalfooter;
 	footer.SwapByteOrder();
 	//verify checksum on footer
 	if (!footer.IsValid()) {
+		footerFromHeader = true;
 		//if invalid, read header, and verify checksum on header
 		if (fseeko64(file, 0L, SEEK_SET)) { fclose(file); return INVALID_DATA; }
 		if (fread(&originalfooter, sizeof(uint8_t), 512, file) != 512) { fclose(file); return INVALID_DATA; }
@@ -260,8 +264,29 @@ imageDiskVHD::ErrorCodes imageDiskVHD::Open(const char* fileName, const bool rea
 	vhd->blockMapSectors = blockMapSectors;
 	vhd->blockMapSize = blockMapSectors * 512;
 	vhd->sectorsPerBlock = sectorsPerBlock;
-	vhd->currentBlockDirtyMap = (uint8_t*)malloc(vhd->blockMapSize);
-	if (!vhd->currentBlockDirtyMap) { delete vhd; return INVALID_DATA; }
+
+	//keep the BAT in memory; it is only written to when a block gets allocated
+	vhd->blockTable.resize(dynHeader.maxTableEntries);
+	if (dynHeader.maxTableEntries != 0) {
+		if (fseeko64(file, (off_t)dynHeader.tableOffset, SEEK_SET)) { delete vhd; return INVALID_DATA; }
+		if (fread(vhd->blockTable.data(), sizeof(uint32_t), dynHeader.maxTableEntries, file) != dynHeader.maxTableEntries) { delete vhd; return INVALID_DATA; }
+	}
+	for (auto &entry : vhd->blockTable) entry = SDL_SwapBE32(entry);
+
+	//a missing footer means the file was cut short, possibly inside the last block.
+	//New blocks must go after all existing ones.
+	if (footerFromHeader) {
+		uint64_t end = footerPosition + 512;
+		for (const auto &entry : vhd->blockTable) {
+			if (entry == 0xFFFFFFFFul) continue;
+			uint64_t blockEnd = ((((uint64_t)entry * 512ull) + vhd->blockMapSize + dynHeader.blockSize + 511ull) / 512ull) * 512ull;
+			if (end < blockEnd) end = blockEnd;
+		}
+		vhd->footerPosition = end;
+	}
+
+	vhd->blockMapCache.resize(16);
+	for (auto &slot : vhd->blockMapCache) slot.map.resize(vhd->blockMapSize);
 
 	//try loading the first block
 	if (!vhd->loadBlock(0)) {
@@ -403,6 +428,82 @@ uint8_t imageDiskVHD::Read_AbsoluteSector(uint32_t sectnum, void * data) {
 	}
 }
 
+uint8_t imageDiskVHD::Read_Sectors(uint32_t sectnum, uint32_t count, void * data) {
+    if(vhdType == VHD_TYPE_FIXED) return fixedDisk->Read_Sectors(sectnum, count, data);
+	uint8_t* target = (uint8_t*)data;
+	while (count > 0) {
+		uint32_t blockNumber = sectnum / sectorsPerBlock;
+		uint32_t sectorOffset = sectnum % sectorsPerBlock;
+		if (!loadBlock(blockNumber)) return 0x05; //can't load block
+		//take the run of sectors within this block which are all either stored in this image or not
+		bool hasData = currentBlockAllocated && (currentBlockDirtyMap[sectorOffset / 8] & (1 << (7 - (sectorOffset % 8))));
+		uint32_t run = 1;
+		while (run < count && (sectorOffset + run) < sectorsPerBlock) {
+			uint32_t s = sectorOffset + run;
+			bool sectorHasData = currentBlockAllocated && (currentBlockDirtyMap[s / 8] & (1 << (7 - (s % 8))));
+			if (sectorHasData != hasData) break;
+			run++;
+		}
+		if (hasData) {
+			if (fseeko64(diskimg, (off_t)(((uint64_t)currentBlockSectorOffset + blockMapSectors + sectorOffset) * 512ull), SEEK_SET)) return 0x05; //can't seek
+			if (fread(target, 512, run, diskimg) != run) return 0x05; //can't read
+		}
+		else if (parentDisk) {
+			uint8_t result = parentDisk->Read_Sectors(sectnum, run, target);
+			if (result != 0) return result;
+		}
+		else {
+			memset(target, 0, run * 512);
+		}
+		target += run * 512;
+		sectnum += run;
+		count -= run;
+	}
+	return 0;
+}
+
+uint8_t imageDiskVHD::Write_Sectors(uint32_t sectnum, uint32_t count, const void * data) {
+    if(vhdType == VHD_TYPE_FIXED) return fixedDisk->Write_Sectors(sectnum, count, data);
+	const uint8_t* source = (const uint8_t*)data;
+	bool mapChanged = false;
+	while (count > 0) {
+		uint32_t blockNumber = sectnum / sectorsPerBlock;
+		uint32_t sectorOffset = sectnum % sectorsPerBlock;
+		uint32_t run = sectorsPerBlock - sectorOffset;
+		if (run > count) run = count;
+		if (!loadBlock(blockNumber)) return 0x05; //can't load block
+		if (!currentBlockAllocated) {
+			//an unallocated block is kept virtual until written with something other than zeroes
+			bool zeroed = true;
+			for (uint32_t i = 0; i < run && zeroed; i++) zeroed = is_zeroed_sector(source + (i * 512u));
+			if (zeroed && (vhdType != VHD_TYPE_DIFFERENCING || !is_block_allocated(blockNumber))) {
+				source += run * 512;
+				sectnum += run;
+				count -= run;
+				continue;
+			}
+			if (!allocateBlock(blockNumber)) return 0x05;
+		}
+		//mark the sectors as dirty; the bitmap is written back later
+		for (uint32_t i = sectorOffset; i < sectorOffset + run; i++) {
+			uint8_t mask = (uint8_t)(1 << (7 - (i % 8)));
+			if (!(currentBlockDirtyMap[i / 8] & mask)) {
+				currentBlockDirtyMap[i / 8] |= mask;
+				currentBlockMapSlot->dirty = true;
+				mapChanged = true;
+			}
+		}
+		if (fseeko64(diskimg, (off_t)(((uint64_t)currentBlockSectorOffset + (uint64_t)blockMapSectors + (uint64_t)sectorOffset) * 512ull), SEEK_SET)) return 0x05; //can't seek
+		if (fwrite(source, 512, run, diskimg) != run) return 0x05; //can't write
+		source += run * 512;
+		sectnum += run;
+		count -= run;
+	}
+	//until the bitmap is written back, a crash loses these sectors (they read back as before)
+	if (mapChanged) scheduleMetadataFlush();
+	return 0;
+}
+
 bool imageDiskVHD::is_zeroed_sector(const void* data) {
     uint32_t* p = (uint32_t*) data;
     uint8_t* q = ((uint8_t*)data + 512);
@@ -411,73 +512,135 @@ bool imageDiskVHD::is_zeroed_sector(const void* data) {
     return true;
 }
 
+//true if this image or any of its parents stores data for the block
 bool imageDiskVHD::is_block_allocated(uint32_t blockNumber) {
-    if(currentBlockAllocated) return true;
+    if(vhdType == VHD_TYPE_FIXED) return true;
+    if(blockNumber < blockTable.size() && blockTable[blockNumber] != 0xFFFFFFFFul) return true;
     if(parentDisk && ((imageDiskVHD*) parentDisk)->is_block_allocated(blockNumber)) return true;
     return false;
 }
 
 uint8_t imageDiskVHD::Write_AbsoluteSector(uint32_t sectnum, const void * data) {
-    if(vhdType == VHD_TYPE_FIXED) return fixedDisk->Write_AbsoluteSector(sectnum, data);
-	uint32_t blockNumber = sectnum / sectorsPerBlock;
-	uint32_t sectorOffset = sectnum % sectorsPerBlock;
-	if (!loadBlock(blockNumber)) return 0x05; //can't load block
-	if (!currentBlockAllocated) {
-        //an unallocated block is kept virtual until zeroed
-        if(is_zeroed_sector(data)) {
-            if(vhdType != VHD_TYPE_DIFFERENCING) return 0;
-            if(!is_block_allocated(blockNumber)) return 0;
-        }
+	return Write_Sectors(sectnum, 1, data);
+}
 
-		if (!copiedFooter) {
-			//write backup of footer at start of file (should already exist, but we never checked to be sure it is readable or matches the footer we used)
-			if (fseeko64(diskimg, (off_t)0, SEEK_SET)) return 0x05;
-			if (fwrite(&originalFooter, sizeof(uint8_t), 512, diskimg) != 512) return 0x05;
-			copiedFooter = true;
-			//flush the data to disk after writing the backup footer
-			if (fflush(diskimg)) return 0x05;
-		}
-		//calculate new location of footer, and round up to nearest 512 byte increment "just in case"
-        uint64_t newFooterPosition = (((footerPosition + blockMapSize + dynamicHeader.blockSize) + 511ull) / 512ull) * 512ull;
-		//attempt to extend the length appropriately first (on some operating systems this will extend the file)
-		if (fseeko64(diskimg, (off_t)newFooterPosition + 512, SEEK_SET)) return 0x05;
-		//now write the footer
-		if (fseeko64(diskimg, (off_t)newFooterPosition, SEEK_SET)) return 0x05;
-		if (fwrite(&originalFooter, sizeof(uint8_t), 512, diskimg) != 512) return 0x05;
-		//save the new block location and new footer position
-		uint32_t newBlockSectorNumber = (uint32_t)((footerPosition + 511ul) / 512ul);
-		footerPosition = newFooterPosition;
-		//clear the dirty flags for the new footer position
-		for (uint32_t i = 0; i < blockMapSize; i++) currentBlockDirtyMap[i] = 0;
-		//write the dirty map
-		if (fseeko64(diskimg, (off_t)(newBlockSectorNumber * 512ull), SEEK_SET)) return 0x05;
-		if (fwrite(currentBlockDirtyMap, sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return 0x05;
-		//flush the data to disk after expanding the file, before allocating the block in the BAT
-		if (fflush(diskimg)) return 0x05;
-		//update the BAT
-		if (fseeko64(diskimg, (off_t)(dynamicHeader.tableOffset + (blockNumber * 4ull)), SEEK_SET)) return 0x05;
-		uint32_t newBlockSectorNumberBE = SDL_SwapBE32(newBlockSectorNumber);
-		if (fwrite(&newBlockSectorNumberBE, sizeof(uint8_t), 4, diskimg) != 4) return false;
-		currentBlockAllocated = true;
-		currentBlockSectorOffset = newBlockSectorNumber;
-		//flush the data to disk after allocating a block
-		if (fflush(diskimg)) return 0x05;
+//appends a new block to the image and makes it the current block
+bool imageDiskVHD::allocateBlock(const uint32_t blockNumber) {
+	if (!copiedFooter) {
+		//write backup of footer at start of file (should already exist, but we never checked to be sure it is readable or matches the footer we used)
+		if (fseeko64(diskimg, (off_t)0, SEEK_SET)) return false;
+		if (fwrite(&originalFooter, sizeof(uint8_t), 512, diskimg) != 512) return false;
+		copiedFooter = true;
+		//flush the data to disk after writing the backup footer
+		if (fflush(diskimg)) return false;
 	}
-	//current block has now been allocated
-	uint32_t byteNum = sectorOffset / 8;
-	uint32_t bitNum = sectorOffset % 8;
-	bool hasData = currentBlockDirtyMap[byteNum] & (1 << (7 - bitNum));
-	//if the sector hasn't been marked as dirty, mark it as dirty
-	if (!hasData) {
-		currentBlockDirtyMap[byteNum] |= 1 << (7 - bitNum);
-		if (fseeko64(diskimg, (off_t)(currentBlockSectorOffset * 512ull), SEEK_SET)) return 0x05; //can't seek
-		if (fwrite(currentBlockDirtyMap, sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return 0x05;
+	size_t slot;
+	if (!takeBlockMapSlot(slot)) return false;
+	BlockMapSlot &s = blockMapCache[slot];
+	//the new block goes where the footer was. The footer is written behind it first, so that
+	//the file ends with a valid footer at every step
+	uint32_t newBlockSectorNumber = (uint32_t)((footerPosition + 511ul) / 512ul);
+	uint64_t newFooterPosition = (((footerPosition + blockMapSize + dynamicHeader.blockSize) + 511ull) / 512ull) * 512ull;
+	if (fseeko64(diskimg, (off_t)newFooterPosition, SEEK_SET)) return false;
+	if (fwrite(&originalFooter, sizeof(uint8_t), 512, diskimg) != 512) return false;
+	if (fflush(diskimg)) return false;
+	footerPosition = newFooterPosition;
+	//write a clear dirty map, so the block reads back as empty until its bitmap is flushed
+	memset(s.map.data(), 0, blockMapSize);
+	if (fseeko64(diskimg, (off_t)(newBlockSectorNumber * 512ull), SEEK_SET)) return false;
+	if (fwrite(s.map.data(), sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return false;
+	//flush the data to disk after expanding the file, before allocating the block in the BAT
+	if (fflush(diskimg)) return false;
+	//update the BAT
+	if (fseeko64(diskimg, (off_t)(dynamicHeader.tableOffset + (blockNumber * 4ull)), SEEK_SET)) return false;
+	uint32_t newBlockSectorNumberBE = SDL_SwapBE32(newBlockSectorNumber);
+	if (fwrite(&newBlockSectorNumberBE, sizeof(uint8_t), 4, diskimg) != 4) return false;
+	//flush the data to disk after allocating a block
+	if (fflush(diskimg)) return false;
+	blockTable[blockNumber] = newBlockSectorNumber;
+	s.block = blockNumber;
+	s.sectorOffset = newBlockSectorNumber;
+	s.dirty = false;
+	s.lastUsed = ++blockMapClock;
+	currentBlock = blockNumber;
+	currentBlockAllocated = true;
+	currentBlockSectorOffset = newBlockSectorNumber;
+	currentBlockMapSlot = &s;
+	currentBlockDirtyMap = s.map.data();
+	return true;
+}
+
+//picks the least recently used bitmap slot, writing it back first if it was changed
+bool imageDiskVHD::takeBlockMapSlot(size_t &slot) {
+	slot = 0;
+	for (size_t i = 1; i < blockMapCache.size(); i++) {
+		if (blockMapCache[i].lastUsed < blockMapCache[slot].lastUsed) slot = i;
 	}
-	//current sector has now been marked as dirty
-	//write the sector
-	if (fseeko64(diskimg, (off_t)(((uint64_t)currentBlockSectorOffset + (uint64_t)blockMapSectors + (uint64_t)sectorOffset) * 512ull), SEEK_SET)) return 0x05; //can't seek
-	if (fwrite(data, sizeof(uint8_t), 512, diskimg) != 512) return 0x05; //can't write
-	return 0;
+	BlockMapSlot &s = blockMapCache[slot];
+	if (s.dirty && !writeBlockMap(slot)) return false;
+	if (currentBlockMapSlot == &s) {
+		currentBlock = 0xFFFFFFFFul;
+		currentBlockMapSlot = nullptr;
+		currentBlockDirtyMap = nullptr;
+	}
+	s.block = 0xFFFFFFFFul;
+	s.lastUsed = 0;
+	return true;
+}
+
+bool imageDiskVHD::writeBlockMap(size_t slot) {
+	BlockMapSlot &s = blockMapCache[slot];
+	if (fseeko64(diskimg, (off_t)(s.sectorOffset * 512ull), SEEK_SET)) return false;
+	if (fwrite(s.map.data(), sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return false;
+	s.dirty = false;
+	return true;
+}
+
+//writes back changed sector bitmaps
+bool imageDiskVHD::flushMetadata(void) {
+	lastMetadataFlush = GetTicks();
+	bool wrote = false;
+	for (size_t i = 0; i < blockMapCache.size(); i++) {
+		if (!blockMapCache[i].dirty) continue;
+		if (!writeBlockMap(i)) return false;
+		wrote = true;
+	}
+	if (wrote && fflush(diskimg)) return false;
+	return true;
+}
+
+//images with sector bitmaps that are not written back yet
+static std::vector<imageDiskVHD*> vhd_pending_flush;
+
+//writes back changed bitmaps about a second after the last flush of each image,
+//and removes itself when there is nothing left to write
+void imageDiskVHD::metadataFlushTick(void) {
+	const uint32_t now = GetTicks();
+	bool waited = false;
+	for (size_t i = 0; i < vhd_pending_flush.size();) {
+		imageDiskVHD* vhd = vhd_pending_flush[i];
+		if ((uint32_t)(now - vhd->lastMetadataFlush) < 1000u) {
+			i++;
+			continue;
+		}
+		//no IDE read-ahead may use the file while the bitmaps are written
+		if (!waited) {
+			IDE_WaitHostIO();
+			waited = true;
+		}
+		if (!vhd->flushMetadata())
+			LOG_MSG("VHD: could not write back the sector bitmaps of %s", vhd->diskname.c_str());
+		vhd->metadataFlushPending = false;
+		vhd_pending_flush.erase(vhd_pending_flush.begin() + (ptrdiff_t)i);
+	}
+	if (vhd_pending_flush.empty()) TIMER_DelTickHandler(metadataFlushTick);
+}
+
+void imageDiskVHD::scheduleMetadataFlush(void) {
+	if (metadataFlushPending) return;
+	metadataFlushPending = true;
+	if (vhd_pending_flush.empty()) TIMER_AddTickHandler(metadataFlushTick);
+	vhd_pending_flush.push_back(this);
 }
 
 imageDiskVHD::VHDTypes imageDiskVHD::GetVHDType(void) const {
@@ -497,29 +660,52 @@ imageDiskVHD::VHDTypes imageDiskVHD::GetVHDType(const char* fileName) {
 bool imageDiskVHD::loadBlock(const uint32_t blockNumber) {
 	if (currentBlock == blockNumber) return true;
 	if (blockNumber >= dynamicHeader.maxTableEntries) return false;
-	if (fseeko64(diskimg, (off_t)(dynamicHeader.tableOffset + (blockNumber * 4ull)), SEEK_SET)) return false;
-	uint32_t blockSectorOffset;
-	if (fread(&blockSectorOffset, sizeof(uint8_t), 4, diskimg) != 4) return false;
-	blockSectorOffset = SDL_SwapBE32(blockSectorOffset);
+	uint32_t blockSectorOffset = blockTable[blockNumber];
 	if (blockSectorOffset == 0xFFFFFFFFul) {
 		currentBlock = blockNumber;
 		currentBlockAllocated = false;
+		currentBlockMapSlot = nullptr;
+		currentBlockDirtyMap = nullptr;
+		return true;
 	}
-	else {
-		if (fseeko64(diskimg, (off_t)(blockSectorOffset * (uint64_t)512), SEEK_SET)) return false;
-		currentBlock = 0xFFFFFFFFul;
+	for (auto &slot : blockMapCache) {
+		if (slot.block != blockNumber) continue;
+		slot.lastUsed = ++blockMapClock;
+		currentBlock = blockNumber;
 		currentBlockAllocated = true;
 		currentBlockSectorOffset = blockSectorOffset;
-		if (fread(currentBlockDirtyMap, sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return false;
-		currentBlock = blockNumber;
+		currentBlockMapSlot = &slot;
+		currentBlockDirtyMap = slot.map.data();
+		return true;
 	}
+	size_t slot;
+	if (!takeBlockMapSlot(slot)) return false;
+	BlockMapSlot &s = blockMapCache[slot];
+	currentBlock = 0xFFFFFFFFul;
+	if (fseeko64(diskimg, (off_t)(blockSectorOffset * (uint64_t)512), SEEK_SET)) return false;
+	if (fread(s.map.data(), sizeof(uint8_t), blockMapSize, diskimg) != blockMapSize) return false;
+	s.block = blockNumber;
+	s.sectorOffset = blockSectorOffset;
+	s.dirty = false;
+	s.lastUsed = ++blockMapClock;
+	currentBlock = blockNumber;
+	currentBlockAllocated = true;
+	currentBlockSectorOffset = blockSectorOffset;
+	currentBlockMapSlot = &s;
+	currentBlockDirtyMap = s.map.data();
 	return true;
 }
 
 imageDiskVHD::~imageDiskVHD() {
-	if (currentBlockDirtyMap) {
-		free(currentBlockDirtyMap);
-		currentBlockDirtyMap = nullptr;
+	if (vhdType != VHD_TYPE_FIXED && diskimg != NULL && !flushMetadata())
+		LOG_MSG("VHD: could not write back the sector bitmaps of %s", diskname.c_str());
+	if (metadataFlushPending) {
+		for (size_t i = 0; i < vhd_pending_flush.size(); i++) {
+			if (vhd_pending_flush[i] != this) continue;
+			vhd_pending_flush.erase(vhd_pending_flush.begin() + (ptrdiff_t)i);
+			break;
+		}
+		if (vhd_pending_flush.empty()) TIMER_DelTickHandler(metadataFlushTick);
 	}
 	if (parentDisk) {
 		parentDisk->Release();
@@ -980,6 +1166,10 @@ bool imageDiskVHD::MergeSnapshot(uint32_t* totalSectorsMerged, uint32_t* totalBl
         if(blockUpdated) (*totalBlocksUpdated)++;
     }
     LOG_MSG("Merged %d sectors in %d blocks", *totalSectorsMerged, *totalBlocksUpdated);
+    if (! ((imageDiskVHD*)parentDisk)->flushMetadata() ) {
+        LOG_MSG("Couldn't write back the parent's sector bitmaps, merging aborted!");
+        return false;
+    }
     if (! ((imageDiskVHD*)parentDisk)->UpdateUUID() )
         LOG_MSG("Warning: parent UUID not updated, invalid children might remain!");
     return true;
@@ -19,6 +19,8 @@
 
 #include "qcow2_disk.h"
 
+#include <string.h>
+
 #if defined(_MSC_VER)
 # pragma warning(disable:4244) /* const fmath::local::uint64_t to double possible loss of data */
 #endif
@@ -56,7 +58,7 @@ using namespace std;
 
 
 //Public Constructor.
-	QCow2Image::QCow2Image(QCow2Image::QCow2Header& qcow2Header, FILE *qcow2File, const char* imageName, uint32_t sectorSizeBytes) : file(qcow2File), header(qcow2Header), sector_size(sectorSizeBytes), backing_image(NULL)
+	QCow2Image::QCow2Image(QCow2Image::QCow2Header& qcow2Header, FILE *qcow2File, const char* imageName, uint32_t sectorSizeBytes) : file(qcow2File), header(qcow2Header), sector_size(sectorSizeBytes), backing_image(NULL), l2_cache_limit(0), l2_cache_clock(0)
 	{
 		cluster_mask = mask64(header.cluster_bits);
 		cluster_size = cluster_mask + 1;
@@ -66,6 +68,21 @@ using namespace std;
 		l1_bits = header.cluster_bits + l2_bits;
 		refcount_bits = header.cluster_bits - 1;
 		refcount_mask = mask64(refcount_bits);
+		l2_cache_limit = (size_t)(l2_cache_bytes / cluster_size);
+		if (l2_cache_limit < 2){
+			l2_cache_limit = 2;
+		}
+		//The L1 table has one entry per L2 table, so it is small enough to keep in memory. If it cannot be read, entries are read from the file as needed.
+		if (header.l1_size != 0 && header.l1_size <= 0x1000000){
+			l1_table.resize(header.l1_size);
+			if (0 != read_allocated_data(header.l1_table_offset, (uint8_t*)l1_table.data(), (uint64_t)header.l1_size * 8)){
+				clearerr(file);
+				l1_table.clear();
+			}
+			for (size_t i = 0; i < l1_table.size(); i++){
+				l1_table[i] = host_read64(l1_table[i]) & table_entry_mask;
+			}
+		}
 		if (header.backing_file_offset != 0 && header.backing_file_size != 0){
 			char* backing_file_name = new char[header.backing_file_size + 1];
 			backing_file_name[header.backing_file_size] = 0;
@@ -139,67 +156,171 @@ using namespace std;
 	}
 
 
-//Public function to a write a sector.
-	uint8_t QCow2Image::write_sector(uint32_t sectnum, const uint8_t* data){
-		const uint64_t address = (uint64_t)sectnum * sector_size;
-		if (address >= header.size){
-			return 0x05;
-		}
-		uint64_t l2_table_offset;
-		if (0 != read_l1_table(address, l2_table_offset)){
-			return 0x05;
-		}
-		if (0 == l2_table_offset){
-			if (0 != pad_file(l2_table_offset)){
+//Public function to read consecutive sectors. Clusters that follow each other in the image file are read with a single file read.
+	uint8_t QCow2Image::read_sectors(uint32_t sectnum, uint32_t count, uint8_t* data){
+		uint64_t pending_offset = 0;
+		uint64_t pending_size = 0;
+		uint8_t* pending_data = data;
+		while (count > 0){
+			const uint64_t address = (uint64_t)sectnum * sector_size;
+			if (address >= header.size){
 				return 0x05;
 			}
-			if (0 != write_l1_table_entry(address, l2_table_offset)){
-				return 0x05;
+			uint32_t run = (uint32_t)(sectors_per_cluster - ((address & cluster_mask) / sector_size));
+			if (run > count){
+				run = count;
 			}
-			uint8_t* cluster_buffer = new uint8_t[cluster_size];
-			std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
-			if (0 != write_data(l2_table_offset, cluster_buffer, cluster_size)){
-				delete[] cluster_buffer;
+			const uint64_t run_size = (uint64_t)run * sector_size;
+			uint64_t l2_table_offset;
+			if (0 != read_l1_table(address, l2_table_offset)){
 				return 0x05;
 			}
-			if (0 != update_reference_count(l2_table_offset, cluster_buffer)){
-				delete[] cluster_buffer;
+			uint64_t data_cluster_offset = 0;
+			if (0 != l2_table_offset && 0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
 				return 0x05;
 			}
-			delete[] cluster_buffer;
+			if (0 != data_cluster_offset){
+				const uint64_t file_offset = data_cluster_offset + (address & cluster_mask);
+				if (pending_size != 0 && file_offset != pending_offset + pending_size){
+					if (0 != read_allocated_data(pending_offset, pending_data, pending_size)){
+						return 0x05;
+					}
+					pending_size = 0;
+				}
+				if (pending_size == 0){
+					pending_offset = file_offset;
+					pending_data = data;
+				}
+				pending_size += run_size;
+			}
+			else {
+				if (pending_size != 0){
+					if (0 != read_allocated_data(pending_offset, pending_data, pending_size)){
+						return 0x05;
+					}
+					pending_size = 0;
+				}
+				if (backing_image != NULL){
+					if (0 != backing_image->read_sectors(sectnum, run, data)){
+						return 0x05;
+					}
+				}
+				else {
+					std::fill(data, data + run_size, 0);
+				}
+			}
+			data += run_size;
+			sectnum += run;
+			count -= run;
 		}
-		uint64_t data_cluster_offset;
-		if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
-			return 0x05;
+		if (pending_size != 0){
+			return read_allocated_data(pending_offset, pending_data, pending_size);
 		}
-		if (data_cluster_offset == 0){
-			if (0 != pad_file(data_cluster_offset)){
+		return 0;
+	}
+
+
+//Public function to a write a sector.
+	uint8_t QCow2Image::write_sector(uint32_t sectnum, const uint8_t* data){
+		return write_sectors(sectnum, 1, data);
+	}
+
+
+//Public function to write consecutive sectors. A cluster that has to be allocated is written once with all of its new sectors,
+//without reading the old contents if they are all replaced, and allocated clusters that follow each other in the image file
+//are written with a single file write.
+	uint8_t QCow2Image::write_sectors(uint32_t sectnum, uint32_t count, const uint8_t* data){
+		uint64_t pending_offset = 0;
+		uint64_t pending_size = 0;
+		const uint8_t* pending_data = data;
+		while (count > 0){
+			const uint64_t address = (uint64_t)sectnum * sector_size;
+			if (address >= header.size){
 				return 0x05;
 			}
-			if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
-				return 0x05;
+			uint32_t run = (uint32_t)(sectors_per_cluster - ((address & cluster_mask) / sector_size));
+			if (run > count){
+				run = count;
 			}
-			uint8_t* cluster_buffer = new uint8_t[cluster_size];
-			if ( 0 != read_unallocated_cluster(address/cluster_size, cluster_buffer)){
-				delete[] cluster_buffer;
+			const uint64_t run_size = (uint64_t)run * sector_size;
+			uint64_t l2_table_offset;
+			if (0 != read_l1_table(address, l2_table_offset)){
 				return 0x05;
 			}
-			const uint64_t cluster_buffer_sector_offset = address & cluster_mask;
-			for (uint64_t i = 0; i < sector_size; i++){
-				cluster_buffer[cluster_buffer_sector_offset + i] = data[i];
-			}
-			if (0 != write_data(data_cluster_offset, cluster_buffer, cluster_size)){
+			if (0 == l2_table_offset){
+				if (0 != pad_file(l2_table_offset)){
+					return 0x05;
+				}
+				if (0 != write_l1_table_entry(address, l2_table_offset)){
+					return 0x05;
+				}
+				uint8_t* cluster_buffer = new uint8_t[cluster_size];
+				std::fill(cluster_buffer, cluster_buffer + cluster_size, 0);
+				if (0 != write_data(l2_table_offset, cluster_buffer, cluster_size)){
+					delete[] cluster_buffer;
+					return 0x05;
+				}
+				if (0 != update_reference_count(l2_table_offset, cluster_buffer)){
+					delete[] cluster_buffer;
+					return 0x05;
+				}
 				delete[] cluster_buffer;
+			}
+			uint64_t data_cluster_offset;
+			if (0 != read_l2_table(l2_table_offset, address, data_cluster_offset)){
 				return 0x05;
 			}
-			if (0 != update_reference_count(data_cluster_offset, cluster_buffer)){
+			if (data_cluster_offset == 0){
+				if (pending_size != 0){
+					if (0 != write_data(pending_offset, pending_data, pending_size)){
+						return 0x05;
+					}
+					pending_size = 0;
+				}
+				if (0 != pad_file(data_cluster_offset)){
+					return 0x05;
+				}
+				if (0 != write_l2_table_entry(l2_table_offset, address, data_cluster_offset)){
+					return 0x05;
+				}
+				uint8_t* cluster_buffer = new uint8_t[cluster_size];
+				if (run_size < cluster_size && 0 != read_unallocated_cluster(address/cluster_size, cluster_buffer)){
+					delete[] cluster_buffer;
+					return 0x05;
+				}
+				memcpy(cluster_buffer + (address & cluster_mask), data, (size_t)run_size);
+				if (0 != write_data(data_cluster_offset, cluster_buffer, cluster_size)){
+					delete[] cluster_buffer;
+					return 0x05;
+				}
+				if (0 != update_reference_count(data_cluster_offset, cluster_buffer)){
+					delete[] cluster_buffer;
+					return 0x05;
+				}
 				delete[] cluster_buffer;
-				return 0x05;
 			}
-			delete[] cluster_buffer;
-			return 0;
+			else {
+				const uint64_t file_offset = data_cluster_offset + (address & cluster_mask);
+				if (pending_size != 0 && file_offset != pending_offset + pending_size){
+					if (0 != write_data(pending_offset, pending_data, pending_size)){
+						return 0x05;
+					}
+					pending_size = 0;
+				}
+				if (pending_size == 0){
+					pending_offset = file_offset;
+					pending_data = data;
+				}
+				pending_size += run_size;
+			}
+			data += run_size;
+			sectnum += run;
+			count -= run;
+		}
+		if (pending_size != 0){
+			return write_data(pending_offset, pending_data, pending_size);
 		}
-		return write_data(data_cluster_offset + (address & cluster_mask), data, sector_size);
+		return 0;
 	}
 
 
@@ -207,6 +328,7 @@ using namespace std;
 	const uint64_t QCow2Image::copy_flag = 0x8000000000000000;
 	const uint64_t QCow2Image::empty_mask = 0xFFFFFFFFFFFFFFFF;
 	const uint64_t QCow2Image::table_entry_mask = 0x00FFFFFFFFFFFFFF;
+	const uint64_t QCow2Image::l2_cache_bytes = 2 * 1024 * 1024;
 
 
 //Helper functions for endianness. QCOW format is big endian so we need different functions than those defined in mem.h.
@@ -307,6 +429,11 @@ using namespace std;
 
 //Read the L1 table to get the offset of the L2 table for a given address.
 	inline uint8_t QCow2Image::read_l1_table(uint64_t address, uint64_t& l2_table_offset){
+		const uint64_t l1_index = address >> l1_bits;
+		if (l1_index < l1_table.size()){
+			l2_table_offset = l1_table[l1_index];
+			return 0;
+		}
 		const uint64_t l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
 		return read_table(l1_entry_offset, table_entry_mask, l2_table_offset);
 	}
@@ -314,8 +441,44 @@ using namespace std;
 
 //Read an L2 table to get the offset of the data cluster for a given address.
 	inline uint8_t QCow2Image::read_l2_table(uint64_t l2_table_offset, uint64_t address, uint64_t& data_cluster_offset){
-		const uint64_t l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return read_table(l2_entry_offset, table_entry_mask, data_cluster_offset);
+		const uint64_t* l2_table = get_l2_table(l2_table_offset);
+		if (l2_table == NULL){
+			return 0x05;
+		}
+		data_cluster_offset = l2_table[(address >> header.cluster_bits) & l2_mask];
+		return 0;
+	}
+
+
+//Get an L2 table from the cache, loading it in place of the least recently used one if needed.
+	const uint64_t* QCow2Image::get_l2_table(uint64_t l2_table_offset){
+		L2CacheEntry* victim = NULL;
+		for (size_t i = 0; i < l2_cache.size(); i++){
+			if (l2_cache[i].table_offset == l2_table_offset){
+				l2_cache[i].last_used = ++l2_cache_clock;
+				return l2_cache[i].entries.data();
+			}
+			if (victim == NULL || l2_cache[i].last_used < victim->last_used){
+				victim = &l2_cache[i];
+			}
+		}
+		if (l2_cache.size() < l2_cache_limit){
+			l2_cache.push_back(L2CacheEntry());
+			victim = &l2_cache.back();
+			victim->entries.resize((size_t)(cluster_size >> 3));
+		}
+		//Offset 0 holds the header, so it never is an L2 table and marks an unused cache entry.
+		victim->table_offset = 0;
+		victim->last_used = 0;
+		if (0 != read_allocated_data(l2_table_offset, (uint8_t*)victim->entries.data(), cluster_size)){
+			return NULL;
+		}
+		for (size_t i = 0; i < victim->entries.size(); i++){
+			victim->entries[i] = host_read64(victim->entries[i]) & table_entry_mask;
+		}
+		victim->table_offset = l2_table_offset;
+		victim->last_used = ++l2_cache_clock;
+		return victim->entries.data();
 	}
 
 
@@ -399,14 +562,29 @@ using namespace std;
 //Write an L2 table offset into the L1 table.
 	inline uint8_t QCow2Image::write_l1_table_entry(uint64_t address, uint64_t l2_table_offset){
 		const uint64_t l1_entry_offset = header.l1_table_offset + ((address >> l1_bits) << 3);
-		return write_table_entry(l1_entry_offset, l2_table_offset | copy_flag);
+		if (0 != write_table_entry(l1_entry_offset, l2_table_offset | copy_flag)){
+			return 0x05;
+		}
+		if ((address >> l1_bits) < l1_table.size()){
+			l1_table[address >> l1_bits] = l2_table_offset & table_entry_mask;
+		}
+		return 0;
 	}
 
 
 //Write a data cluster offset into an L2 table.
 	inline uint8_t QCow2Image::write_l2_table_entry(uint64_t l2_table_offset, uint64_t address, uint64_t data_cluster_offset){
-		const uint64_t l2_entry_offset = l2_table_offset + (((address >> header.cluster_bits) & l2_mask) << 3);
-		return write_table_entry(l2_entry_offset, data_cluster_offset | copy_flag);
+		const uint64_t l2_index = (address >> header.cluster_bits) & l2_mask;
+		if (0 != write_table_entry(l2_table_offset + (l2_index << 3), data_cluster_offset | copy_flag)){
+			return 0x05;
+		}
+		for (size_t i = 0; i < l2_cache.size(); i++){
+			if (l2_cache[i].table_offset == l2_table_offset){
+				l2_cache[i].entries[l2_index] = data_cluster_offset & table_entry_mask;
+				break;
+			}
+		}
+		return 0;
 	}
 
 
@@ -452,3 +630,15 @@ using namespace std;
 	uint8_t QCow2Disk::Write_AbsoluteSector(uint32_t sectnum,const void* data){
 		return qcowImage.write_sector(sectnum, (const uint8_t*)data);
 	}
+
+
+//Public function to read consecutive sectors.
+	uint8_t QCow2Disk::Read_Sectors(uint32_t sectnum, uint32_t count, void* data){
+		return qcowImage.read_sectors(sectnum, count, (uint8_t*)data);
+	}
+
+
+//Public function to write consecutive sectors.
+	uint8_t QCow2Disk::Write_Sectors(uint32_t sectnum, uint32_t count, const void* data){
+		return qcowImage.write_sectors(sectnum, count, (const uint8_t*)data);
+	}
@@ -26,10 +26,32 @@
 #include <stdint.h>
 #include <string.h>
 #include <math.h>
+#include <limits.h>
 #include <png.h>
 
 #include "zmbv.h"
 
+#if defined(__SSE2__) || defined(_M_AMD64) || defined(_M_X64)
+# include <emmintrin.h>
+# define ZMBV_SSE2 1
+#endif
+
+/* AVX2 is chosen at runtime, from the CPU check in dosbox.cpp */
+#if defined(ZMBV_SSE2) && defined(__GNUC__) && defined(__SSE__) && !(defined(_M_AMD64) || defined(__e2k__))
+# include <immintrin.h>
+# define ZMBV_AVX2 1
+extern bool avx2_available;
+#endif
+
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define ZMBV_THREADS 1
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <atomic>
+# include <vector>
+#endif
+
 #define DBZV_VERSION_HIGH 0
 #define DBZV_VERSION_LOW 1
 
@@ -94,7 +116,7 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 	buf2 = new unsigned char[bufsize];
 	work = new unsigned char[bufsize];
 
-	int xblocks = (width/blockwidth);
+	xblocks = (width/blockwidth);
 	int xleft = width % blockwidth;
 	if (xleft) xblocks++;
 	int yblocks = (height/blockheight);
@@ -102,8 +124,10 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 	if (yleft) yblocks++;
 	blockcount=yblocks*xblocks;
 	blocks=new FrameBlock[blockcount];
+	blockchanged=new unsigned char[blockcount];
+	linesame=new unsigned char[height];
 
-	if (!buf1 || !buf2 || !work || !blocks) {
+	if (!buf1 || !buf2 || !work || !blocks || !blockchanged || !linesame) {
 		FreeBuffers();
 		return false;
 	}
@@ -123,10 +147,13 @@ bool VideoCodec::SetupBuffers(zmbv_format_t _format, int blockwidth, int blockhe
 			} else {
 				blocks[i].dy=blockheight;
 			}
+			blocks[i].vx=blocks[i].vy=blocks[i].change=0;
 			i++;
 		}
 	}
 
+	memset(blockchanged,1,(unsigned int)blockcount);
+	memset(linesame,1,(unsigned int)height);
 	memset(buf1,0,(unsigned int)bufsize);
 	memset(buf2,0,(unsigned int)bufsize);
 	memset(work,0,(unsigned int)bufsize);
@@ -152,6 +179,77 @@ void VideoCodec::CreateVectorTable(void) {
 	}
 }
 
+static INLINE int zmbv_popcount(unsigned int v) {
+#if defined(__GNUC__)
+	return __builtin_popcount(v);
+#else
+	v = v - ((v >> 1) & 0x55555555u);
+	v = (v & 0x33333333u) + ((v >> 2) & 0x33333333u);
+	return (int)((((v + (v >> 4)) & 0x0f0f0f0fu) * 0x01010101u) >> 24);
+#endif
+}
+
+/* Counts the pixels of a row that differ. The alpha byte of 32bpp pixels is ignored,
+ * as the scalar compare always did, since the output depends on these counts. */
+template<class P>
+static INLINE int zmbv_diff_row(const P *pold,const P *pnew,int count) {
+	int ret=0,x=0;
+#if defined(ZMBV_SSE2)
+	const int step=16/(int)sizeof(P);
+	const __m128i mask=_mm_set1_epi32(sizeof(P) == 4 ? 0x00ffffff : -1);
+	const __m128i zero=_mm_setzero_si128();
+	for (;x+step<=count;x+=step) {
+		const __m128i d=_mm_and_si128(_mm_xor_si128(_mm_loadu_si128((const __m128i*)(pold+x)),_mm_loadu_si128((const __m128i*)(pnew+x))),mask);
+		__m128i same;
+		if (sizeof(P) == 1) same=_mm_cmpeq_epi8(d,zero);
+		else if (sizeof(P) == 2) same=_mm_cmpeq_epi16(d,zero);
+		else same=_mm_cmpeq_epi32(d,zero);
+		ret+=(16-zmbv_popcount((unsigned int)_mm_movemask_epi8(same)))/(int)sizeof(P);
+	}
+#endif
+	for (;x<count;x++)
+		ret+=(((uint32_t)(pold[x]^pnew[x]) & 0x00ffffffu) != 0) ? 1 : 0;
+	return ret;
+}
+
+static INLINE void zmbv_xor_row(unsigned char *dst,const unsigned char *pold,const unsigned char *pnew,int count) {
+	int x=0;
+#if defined(ZMBV_SSE2)
+	for (;x+16<=count;x+=16)
+		_mm_storeu_si128((__m128i*)(dst+x),_mm_xor_si128(_mm_loadu_si128((const __m128i*)(pold+x)),_mm_loadu_si128((const __m128i*)(pnew+x))));
+#endif
+	for (;x<count;x++)
+		dst[x]=pnew[x]^pold[x];
+}
+
+#if defined(ZMBV_AVX2)
+template<class P>
+__attribute__((__target__("avx2")))
+static int zmbv_diff_row_avx2(const P *pold,const P *pnew,int count) {
+	int ret=0,x=0;
+	const int step=32/(int)sizeof(P);
+	const __m256i mask=_mm256_set1_epi32(sizeof(P) == 4 ? 0x00ffffff : -1);
+	const __m256i zero=_mm256_setzero_si256();
+	for (;x+step<=count;x+=step) {
+		const __m256i d=_mm256_and_si256(_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pold+x)),_mm256_loadu_si256((const __m256i*)(pnew+x))),mask);
+		__m256i same;
+		if (sizeof(P) == 1) same=_mm256_cmpeq_epi8(d,zero);
+		else if (sizeof(P) == 2) same=_mm256_cmpeq_epi16(d,zero);
+		else same=_mm256_cmpeq_epi32(d,zero);
+		ret+=(32-zmbv_popcount((unsigned int)_mm256_movemask_epi8(same)))/(int)sizeof(P);
+	}
+	return ret+zmbv_diff_row<P>(pold+x,pnew+x,count-x);
+}
+
+__attribute__((__target__("avx2")))
+static void zmbv_xor_row_avx2(unsigned char *dst,const unsigned char *pold,const unsigned char *pnew,int count) {
+	int x=0;
+	for (;x+32<=count;x+=32)
+		_mm256_storeu_si256((__m256i*)(dst+x),_mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(pold+x)),_mm256_loadu_si256((const __m256i*)(pnew+x))));
+	zmbv_xor_row(dst+x,pold+x,pnew+x,count-x);
+}
+#endif
+
 template<class P>
 INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 	int ret=0;
@@ -162,22 +260,27 @@ INLINE int VideoCodec::PossibleBlock(int vx,int vy,FrameBlock * block) {
 			int test=0-(int)((pold[x]-pnew[x])&0x00ffffffu);
 			ret-=(test>>31);
 		}
+		/* the caller only checks for less than 4 */
+		if (ret>=4) break;
 		pold+=pitch*4;
 		pnew+=pitch*4;
 	}
 	return ret;
 }
 
+/* stops counting once limit is reached, since the caller only looks for a smaller count */
 template<class P>
-INLINE int VideoCodec::CompareBlock(int vx,int vy,FrameBlock * block) {
+INLINE int VideoCodec::CompareBlock(int vx,int vy,FrameBlock * block,int limit) {
 	int ret=0;
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;;	
-	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			int test=0-(int)((pold[x]-pnew[x])&0x00ffffffu);
-			ret-=(test>>31);
-		}
+	for (int y=0;y<block->dy && ret<limit;y++) {
+#if defined(ZMBV_AVX2)
+		if (avx2_available)
+			ret+=zmbv_diff_row_avx2<P>(pold,pnew,block->dx);
+		else
+#endif
+			ret+=zmbv_diff_row<P>(pold,pnew,block->dx);
 		pold+=pitch;
 		pnew+=pitch;
 	}
@@ -188,30 +291,34 @@ template<class P>
 INLINE void VideoCodec::AddXorBlock(int vx,int vy,FrameBlock * block) {
 	P * pold=((P*)oldframe)+block->start+(vy*pitch)+vx;
 	P * pnew=((P*)newframe)+block->start;
+	const int rowBytes=block->dx*(int)sizeof(P);
 	for (int y=0;y<block->dy;y++) {
-		for (int x=0;x<block->dx;x++) {
-			*((P*)&work[workUsed])=pnew[x] ^ pold[x];
-			workUsed+=(int)sizeof(P);
-		}
+#if defined(ZMBV_AVX2)
+		if (avx2_available)
+			zmbv_xor_row_avx2(&work[workUsed],(const unsigned char*)pold,(const unsigned char*)pnew,rowBytes);
+		else
+#endif
+			zmbv_xor_row(&work[workUsed],(const unsigned char*)pold,(const unsigned char*)pnew,rowBytes);
+		workUsed+=rowBytes;
 		pold+=pitch;
 		pnew+=pitch;
 	}
 }
 
+/* motion search for the changed blocks of one row of blocks */
 template<class P>
-void VideoCodec::AddXorFrame(void) {
-//	int written=0;
-//	int lastvector=0;
-	signed char * vectors=(signed char*)&work[workUsed];
-	/* Align the following xor data on 4 byte boundary*/
-	workUsed=(workUsed + blockcount*2 +3) & ~3;
-//	int totalx=0;
-//	int totaly=0;
-	for (int b=0;b<blockcount;b++) {
+void VideoCodec::SearchBlockRow(int row) {
+	const int end=(row+1)*xblocks;
+	for (int b=row*xblocks;b<end;b++) {
 		FrameBlock * block=&blocks[b];
+		block->vx = 0;
+		block->vy = 0;
+		block->change = 0;
+		/* unchanged since the last frame, so the zero vector is an exact match */
+		if (!blockchanged[b]) continue;
 		int bestvx = 0;
 		int bestvy = 0;
-		int bestchange=CompareBlock<P>(0,0, block);
+		int bestchange=CompareBlock<P>(0,0, block, INT_MAX);
 		int possibles=64;
 		for (int v=0;v<VectorCount && possibles;v++) {
 			if (bestchange<4) break;
@@ -220,7 +327,7 @@ void VideoCodec::AddXorFrame(void) {
 			if (PossibleBlock<P>(vx, vy, block) < 4) {
 				possibles--;
 //				if (!possibles) Msg("Ran out of possibles, at %d of %d best %d\n",v,VectorCount,bestchange);
-				int testchange=CompareBlock<P>(vx,vy, block);
+				int testchange=CompareBlock<P>(vx,vy, block, bestchange);
 				if (testchange<bestchange) {
 					bestchange=testchange;
 					bestvx = vx;
@@ -228,11 +335,211 @@ void VideoCodec::AddXorFrame(void) {
 				}
 			}
 		}
-		vectors[b*2+0]=(bestvx << 1);
-		vectors[b*2+1]=(bestvy << 1);
-		if (bestchange) {
+		block->vx = bestvx;
+		block->vy = bestvy;
+		block->change = bestchange;
+	}
+}
+
+#if defined(ZMBV_THREADS)
+/* Helper threads for the motion search, which take one row of blocks at a time. A row only
+ * reads the two frames and writes the results of its own blocks, and the XOR data is written
+ * out in block order afterwards, so the output is the same for any number of threads.
+ * Keyframes are deflated on the same threads, one chunk per job. */
+struct VideoCodec::HelperThreads {
+	std::vector<std::thread>	threads;
+	std::mutex			lock;
+	std::condition_variable		start,finished;
+	VideoCodec *			codec = nullptr;
+	void (VideoCodec::*job)(int) = nullptr;
+	std::atomic<int>		nextJob{0};
+	int				jobs = 0;
+	int				busy = 0;
+	unsigned int			generation = 0;
+	bool				stopping = false;
+
+	HelperThreads() {
+		/* leave room for emulation and the rest of the capture pipeline */
+		unsigned int n = std::thread::hardware_concurrency() / 2;
+		if (n > 4) n = 4;
+		for (unsigned int i=1;i<n;i++)
+			threads.emplace_back(&HelperThreads::Loop,this);
+	}
+
+	~HelperThreads() {
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stopping = true;
+		}
+		start.notify_all();
+		for (auto &t : threads) t.join();
+	}
+
+	bool Run(VideoCodec *c,void (VideoCodec::*j)(int),int count) {
+		if (threads.empty()) return false;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			codec = c;
+			job = j;
+			jobs = count;
+			nextJob = 0;
+			busy = (int)threads.size();
+			generation++;
+		}
+		start.notify_all();
+		Work();
+		std::unique_lock<std::mutex> guard(lock);
+		finished.wait(guard,[this]{ return busy == 0; });
+		return true;
+	}
+
+	void Work(void) {
+		int j;
+		while ((j = nextJob++) < jobs)
+			(codec->*job)(j);
+	}
+
+	void Loop(void) {
+		unsigned int seen = 0;
+		std::unique_lock<std::mutex> guard(lock);
+		while (true) {
+			start.wait(guard,[this,&seen]{ return stopping || generation != seen; });
+			if (stopping) break;
+			seen = generation;
+			guard.unlock();
+			Work();
+			guard.lock();
+			if (--busy == 0) finished.notify_one();
+		}
+	}
+};
+#endif
+
+/* Keyframes are deflated in chunks, pigz style: each chunk is raw deflate data primed with
+ * the 32KB before it and ended with a sync flush, so the chunks join into one stream that
+ * any zlib inflate, and so any ZMBV decoder, reads as usual. */
+struct VideoCodec::KeyframeChunk {
+	z_stream	zs;
+	bool		ready;
+	bool		ok;
+	int		start, size, used;
+	unsigned char *	out;
+	int		outsize;
+};
+
+/* smaller keyframes are not worth waking the helper threads for */
+#define KEYFRAME_CHUNK_MIN	(128*1024)
+
+void VideoCodec::RunJobs(void (VideoCodec::*job)(int), int count, bool parallel) {
+#if defined(ZMBV_THREADS)
+	if (parallel && count > 1) {
+		if (helpers == nullptr) helpers = new HelperThreads();
+		if (helpers->Run(this, job, count)) return;
+	}
+#else
+	(void)parallel;
+#endif
+	for (int i=0;i<count;i++)
+		(this->*job)(i);
+}
+
+void VideoCodec::DeflateChunk(int chunk) {
+	KeyframeChunk &k = chunks[chunk];
+	k.ok = false;
+	if (!k.ready) {
+		memset(&k.zs, 0, sizeof(k.zs));
+		if (deflateInit2(&k.zs, 4, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			return;
+		k.ready = true;
+	} else {
+		deflateReset(&k.zs);
+	}
+	if (k.start > 0) {
+		const int dict = k.start < 32768 ? k.start : 32768;
+		deflateSetDictionary(&k.zs, (const Bytef *)&work[k.start - dict], (uInt)dict);
+	}
+	/* room for the sync flush marker as well */
+	const int need = (int)deflateBound(&k.zs, (uLong)k.size) + 64;
+	if (k.outsize < need) {
+		delete[] k.out;
+		k.out = new unsigned char[need];
+		k.outsize = need;
+	}
+	k.zs.next_in = (Bytef *)&work[k.start];
+	k.zs.avail_in = (uInt)k.size;
+	k.zs.next_out = (Bytef *)k.out;
+	k.zs.avail_out = (uInt)k.outsize;
+	k.ok = deflate(&k.zs, Z_SYNC_FLUSH) == Z_OK && k.zs.avail_in == 0;
+	k.used = k.outsize - (int)k.zs.avail_out;
+}
+
+bool VideoCodec::DeflateKeyframe(void) {
+#if defined(ZMBV_THREADS)
+	if (workUsed < 2*KEYFRAME_CHUNK_MIN) return false;
+	if (helpers == nullptr) helpers = new HelperThreads();
+	if (helpers->threads.empty()) return false;
+	if (chunks == nullptr) {
+		chunkcount = (int)helpers->threads.size() + 1;
+		chunks = new KeyframeChunk[chunkcount];
+		for (int c=0;c<chunkcount;c++) {
+			chunks[c].ready = false;
+			chunks[c].out = nullptr;
+			chunks[c].outsize = 0;
+		}
+	}
+	int count = workUsed / KEYFRAME_CHUNK_MIN;
+	if (count > chunkcount) count = chunkcount;
+	const int size = (workUsed + count - 1) / count;
+	for (int c=0;c<count;c++) {
+		chunks[c].start = c * size;
+		chunks[c].size = (c == count-1) ? workUsed - c * size : size;
+	}
+	RunJobs(&VideoCodec::DeflateChunk, count, true);
+
+	int total = 0;
+	for (int c=0;c<count;c++) {
+		if (!chunks[c].ok) return false;
+		total += chunks[c].used;
+	}
+	if (total > compress.writeSize - compress.writeDone) return false;
+	for (int c=0;c<count;c++) {
+		memcpy(compress.writeBuf + compress.writeDone, chunks[c].out, (size_t)chunks[c].used);
+		compress.writeDone += chunks[c].used;
+	}
+	/* the following delta frames continue the stream from the end of this keyframe */
+	const int dict = workUsed < 32768 ? workUsed : 32768;
+	deflateReset(&zstream);
+	deflateSetDictionary(&zstream, (const Bytef *)&work[workUsed - dict], (uInt)dict);
+	return true;
+#else
+	return false;
+#endif
+}
+
+template<class P>
+void VideoCodec::AddXorFrame(void) {
+//	int written=0;
+//	int lastvector=0;
+	signed char * vectors=(signed char*)&work[workUsed];
+	/* Align the following xor data on 4 byte boundary*/
+	workUsed=(workUsed + blockcount*2 +3) & ~3;
+//	int totalx=0;
+//	int totaly=0;
+	/* lines that were not given this frame were not checked for changes */
+	if (compress.linesDone < height)
+		memset(blockchanged,1,(unsigned int)blockcount);
+	int changed=0;
+	for (int b=0;b<blockcount;b++)
+		changed+=blockchanged[b];
+	/* a few changed blocks are searched faster than the threads are woken up */
+	RunJobs(&VideoCodec::SearchBlockRow<P>, blockcount / xblocks, changed >= 64);
+	for (int b=0;b<blockcount;b++) {
+		FrameBlock * block=&blocks[b];
+		vectors[b*2+0]=(block->vx << 1);
+		vectors[b*2+1]=(block->vy << 1);
+		if (block->change) {
 			vectors[b*2+0]|=1;
-			AddXorBlock<P>(bestvx, bestvy, block);
+			AddXorBlock<P>(block->vx, block->vy, block);
 		}
 	}
 }
@@ -242,7 +549,9 @@ bool VideoCodec::SetupCompress( int _width, int _height ) {
 	height = _height;
 	pitch = _width + 2*MAX_VECTOR;
 	format = ZMBV_FORMAT_NONE;
-	if (deflateInit (&zstream, 4) != Z_OK)
+	/* raw deflate, with the zlib header written at each keyframe, so that keyframes can
+	 * also be deflated in chunks; the output is the same as with deflateInit(4) */
+	if (deflateInit2 (&zstream, 4, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
 		return false;
 	return true;
 }
@@ -270,6 +579,7 @@ bool VideoCodec::PrepareCompressFrame(int flags,  zmbv_format_t _format, char *
 	unsigned char *copyFrame = newframe;
 	newframe = oldframe;
 	oldframe = copyFrame;
+	memset(blockchanged,0,(unsigned int)blockcount);
 
 	compress.linesDone = 0;
 	compress.writeSize = writeSize;
@@ -304,8 +614,10 @@ bool VideoCodec::PrepareCompressFrame(int flags,  zmbv_format_t _format, char *
 				work[workUsed++] = (unsigned char)palette[i*4+2];
 			}
 		}
-		/* Restart deflate */
+		/* Restart deflate, with the zlib header deflateInit(4) would write */
 		deflateReset(&zstream);
+		compress.writeBuf[compress.writeDone++] = 0x78;
+		compress.writeBuf[compress.writeDone++] = 0x5e;
 	} else {
 		if (palsize && pal && memcmp(pal, palette, (unsigned int)palsize * 4u)) {
 			*firstByte |= Mask_DeltaPalette;
@@ -327,6 +639,37 @@ void VideoCodec::CompressLines(int lineCount, void *lineData[]) {
 	unsigned char *destStart = newframe + pixelsize*(MAX_VECTOR+(compress.linesDone+MAX_VECTOR)*pitch);
 	while ( i < lineCount && (compress.linesDone < height)) {
 		memcpy(destStart, lineData[i], (size_t)lineWidth );
+		/* note which blocks differ from the last frame while the line is still in cache,
+		 * so that motion search can skip the unchanged ones */
+		const unsigned char *oldStart = oldframe + (destStart - newframe);
+		linesame[compress.linesDone] = 1;
+		if (memcmp(destStart, oldStart, (size_t)lineWidth)) {
+			linesame[compress.linesDone] = 0;
+			unsigned char *changed = blockchanged + (compress.linesDone / blocks[0].dy) * xblocks;
+			int pos = 0;
+			for (int x=0;x<xblocks;x++) {
+				const int bytes = blocks[x].dx * pixelsize;
+				if (!changed[x] && memcmp(destStart + pos, oldStart + pos, (size_t)bytes)) changed[x] = 1;
+				pos += bytes;
+			}
+		}
+		destStart += linePitch;
+		i++;compress.linesDone++;
+	}
+}
+
+/* The lines are the same as in the previous frame. Nothing is compared, and the line is
+ * only copied if the frame buffer being filled holds an older version of it. */
+void VideoCodec::SkipLines(int lineCount) {
+	int linePitch = pitch * pixelsize;
+	int lineWidth = width * pixelsize;
+	int i = 0;
+	unsigned char *destStart = newframe + pixelsize*(MAX_VECTOR+(compress.linesDone+MAX_VECTOR)*pitch);
+	while ( i < lineCount && (compress.linesDone < height)) {
+		if (!linesame[compress.linesDone]) {
+			memcpy(destStart, oldframe + (destStart - newframe), (size_t)lineWidth );
+			linesame[compress.linesDone] = 1;
+		}
 		destStart += linePitch;
 		i++;compress.linesDone++;
 	}
@@ -343,6 +686,8 @@ int VideoCodec::FinishCompressFrame( void ) {
 			readFrame += pitch*pixelsize;
 			workUsed += width*pixelsize;
 		}
+		if (DeflateKeyframe())
+			return (int)compress.writeDone;
 	} else {
 		/* Add the delta frame data */
 		switch (format) {
@@ -540,6 +885,14 @@ void VideoCodec::FreeBuffers(void) {
 		delete[] blocks;
 		blocks = nullptr;
 	}
+	if (blockchanged) {
+		delete[] blockchanged;
+		blockchanged = nullptr;
+	}
+	if (linesame) {
+		delete[] linesame;
+		linesame = nullptr;
+	}
 	if (buf1) {
 		delete[] buf1;
 		buf1 = nullptr;
@@ -558,10 +911,28 @@ void VideoCodec::FreeBuffers(void) {
 VideoCodec::VideoCodec() {
 	CreateVectorTable();
 	blocks = nullptr;
+	blockchanged = nullptr;
+	linesame = nullptr;
+	xblocks = 0;
+	helpers = nullptr;
+	chunks = nullptr;
+	chunkcount = 0;
 	buf1 = nullptr;
 	buf2 = nullptr;
 	work = nullptr;
 	memset( &zstream, 0, sizeof(zstream));
 }
 
+VideoCodec::~VideoCodec() {
+#if defined(ZMBV_THREADS)
+	delete helpers;
+#endif
+	for (int c=0;c<chunkcount;c++) {
+		if (chunks[c].ready) deflateEnd(&chunks[c].zs);
+		delete[] chunks[c].out;
+	}
+	delete[] chunks;
+	FreeBuffers();
+}
+
 #endif //(C_SSHOT)
@@ -46,6 +46,7 @@ private:
 	struct FrameBlock {
 		int start;
 		int dx,dy;
+		int vx,vy,change;	/* motion search result, when compressing */
 	};
 	struct CodecVector {
 		int x,y;
@@ -75,6 +76,15 @@ private:
 
 	int blockcount; 
 	FrameBlock * blocks;
+	int xblocks;
+	unsigned char * blockchanged;	/* blocks whose pixels differ from the previous frame */
+	unsigned char * linesame;	/* lines that are the same in both frame buffers */
+
+	struct HelperThreads;
+	HelperThreads * helpers;	/* motion search and keyframe deflate */
+	struct KeyframeChunk;
+	KeyframeChunk * chunks;
+	int chunkcount;
 
 	int workUsed, workPos;
 
@@ -93,12 +103,17 @@ private:
 
 	template<class P>
 		void AddXorFrame(void);
+	template<class P>
+		void SearchBlockRow(int row);
+	void RunJobs(void (VideoCodec::*job)(int), int count, bool parallel);
+	void DeflateChunk(int chunk);
+	bool DeflateKeyframe(void);
 	template<class P>
 		void UnXorFrame(void);
 	template<class P>
 		INLINE int PossibleBlock(int vx,int vy,FrameBlock * block);
 	template<class P>
-		INLINE int CompareBlock(int vx,int vy,FrameBlock * block);
+		INLINE int CompareBlock(int vx,int vy,FrameBlock * block,int limit);
 	template<class P>
 		INLINE void AddXorBlock(int vx,int vy,FrameBlock * block);
 	template<class P>
@@ -107,12 +122,14 @@ private:
 		INLINE void CopyBlock(int vx, int vy,FrameBlock * block);
 public:
 	VideoCodec();
+	~VideoCodec();
 	bool SetupCompress( int _width, int _height);
 	bool SetupDecompress( int _width, int _height);
 	zmbv_format_t BPPFormat( int bpp );
 	int NeededSize( int _width, int _height, zmbv_format_t _format);
 
 	void CompressLines(int lineCount, void *lineData[]);
+	void SkipLines(int lineCount);	/* lines unchanged since the previous frame */
 	bool PrepareCompressFrame(int flags,  zmbv_format_t _format, char * pal, void *writeBuf, int writeSize);
 	int FinishCompressFrame( void );
 	bool DecompressFrame(void * framedata, int size);
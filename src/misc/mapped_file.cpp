@@ -0,0 +1,164 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/* Read-only memory mapping of host files (disk and CD-ROM images) */
+
+#include "dosbox.h"
+#include "logging.h"
+#include "mapped_file.h"
+
+#include <string.h>
+
+#if defined(WIN32) && !defined(HX_DOS)
+# include <windows.h>
+#elif !defined(WIN32) && C_HAVE_MMAP
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+# define MAPPED_FILE_POSIX 1
+#endif
+
+bool MappedFile::enabled = false;
+MappedFile::Advice MappedFile::advice = MappedFile::ADVICE_NORMAL;
+bool MappedFile::hugepages = false;
+
+MappedFile::~MappedFile() {
+    Unmap();
+}
+
+#if defined(MAPPED_FILE_POSIX)
+static const uint8_t *MapDescriptor(int fd, uint64_t &size) {
+    struct stat st;
+
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) return NULL;
+    if ((uint64_t)st.st_size > (uint64_t)(SIZE_MAX / 2)) return NULL; /* does not fit in the address space of 32-bit hosts */
+
+    void *p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return NULL;
+
+    size = (uint64_t)st.st_size;
+    return (const uint8_t*)p;
+}
+#endif
+
+bool MappedFile::Map(FILE *fp) {
+    Unmap();
+    if (fp == NULL) return false;
+
+#if defined(MAPPED_FILE_POSIX)
+    const int fd = fileno(fp);
+    const int fl = fcntl(fd, F_GETFL);
+    if (fl < 0 || (fl & O_ACCMODE) != O_RDONLY) return false;
+
+    base = MapDescriptor(fd, size);
+    if (base == NULL) return false;
+
+    ApplyAdvice();
+    return true;
+#else
+    /* the access mode of a stdio stream cannot be queried on Windows, so only files
+     * opened by name through Map(const char*) are mapped there */
+    return false;
+#endif
+}
+
+bool MappedFile::Map(const char *path) {
+    Unmap();
+    if (path == NULL || *path == 0) return false;
+
+#if defined(MAPPED_FILE_POSIX)
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    base = MapDescriptor(fd, size);
+    close(fd); /* the mapping keeps its own reference to the file */
+    if (base == NULL) return false;
+
+    ApplyAdvice();
+    return true;
+#elif defined(WIN32) && !defined(HX_DOS)
+    DWORD flags = FILE_ATTRIBUTE_NORMAL;
+    if (advice == ADVICE_SEQUENTIAL) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+    else if (advice == ADVICE_RANDOM) flags |= FILE_FLAG_RANDOM_ACCESS;
+
+    HANDLE h = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, flags, NULL);
+    if (h == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER li;
+    if (!GetFileSizeEx(h, &li) || li.QuadPart <= 0 || (uint64_t)li.QuadPart > (uint64_t)(SIZE_MAX / 2)) {
+        CloseHandle(h);
+        return false;
+    }
+
+    /* large pages cannot back file mappings on Windows, so the huge page hint does not apply */
+    mapping = (void*)CreateFileMappingA(h, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(h);
+    if (mapping == NULL) return false;
+
+    base = (const uint8_t*)MapViewOfFile((HANDLE)mapping, FILE_MAP_READ, 0, 0, 0);
+    if (base == NULL) {
+        CloseHandle((HANDLE)mapping);
+        mapping = NULL;
+        return false;
+    }
+
+    size = (uint64_t)li.QuadPart;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MappedFile::Unmap(void) {
+    if (base == NULL) return;
+
+#if defined(MAPPED_FILE_POSIX)
+    munmap((void*)base, (size_t)size);
+#elif defined(WIN32) && !defined(HX_DOS)
+    UnmapViewOfFile((LPCVOID)base);
+    CloseHandle((HANDLE)mapping);
+    mapping = NULL;
+#endif
+
+    base = NULL;
+    size = 0;
+}
+
+void MappedFile::ApplyAdvice(void) {
+#if defined(MAPPED_FILE_POSIX)
+    if (advice == ADVICE_SEQUENTIAL)
+        madvise((void*)base, (size_t)size, MADV_SEQUENTIAL);
+    else if (advice == ADVICE_RANDOM)
+        madvise((void*)base, (size_t)size, MADV_RANDOM);
+
+# if defined(MADV_HUGEPAGE)
+    /* only honored for file mappings if the host kernel supports huge pages in the page cache */
+    if (hugepages && madvise((void*)base, (size_t)size, MADV_HUGEPAGE) != 0)
+        LOG(LOG_MISC,LOG_DEBUG)("Huge pages not available for mapped image");
+# endif
+#endif
+}
+
+bool MappedFile::Read(void *data, uint64_t offset, size_t count) const {
+    if (base == NULL || offset > size || (uint64_t)count > (size - offset)) return false;
+
+    memcpy(data, base + offset, count);
+    return true;
+}
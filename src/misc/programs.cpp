@@ -722,7 +722,7 @@ private:
 	}
 };
 
-void dos_ver_menu(bool start), ReloadMapper(Section_prop *sec, bool init), SetGameState_Run(int value), update_dos_ems_menu(void), MountAllDrives(bool quiet), GFX_SwitchFullScreen(void), RebootConfig(std::string filename, bool confirm=false);
+void dos_ver_menu(bool start), ReloadMapper(Section_prop *sec, bool init), SetGameState_Run(int value), REWIND_SetConfig(Section_prop *section), SaveState_DropChunkCache(void), update_dos_ems_menu(void), MountAllDrives(bool quiet), GFX_SwitchFullScreen(void), RebootConfig(std::string filename, bool confirm=false);
 bool set_ver(char *s), GFX_IsFullscreen(void);
 
 void Load_Language(std::string name) {
@@ -777,6 +777,10 @@ void ApplySetting(std::string pvar, std::string inputline, bool quiet) {
                 }
                 if (!strcasecmp(inputline.substr(0, 23).c_str(), "show recorded filename="))
                     show_recorded_filename = section->Get_bool("show recorded filename");
+                if (!strcasecmp(inputline.substr(0, 16).c_str(), "rewind interval=") || !strcasecmp(inputline.substr(0, 14).c_str(), "rewind memory="))
+                    REWIND_SetConfig(section);
+                if (!strcasecmp(inputline.substr(0, 25).c_str(), "save state in background=") && !section->Get_bool("save state in background"))
+                    SaveState_DropChunkCache();
                 if (!strcasecmp(inputline.substr(0, 6).c_str(), "title=")) {
                     dosbox_title=section->Get_string("title");
                     trim(dosbox_title);
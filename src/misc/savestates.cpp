@@ -16,6 +16,7 @@
 #include "logging.h"
 #include "mixer.h"
 #include "build_timestamp.h"
+#include "timer.h"
 #ifdef WIN32
 #include "direct.h"
 #endif
@@ -35,6 +36,16 @@
 #include "vs/zlib/contrib/minizip/unzip.c"
 #include "vs/zlib/contrib/minizip/ioapi.c"
 #include "zipcppstdbuf.h"
+#include <vector>
+#include <sstream>
+#include <deque>
+#include <memory>
+#include <chrono>
+#if !defined(HX_DOS) && !(defined(__MINGW32__) && !defined(__MINGW64_VERSION_MAJOR))
+# define SAVESTATE_THREADS 1
+# include <thread>
+# include <atomic>
+#endif
 #if !defined(HX_DOS)
 #include "../libs/tinyfiledialogs/tinyfiledialogs.h"
 #endif
@@ -186,19 +197,13 @@ namespace
 	}
 
 
-	void LoadGameState(bool pressed) {
-		if (!pressed) return;
-
-		//    if (SaveState::instance().isEmpty(currentSlot))
-		//    {
-		//        LOG_MSG("[%s]: State %d is empty!", getTime().c_str(), currentSlot + 1);
-		//        return;
-		//    }
+	/* Shared by loading from a slot and rewinding: errors are reported instead of thrown,
+	 * and the TTF output is resized to the restored screen. Returns false on error. */
+	template <typename Restore> bool RestoreGameState(Restore restore) {
 		if (!GFX_IsFullscreen()&&render.aspect) GFX_LosingFocus();
 		try
 		{
-			LOG_MSG("Loading state from slot: %d", (int)currentSlot + 1);
-			SaveState::instance().load(currentSlot);
+			restore();
 #if defined(USE_TTF)
 			if (ttf.inUse) resetFontSize();
 #endif
@@ -206,7 +211,23 @@ namespace
 		catch (const SaveState::Error& err)
 		{
 			notifyError(err);
+			return false;
 		}
+		return true;
+	}
+
+	void LoadGameState(bool pressed) {
+		if (!pressed) return;
+
+		//    if (SaveState::instance().isEmpty(currentSlot))
+		//    {
+		//        LOG_MSG("[%s]: State %d is empty!", getTime().c_str(), currentSlot + 1);
+		//        return;
+		//    }
+		RestoreGameState([]() {
+			LOG_MSG("Loading state from slot: %d", (int)currentSlot + 1);
+			SaveState::instance().load(currentSlot);
+		});
 	}
 
 	void NextSaveSlot(bool pressed) {
@@ -308,6 +329,214 @@ void ShowStateInfo(bool pressed) {
 	systemmessagebox("Saved state information", message.c_str(), "ok","info", 1);
 }
 
+/* In-memory ring of recent states for rewinding.
+ *
+ * Every "rewind interval" frames all components are captured into one buffer. The first
+ * capture, and any that changed too much or whose layout differs, becomes a keyframe that is
+ * kept whole. The others keep only the 4KB pages that differ from their keyframe, XORed with
+ * it and deflated. The oldest states are dropped to stay within "rewind memory", which also
+ * covers the scratch buffers; if a single keyframe does not fit, rewinding stays off until
+ * the setting is raised. */
+namespace
+{
+	struct RewindKeyframe {
+		std::vector<char> data;
+		std::vector<size_t> sizes;
+	};
+
+	struct RewindState {
+		std::shared_ptr<RewindKeyframe> key;
+		std::vector<uint32_t> pages;		/* pages that differ from the keyframe */
+		std::vector<unsigned char> delta;	/* those pages XOR the keyframe, deflated */
+		size_t bytes = 0;			/* memory used, not counting the keyframe */
+		double capture_ms = 0;
+	};
+
+	const size_t rewind_page = 4096;
+
+	std::deque<RewindState> rewind_ring;
+	std::shared_ptr<RewindKeyframe> rewind_key;
+	std::vector<char> rewind_buf;
+	std::vector<size_t> rewind_sizes;
+	std::vector<unsigned char> rewind_xor;
+	size_t rewind_too_large = 0;		/* budget that could not hold one keyframe, or 0 */
+	unsigned int rewind_frames = 0;
+	int rewind_interval = 0;			/* "rewind interval", read by REWIND_SetConfig */
+	size_t rewind_budget = 0;			/* "rewind memory" in bytes */
+	unsigned long rewind_captures = 0;
+	double rewind_ms_total = 0, rewind_ms_max = 0;
+
+	size_t REWIND_MemoryUsed(void) {
+		size_t used = rewind_buf.capacity() + rewind_xor.capacity() + rewind_sizes.capacity() * sizeof(size_t);
+		const RewindKeyframe *key = NULL;
+
+		/* states of the same keyframe are next to each other */
+		for (const auto &state : rewind_ring) {
+			used += state.bytes;
+			if (state.key.get() != key) {
+				key = state.key.get();
+				used += key->data.capacity();
+			}
+		}
+		return used;
+	}
+
+	void REWIND_Clear(void) {
+		rewind_ring.clear();
+		rewind_key.reset();
+		rewind_frames = 0;
+		std::vector<char>().swap(rewind_buf);
+		std::vector<unsigned char>().swap(rewind_xor);
+	}
+
+	size_t REWIND_PageSize(const RewindKeyframe &key, uint32_t page) {
+		const size_t offset = (size_t)page * rewind_page;
+		return std::min(rewind_page, key.data.size() - offset);
+	}
+}
+
+/* Called when the [dosbox] section is initialized and whenever either rewind setting changes,
+ * so that the per-frame path below does not have to look them up */
+void REWIND_SetConfig(Section_prop *section) {
+	rewind_interval = section->Get_int("rewind interval");
+	const int memory = section->Get_int("rewind memory");
+	rewind_budget = memory > 0 ? (size_t)memory * 1024 * 1024 : 0;
+}
+
+void REWIND_Frame(void) {
+	const int interval = rewind_interval;
+	if (interval <= 0) {
+		if (rewind_key) REWIND_Clear();
+		rewind_too_large = 0;
+		return;
+	}
+	if (++rewind_frames < (unsigned int)interval) return;
+	rewind_frames = 0;
+	if ((MEM_TotalPages()*4096/1024/1024)>1024) return;
+
+	const size_t budget = rewind_budget;
+	if (rewind_too_large != 0) {
+		if (budget <= rewind_too_large) return;
+		rewind_too_large = 0;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	RewindState state;
+
+	SaveState::instance().snapshot(rewind_buf, rewind_sizes);
+
+	bool keyframe = !rewind_key || rewind_key->sizes != rewind_sizes;
+	if (!keyframe) {
+		const char *cur = rewind_buf.data();
+		const char *key = rewind_key->data.data();
+		const size_t total = rewind_buf.size();
+
+		rewind_xor.clear();
+		for (size_t offset = 0;offset < total;offset += rewind_page) {
+			const size_t len = std::min(rewind_page, total - offset);
+			if (memcmp(cur + offset, key + offset, len) == 0) continue;
+
+			/* past a quarter of the state, a new keyframe is cheaper to keep and restore */
+			if (rewind_xor.size() + len > total / 4) {
+				keyframe = true;
+				break;
+			}
+			state.pages.push_back((uint32_t)(offset / rewind_page));
+			const size_t at = rewind_xor.size();
+			rewind_xor.resize(at + len);
+			for (size_t i = 0;i < len;i++)
+				rewind_xor[at + i] = (unsigned char)(cur[offset + i] ^ key[offset + i]);
+		}
+	}
+
+	if (keyframe) {
+		rewind_key = std::make_shared<RewindKeyframe>();
+		rewind_key->data = rewind_buf;
+		rewind_key->sizes = rewind_sizes;
+		state.pages.clear();
+	} else if (!rewind_xor.empty()) {
+		uLongf len = compressBound((uLong)rewind_xor.size());
+		state.delta.resize(len);
+		if (compress2(state.delta.data(), &len, rewind_xor.data(), (uLong)rewind_xor.size(), Z_BEST_SPEED) != Z_OK) return;
+		state.delta.resize(len);
+		state.delta.shrink_to_fit();
+		state.pages.shrink_to_fit();
+	}
+	state.key = rewind_key;
+	state.bytes = sizeof(RewindState) + state.pages.capacity() * sizeof(uint32_t) + state.delta.capacity();
+	state.capture_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	rewind_captures++;
+	rewind_ms_total += state.capture_ms;
+	if (rewind_ms_max < state.capture_ms) rewind_ms_max = state.capture_ms;
+	LOG(LOG_MISC,LOG_DEBUG)("Rewind: %s captured in %.2f ms, %u KB",
+		keyframe ? "keyframe" : "state", state.capture_ms,
+		(unsigned int)((keyframe ? rewind_key->data.size() : state.bytes) / 1024));
+
+	rewind_ring.push_back(std::move(state));
+
+	size_t used = REWIND_MemoryUsed();
+	while (rewind_ring.size() > 1 && used > budget) {
+		const RewindState &oldest = rewind_ring[0];
+		used -= oldest.bytes;
+		if (oldest.key != rewind_ring[1].key) used -= oldest.key->data.capacity();
+		rewind_ring.pop_front();
+	}
+	if (used > budget) {
+		LOG_MSG("Rewind: one state needs %u KB, more than the rewind memory of %u KB; rewinding is off",
+			(unsigned int)(used / 1024), (unsigned int)(budget / 1024));
+		REWIND_Clear();
+		rewind_too_large = budget;
+	}
+}
+
+/* Steps back to the newest state kept in memory, which is then dropped, so that each press
+ * goes further back */
+void RewindGameState(bool pressed) {
+	if (!pressed) return;
+	if (rewind_ring.empty()) {
+		LOG_MSG("No states kept for rewinding%s", rewind_interval > 0 ? "" : " (rewind interval is 0)");
+		return;
+	}
+
+	RewindState state = std::move(rewind_ring.back());
+	rewind_ring.pop_back();
+
+	const auto start = std::chrono::steady_clock::now();
+	const RewindKeyframe &key = *state.key;
+	rewind_buf = key.data;
+	if (!state.pages.empty()) {
+		size_t size = 0;
+		for (const uint32_t page : state.pages) size += REWIND_PageSize(key, page);
+
+		rewind_xor.resize(size);
+		uLongf len = (uLongf)size;
+		if (uncompress(rewind_xor.data(), &len, state.delta.data(), (uLong)state.delta.size()) != Z_OK || len != size) {
+			notifyError("Failed to decompress the state kept for rewinding.");
+			REWIND_Clear();
+			return;
+		}
+
+		const unsigned char *x = rewind_xor.data();
+		for (const uint32_t page : state.pages) {
+			char *p = rewind_buf.data() + (size_t)page * rewind_page;
+			const size_t n = REWIND_PageSize(key, page);
+			for (size_t i = 0;i < n;i++) p[i] ^= (char)x[i];
+			x += n;
+		}
+	}
+	if (!RestoreGameState([&]() { SaveState::instance().restore(rewind_buf, key.sizes); })) {
+		REWIND_Clear();
+		return;
+	}
+	rewind_frames = 0;
+
+	const double restore_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	LOG_MSG("Rewound: state captured in %.2f ms, restored in %.2f ms; %u states left in %u KB, capture average %.2f ms, max %.2f ms",
+		state.capture_ms, restore_ms, (unsigned int)rewind_ring.size(), (unsigned int)(REWIND_MemoryUsed() / 1024),
+		rewind_captures ? rewind_ms_total / rewind_captures : 0.0, rewind_ms_max);
+}
+
 void AddSaveStateMapper() {
 	DOSBoxMenu::item *item;
 	MAPPER_AddHandler(SaveGameState, MK_s, MMODHOST,"savestate","Save state", &item);
@@ -320,6 +549,8 @@ void AddSaveStateMapper() {
 	item->set_text("Select previous slot");
 	MAPPER_AddHandler(NextSaveSlot, MK_period, MMODHOST,"nextslot","Next save slot", &item);
 	item->set_text("Select next slot");
+	MAPPER_AddHandler(RewindGameState, MK_nothing, 0,"rewind","Rewind state", &item);
+	item->set_text("Rewind to previous state in memory");
 }
 
 #ifndef WIN32
@@ -362,6 +593,57 @@ void SaveState::registerComponent(const std::string& uniqueName, Component& comp
 	components.insert(std::make_pair(uniqueName, CompData(comp)));
 }
 
+namespace
+{
+	/* Appends to a vector, which keeps its capacity from one snapshot to the next. Like
+	 * zip_ostreambuf it only takes writes, not single characters, so that what is captured
+	 * is byte for byte what goes into a save file. */
+	class vector_ostreambuf : public std::streambuf {
+	public:
+		vector_ostreambuf(std::vector<char> &n_buf) : buf(n_buf) { }
+	protected:
+		std::streamsize xsputn(const char_type *s, std::streamsize count) override {
+			buf.insert(buf.end(), s, s + count);
+			return count;
+		}
+	private:
+		std::vector<char> &buf;
+	};
+
+	class memory_istreambuf : public std::streambuf {
+	public:
+		memory_istreambuf(const char *data, size_t size) {
+			char *p = const_cast<char*>(data);
+			setg(p, p, p + size);
+		}
+	};
+}
+
+void SaveState::snapshot(std::vector<char>& data, std::vector<size_t>& sizes) {
+	vector_ostreambuf vos(data);
+	std::ostream ss(&vos);
+
+	data.clear();
+	sizes.clear();
+	for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
+		const size_t start = data.size();
+		i->second.comp.getBytes(ss);
+		sizes.push_back(data.size() - start);
+	}
+}
+
+void SaveState::restore(const std::vector<char>& data, const std::vector<size_t>& sizes) const {
+	size_t offset = 0, n = 0;
+
+	for (CompEntry::const_iterator i = components.begin(); i != components.end() && n < sizes.size(); ++i, ++n) {
+		memory_istreambuf mis(data.data() + offset, sizes[n]);
+		std::istream ss(&mis);
+
+		i->second.comp.setBytes(ss);
+		offset += sizes[n];
+	}
+}
+
 #define CASESENSITIVITY (0)
 #define MAXFILENAME (256)
 
@@ -413,20 +695,356 @@ int zipOutOpenFile(zipFile zf,const char *zfname,zip_fileinfo &zi,const bool com
 		NULL/*password*/,0/*crcFile*/,1/*zip64*/);
 }
 
+#define SAVE_DEFLATE_CHUNK ((size_t)1024*1024)
+
+/* The chunks of the last save of a part. A chunk is reused as is if neither its data nor
+ * the 32KB before it changed since, which for guest memory is most of it between saves. */
+struct SaveChunkCache {
+	std::vector<char> data;
+	std::vector< std::vector<unsigned char> > out;
+	std::vector<uLong> crc;
+};
+static std::map<std::string,SaveChunkCache> save_chunk_cache;
+
+/* std::streambuf that writes one deflated ZIP entry in chunks, pigz style: each chunk is raw
+ * deflate data primed with the 32KB before it and ended with a sync flush, and an empty final
+ * block ends the entry, so together they form one ordinary deflated entry. Large writes, such
+ * as guest memory, are deflated straight from the component's buffer on all the threads given,
+ * and small ones are gathered into a chunk first, so a part is never held whole in memory.
+ * Like zip_ostreambuf, only one entry can be written at a time. */
+class zip_deflate_ostreambuf : public std::streambuf {
+public:
+	zip_deflate_ostreambuf(zipFile &n_zf,size_t n_threads,SaveChunkCache *n_cache) : zf(n_zf), threads(n_threads != 0 ? n_threads : 1), cache(n_cache) { }
+	virtual ~zip_deflate_ostreambuf() { close(); }
+
+	int open(const char *zfname,zip_fileinfo &zi) {
+		err = zipOpenNewFileInZip3_64(zf,zfname,&zi,
+			NULL,0,NULL,0,NULL/* comment*/,
+			Z_DEFLATED,9,1/*raw*/,
+			-MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY,
+			NULL/*password*/,0/*crcFile*/,1/*zip64*/);
+		opened = (err == ZIP_OK);
+		return err;
+	}
+
+	int close(void) {
+		if (!opened) return err;
+		opened = false;
+
+		if (!pending.empty()) deflateChunks(pending.data(), pending.size());
+		/* an empty final block ends the deflate data */
+		static const unsigned char final_block[2] = { 0x03, 0x00 };
+		write(final_block, sizeof(final_block));
+
+		const int errclose = zipCloseFileInZipRaw64(zf, (ZPOS64_T)total, crc);
+		if (err == ZIP_OK) err = errclose;
+
+		if (cache != NULL) {
+			if (err == ZIP_OK) {
+				cache->out.swap(outs);
+				cache->crc.swap(crcs);
+			} else {
+				*cache = SaveChunkCache();
+			}
+		}
+		return err;
+	}
+protected:
+	std::streamsize xsputn(const char_type *s, std::streamsize count) override {
+		const Bytef *p = (const Bytef*)s;
+		size_t left = (size_t)count;
+
+		if (err != ZIP_OK) return 0;
+		/* complete a partly gathered chunk first */
+		if (!pending.empty()) {
+			const size_t n = std::min(left, SAVE_DEFLATE_CHUNK - pending.size());
+			pending.insert(pending.end(), p, p + n);
+			p += n;
+			left -= n;
+			if (pending.size() < SAVE_DEFLATE_CHUNK) return count;
+			deflateChunks(pending.data(), pending.size());
+			pending.clear();
+		}
+		/* whole chunks are deflated straight from the caller's buffer */
+		const size_t whole = left - left % SAVE_DEFLATE_CHUNK;
+		if (whole != 0) {
+			deflateChunks(p, whole);
+			p += whole;
+			left -= whole;
+		}
+		pending.insert(pending.end(), p, p + left);
+		return err == ZIP_OK ? count : 0;
+	}
+private:
+	struct Chunk {
+		std::vector<unsigned char> out;
+		uLong crc = 0;
+		bool ok = false;
+	};
+
+	void write(const void *data,size_t size) {
+		if (err == ZIP_OK && size != 0) err = zipWriteInFileInZip(zf, data, (unsigned int)size);
+	}
+
+	void deflateChunk(Chunk &k,size_t index,const Bytef *in,size_t size,const Bytef *dict,size_t dictsize) {
+		if (cache != NULL && index < cache->out.size()) {
+			const size_t offset = index * SAVE_DEFLATE_CHUNK;
+			const std::vector<char> &old = cache->data;
+			if (offset + size == std::min(offset + SAVE_DEFLATE_CHUNK, old.size()) &&
+				memcmp(old.data() + offset, in, size) == 0 &&
+				memcmp(old.data() + offset - dictsize, dict, dictsize) == 0) {
+				k.out.swap(cache->out[index]);
+				k.crc = cache->crc[index];
+				k.ok = true;
+				return;
+			}
+		}
+
+		k.crc = crc32(0L, in, (uInt)size);
+
+		z_stream zs;
+		memset(&zs, 0, sizeof(zs));
+		if (deflateInit2(&zs, 9, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) return;
+		if (dictsize != 0) deflateSetDictionary(&zs, dict, (uInt)dictsize);
+		k.out.resize(deflateBound(&zs, (uLong)size) + 64); /* room for the sync flush marker */
+		zs.next_in = (Bytef*)in;
+		zs.avail_in = (uInt)size;
+		zs.next_out = k.out.data();
+		zs.avail_out = (uInt)k.out.size();
+		k.ok = deflate(&zs, Z_SYNC_FLUSH) == Z_OK && zs.avail_in == 0;
+		k.out.resize(k.out.size() - zs.avail_out);
+		deflateEnd(&zs);
+	}
+
+	/* len is a multiple of the chunk size, except at the end of the entry */
+	void deflateChunks(const Bytef *p,size_t len) {
+		const size_t count = (len + SAVE_DEFLATE_CHUNK - 1) / SAVE_DEFLATE_CHUNK;
+		const size_t first = (size_t)(total / SAVE_DEFLATE_CHUNK);
+		std::vector<Chunk> chunks(count);
+
+		auto chunk = [&](size_t c) {
+			const Bytef *in = p + c * SAVE_DEFLATE_CHUNK;
+			const size_t size = std::min(SAVE_DEFLATE_CHUNK, len - c * SAVE_DEFLATE_CHUNK);
+			if (c == 0)
+				deflateChunk(chunks[c], first, in, size, tail, tailsize);
+			else
+				deflateChunk(chunks[c], first + c, in, size, in - sizeof(tail), sizeof(tail));
+		};
+#if defined(SAVESTATE_THREADS)
+		std::atomic<size_t> next(0);
+		auto work = [&]() {
+			size_t c;
+			while ((c = next++) < count) chunk(c);
+		};
+		std::vector<std::thread> helpers;
+		for (size_t t=1;t < threads && t < count;t++) helpers.emplace_back(work);
+		work();
+		for (auto &t : helpers) t.join();
+#else
+		for (size_t c=0;c < count;c++) chunk(c);
+#endif
+
+		for (size_t c=0;c < count;c++) {
+			Chunk &k = chunks[c];
+			if (!k.ok) {
+				if (err == ZIP_OK) err = ZIP_INTERNALERROR;
+				return;
+			}
+			write(k.out.data(), k.out.size());
+			crc = crc32_combine(crc, k.crc, (z_off_t)std::min(SAVE_DEFLATE_CHUNK, len - c * SAVE_DEFLATE_CHUNK));
+			if (cache != NULL) {
+				outs.emplace_back();
+				outs.back().swap(k.out);
+				crcs.push_back(k.crc);
+			}
+		}
+		total += len;
+
+		/* the last 32KB primes the next chunk */
+		if (len >= sizeof(tail)) {
+			memcpy(tail, p + len - sizeof(tail), sizeof(tail));
+			tailsize = sizeof(tail);
+		} else {
+			const size_t keep = std::min(tailsize, sizeof(tail) - len);
+			memmove(tail, tail + tailsize - keep, keep);
+			memcpy(tail + keep, p, len);
+			tailsize = keep + len;
+		}
+	}
+
+	zipFile zf = NULL;
+	size_t threads;
+	SaveChunkCache *cache;
+	bool opened = false;
+	int err = ZIP_OK;
+	std::vector<unsigned char> pending;
+	Bytef tail[32768];
+	size_t tailsize = 0;
+	uint64_t total = 0;
+	uLong crc = 0;
+	std::vector< std::vector<unsigned char> > outs;	/* for the cache */
+	std::vector<uLong> crcs;
+};
+
+/* Writes one part to the open ZIP file, as fill() streams it out */
+static bool zipWriteSavePart(zipFile zf,const char *name,zip_fileinfo &zi,const bool compress,size_t threads,SaveChunkCache *cache,const std::function<void(std::ostream&)> &fill) {
+	if (compress) {
+		zip_deflate_ostreambuf zds(zf,threads,cache);
+		if (zds.open(name,zi) != ZIP_OK) return false;
+		std::ostream stream(&zds);
+		fill(stream);
+		return zds.close() == ZIP_OK;
+	}
+
+	if (zipOutOpenFile(zf,name,zi,false) != ZIP_OK) return false;
+	zip_ostreambuf zos(zf);
+	std::ostream stream(&zos);
+	fill(stream);
+	return zos.close() == ZIP_OK;
+}
+
+/* Save files are written to a temporary file first, which replaces the old one once complete */
+static zipFile zipOpenSaveFile(const std::string &temp) {
+	const char *global_comment = "DOSBox-X save state";
+	zlib_filefunc64_def ffunc;
+#ifdef USEWIN32IOAPI
+	fill_win32_filefunc64A(&ffunc);
+#else
+	fill_fopen64_filefunc(&ffunc);
+#endif
+	remove(temp.c_str());
+	return zipOpen2_64(temp.c_str(),APPEND_STATUS_CREATE,&global_comment,&ffunc);
+}
+
+static bool zipCloseSaveFile(zipFile zf,const std::string &temp,const std::string &file,bool ok) {
+	if (zipClose(zf,NULL) != ZIP_OK) ok = false;
+	if (ok) {
+		remove(file.c_str());
+		ok = rename(temp.c_str(),file.c_str()) == 0;
+	}
+	if (!ok) remove(temp.c_str());
+	return ok;
+}
+
+#if defined(SAVESTATE_THREADS)
+/* A component or info file of a state, as captured for writing in the background */
+struct SavePart {
+	std::string name;
+	std::vector<char> data;
+	zip_fileinfo zi;
+};
+
+static bool zipWriteSaveParts(const std::string &file,std::vector<SavePart> &parts,const bool compress) {
+	const std::string temp = file + ".tmp";
+	zipFile zf = zipOpenSaveFile(temp);
+	if (zf == NULL) return false;
+
+	/* leave a core to the emulation, which keeps running meanwhile */
+	size_t threads = std::thread::hardware_concurrency();
+	if (threads > 1) threads--;
+
+	bool ok = true;
+	for (auto &part : parts) {
+		/* small parts are not worth keeping a copy of */
+		SaveChunkCache *cache = part.data.size() >= 2*SAVE_DEFLATE_CHUNK ? &save_chunk_cache[part.name] : NULL;
+		const std::vector<char> &data = part.data;
+		if (!zipWriteSavePart(zf,part.name.c_str(),part.zi,compress,threads,compress ? cache : NULL,[&data](std::ostream &stream) { stream.write(data.data(),(std::streamsize)data.size()); })) {
+			ok = false;
+			break;
+		}
+		if (compress && cache != NULL) cache->data.swap(part.data);
+		part.data = std::vector<char>();
+	}
+	return zipCloseSaveFile(zf,temp,file,ok);
+}
+#endif
+
+static void reportSave(bool ok,size_t slot,const std::string &when) {
+	if (!ok)
+		notifyError("Failed to save the current state.");
+	else
+		LOG_MSG("[%s]: Saved. (Slot %d)", when.c_str(), (int)slot+1);
+}
+
+#if defined(SAVESTATE_THREADS)
+/* Writes out a captured state while emulation continues. One save is in flight at a time;
+ * the next save, loading a state or removing one wait for it to finish first. */
+class SaveStateWriter {
+public:
+	~SaveStateWriter() {
+		if (thread.joinable()) thread.join();
+	}
+
+	void Start(const std::string &n_file,std::vector<SavePart> &&n_parts,bool compress,size_t n_slot,const std::string &n_when) {
+		Finish();
+		file = n_file;
+		parts = std::move(n_parts);
+		slot = n_slot;
+		when = n_when;
+		done = false;
+		thread = std::thread([this,compress]() {
+			ok = zipWriteSaveParts(file,parts,compress);
+			parts.clear();
+			done = true;
+		});
+		TIMER_AddTickHandler(Poll);
+	}
+
+	/* waits for the save in flight, if any, and reports how it went */
+	void Finish(void) {
+		if (!thread.joinable()) return;
+		thread.join();
+		TIMER_DelTickHandler(Poll);
+		reportSave(ok,slot,when);
+		refresh_slots();
+	}
+
+	static void Poll(void);
+private:
+	std::thread thread;
+	std::string file, when;
+	std::vector<SavePart> parts;
+	size_t slot = 0;
+	bool ok = false;
+	std::atomic<bool> done{false};
+};
+
+static SaveStateWriter save_state_writer;
+
+void SaveStateWriter::Poll(void) {
+	if (save_state_writer.done) save_state_writer.Finish();
+}
+#endif
+
+/* The chunk cache holds a copy of guest memory and video memory from the last background save,
+ * so it is only kept while saving in the background with compression */
+void SaveState_DropChunkCache(void) {
+#if defined(SAVESTATE_THREADS)
+	save_state_writer.Finish();
+#endif
+	std::map<std::string,SaveChunkCache>().swap(save_chunk_cache);
+}
+
 void SaveState::save(size_t slot) { //throw (Error)
 	if (slot >= SLOT_COUNT*MAX_PAGE)  return;
+#if defined(SAVESTATE_THREADS)
+	save_state_writer.Finish();
+#endif
 #ifdef C_SDL2
         SDL_PauseAudioDevice(SDL2_AudioDevice, 0);
 #else
         SDL_PauseAudio(0);
 #endif
-	bool save_err=false;
 	if((MEM_TotalPages()*4096/1024/1024)>1024) {
 		LOG_MSG("Stopped. 1 GB is the maximum memory size for saving/loading states.");
 		notifyError("Unsupported memory size for saving states.", false);
 		return;
 	}
 	bool compresssaveparts = static_cast<Section_prop *>(control->GetSection("dosbox"))->Get_bool("compresssaveparts");
+#if defined(SAVESTATE_THREADS)
+	bool background = static_cast<Section_prop *>(control->GetSection("dosbox"))->Get_bool("save state in background");
+	if (!background || !compresssaveparts) SaveState_DropChunkCache();
+#endif
 	const char *save_remark = "";
 #if !defined(HX_DOS)
 	if (auto_save_state)
@@ -457,7 +1075,6 @@ void SaveState::save(size_t slot) { //throw (Error)
 		save_remark = new_remark;
 	}
 #endif
-	int errclose;
 	std::string path;
 	bool Get_Custom_SaveDir(std::string& savedir);
 	if(Get_Custom_SaveDir(path)) {
@@ -482,100 +1099,78 @@ void SaveState::save(size_t slot) { //throw (Error)
 	temp=path;
 	std::string save=use_save_file&&savefilename.size()?savefilename:temp+slotname.str()+".sav";
 
-	zipFile zf;
-	{
-		const char *global_comment = "DOSBox-X save state";
-		zlib_filefunc64_def ffunc;
-#ifdef USEWIN32IOAPI
-		fill_win32_filefunc64A(&ffunc);
-#else
-		fill_fopen64_filefunc(&ffunc);
-#endif
-		remove(save.c_str());
-		zf = zipOpen2_64(save.c_str(),APPEND_STATUS_CREATE,&global_comment,&ffunc);
-	}
-	if (zf == NULL) { save_err = true; goto done; }
-
-	{
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,"DOSBox-X_Version",zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream emulatorversion(&zos);
-
-		emulatorversion << "DOSBox-X " << VERSION << " (" << SDL_STRING << ")" << std::endl << GetPlatform(true) << std::endl << UPDATED_STR;
-		/* 2025/01/12: Backwards compat: The old code compressed data to zlib, even though the ZIP support code
-		 *             already applies compression. This is to tell the old code that we did not compress the
-		 *             data (the ZIP support code did though). */
-		emulatorversion << std::endl << "No compression";
-
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
-	}
-	{
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,"Program_Name",zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream programname(&zos);
-
-		programname << RunningProgram;
-
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
-	}
-	{
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,"Memory_Size",zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream memorysize(&zos);
-
-		memorysize << MEM_TotalPages();
-
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
-	}
-	{
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,"Machine_Type",zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream machinetype(&zos);
-
-		machinetype << getType();
-
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
-	}
-	{
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,"Time_Stamp",zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream timestamp(&zos);
-
-		timestamp << getTime(true);
-
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
-	}
-	{
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,"Save_Remark",zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream saveremark(&zos);
-
-		saveremark << std::string(save_remark);
-
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
-	}
-	for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
-		zip_fileinfo zi; zipSetCurrentTime(zi);
-		if ((errclose=zipOutOpenFile(zf,i->first.c_str(),zi,compresssaveparts)) != ZIP_OK) { save_err = true; goto done; }
-		zip_ostreambuf zos(zf); std::ostream ss(&zos);
-
-		i->second.comp.getBytes(ss);
+	/* Streams out the info files and components of the state, in the order they are saved */
+	const auto writeParts = [&](const std::function<bool(const char *name,const std::function<void(std::ostream&)> &fill)> &part) -> bool {
+		if (!part("DOSBox-X_Version",[&](std::ostream &emulatorversion) {
+			/* Only the version line is stored. The platform, UPDATED_STR and "No compression" lines that used to
+			 * follow it were never written, because the ZIP stream stopped at the first std::endl, and the loader
+			 * (of this and older versions) compares the entry against the version line alone. Written out
+			 * explicitly so that the entry does not depend on how the stream it goes through handles std::endl. */
+			emulatorversion << "DOSBox-X " << VERSION << " (" << SDL_STRING << ")";
+		})) return false;
+		if (!part("Program_Name",[&](std::ostream &programname) {
+			programname << RunningProgram;
+		})) return false;
+		if (!part("Memory_Size",[&](std::ostream &memorysize) {
+			memorysize << MEM_TotalPages();
+		})) return false;
+		if (!part("Machine_Type",[&](std::ostream &machinetype) {
+			machinetype << getType();
+		})) return false;
+		if (!part("Time_Stamp",[&](std::ostream &timestamp) {
+			timestamp << getTime(true);
+		})) return false;
+		if (!part("Save_Remark",[&](std::ostream &saveremark) {
+			saveremark << std::string(save_remark);
+		})) return false;
+		for (CompEntry::iterator i = components.begin(); i != components.end(); ++i) {
+			if (!part(i->first.c_str(),[&](std::ostream &ss) {
+				i->second.comp.getBytes(ss);
+			})) return false;
+		}
+		return true;
+	};
 
-		if ((errclose=zos.close()) != ZIP_OK) { save_err = true; goto done; }
+#if defined(SAVESTATE_THREADS)
+	if (background) {
+		/* capture everything now, then compress and write it out while emulation continues */
+		std::vector<SavePart> parts;
+		writeParts([&](const char *name,const std::function<void(std::ostream&)> &fill) {
+			parts.emplace_back();
+			SavePart &part = parts.back();
+			part.name = name;
+			zipSetCurrentTime(part.zi);
+			vector_ostreambuf vos(part.data);
+			std::ostream stream(&vos);
+			fill(stream);
+			return true;
+		});
+		save_state_writer.Start(save,std::move(parts),compresssaveparts,slot,getTime());
+		if (!dos_kernel_disabled) flagged_backup((char *)save.c_str());
+		return;
 	}
+#endif
 
-done:
+	/* the components stream straight into the ZIP file */
+	const std::string tempfile = save + ".tmp";
+	bool save_ok = false;
+	zipFile zf = zipOpenSaveFile(tempfile);
 	if (zf != NULL) {
-		errclose = zipClose(zf,NULL);
-		if (errclose != ZIP_OK) save_err = true;
+#if defined(SAVESTATE_THREADS)
+		const size_t threads = std::thread::hardware_concurrency();
+#else
+		const size_t threads = 1;
+#endif
+		save_ok = writeParts([&](const char *name,const std::function<void(std::ostream&)> &fill) {
+			zip_fileinfo zi; zipSetCurrentTime(zi);
+			return zipWriteSavePart(zf,name,zi,compresssaveparts,threads,NULL,fill);
+		});
+		save_ok = zipCloseSaveFile(zf,tempfile,save,save_ok);
 	}
 
 	if (!dos_kernel_disabled) flagged_backup((char *)save.c_str());
 
-	if (save_err)
-		notifyError("Failed to save the current state.");
-	else
-		LOG_MSG("[%s]: Saved. (Slot %d)", getTime().c_str(), (int)slot+1);
+	reportSave(save_ok,slot,getTime());
 }
 
 void savestatecorrupt(const char* part) {
@@ -595,6 +1190,9 @@ bool loadstateconfirm(int ind) {
 
 void SaveState::load(size_t slot) const { //throw (Error)
 	//	if (isEmpty(slot)) return;
+#if defined(SAVESTATE_THREADS)
+	save_state_writer.Finish();
+#endif
 	bool load_err=false;
 	if((MEM_TotalPages()*4096/1024/1024)>1024) {
 		LOG_MSG("Stopped. 1 GB is the maximum memory size for saving/loading states.");
@@ -810,6 +1408,9 @@ bool SaveState::isEmpty(size_t slot) const {
 
 void SaveState::removeState(size_t slot) const {
 	if (slot >= SLOT_COUNT*MAX_PAGE) return;
+#if defined(SAVESTATE_THREADS)
+	save_state_writer.Finish();
+#endif
 	std::string path;
 	bool Get_Custom_SaveDir(std::string& savedir);
 	if(Get_Custom_SaveDir(path)) {